@@ -4,9 +4,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
+#include <stdint.h>
 
-#define ARRAY_ALLOCATION 20 //elements in array (size in bytes depends on array type)
+#define ARRAY_ALLOCATION 20 //initial elements of string, compound and nested arrays, doubled when full (flat bool and
+                            //number arrays are counted first and allocated at their exact size)
+#define INCLUDE_MAX_DEPTH 32 //#include files nested deeper are left out with an error, so a file including itself ends
 
 /* These macros use decltype or the earlier __typeof GNU extension.
    As decltype is only available in newer compilers (VS2010 or gcc 4.3+
@@ -26,43 +30,63 @@
 #endif
 #endif
 
-#define HASH_ITER(hashmap, o) for (DECLTYPE(hashmap) tmp = hashmap;tmp-(hashmap)<OPTION_HASHMAP_SIZE;++tmp) for((o) = *tmp;o;(o)=(o)->next)
+#define CONFIG_ARENA_CHUNK_SIZE (64 * 1024) //default size of the chunks an arena config allocates from
+#define OPTION_TABLE_INITIAL_SIZE 8 //slots in a new option table, must be a power of two
+#define OPTION_TABLE_MAX_LOAD(capacity) ((capacity) / 4 * 3) //table grows once it holds more options than this
 
-#define OPTION_HASHMAP_SIZE 50
+/*
+ * A config (or compound) is an open-addressing hash table. The Option ** handle returned by INIT_CONFIG points to
+ * an OptionTable and stays valid while the table grows, so it can be stored in compounds before all options are added.
+ * Slots are probed linearly over a dense array of 32-bit hash fingerprints, so names are only compared on a
+ * fingerprint match. Names are hashed with SipHash under a random per-process key, which keeps crafted keys from
+ * piling up in one run.
+ * The elements of a compound array share their template's options: an element's table only holds the options its
+ * `{...}` set (copied from the template when first written) and lookups fall through to the template for the rest.
+ * HASH_ITER visits both, so an element iterates like a full copy of its template.
+ */
+/*
+ * An arena config (INIT_CONFIG_ARENA) takes its tables, options and everything parsed into it from large chunks
+ * instead of one malloc per allocation. The chunks are released all at once: parsed values on the next readConfig
+ * (which resets options to their defaults first) and everything else on cleanOptions.
+ */
+typedef struct ConfigArena ConfigArena;
 
-//https://stackoverflow.com/a/8317622
-#define A 54059 /* a prime */
-#define B 76963 /* another prime */
-#define FIRSTH 37 /* also prime */
+/*
+ * A string that isn't null-terminated, e.g. a value left in the buffer of a mapped config (see readConfigMapped).
+ * TEXT options always have a valid view, so v_sv works in every mode, while v_s is only null-terminated if the
+ * config wasn't loaded with readConfigMapped.
+ */
+typedef struct StringView {
+    const char *ptr;
+    size_t len;
+} StringView;
 
-#define HASH_ADD(hashmap, value) do{                            \
-    unsigned hash = FIRSTH;                                     \
-    char *key = (value)->name;                                  \
-    while (*key) {                                              \
-        hash = (hash * A) ^ (key[0] * B);                       \
-        key++;                                                  \
-    }                                                           \
-    hash %= OPTION_HASHMAP_SIZE;                                \
-                                                                \
-    DECLTYPE(hashmap) next = &(hashmap)[hash];                  \
-    if (*next)                                                  \
-        while (*(next = &((*next)->next))) {}                   \
-    *next = value;                                              \
-}while(0)
+typedef struct OptionTable {
+    uint32_t *hashes; //Hash fingerprint for each slot, 0 marks an empty slot
+    struct Option **slots;
+    size_t capacity; //A power of two, or count once the table is frozen
+    size_t count;
+    ConfigArena *arena; //NULL if the table and its options are heap allocated
+    bool ownsArena; //Set on the root table of an arena config, cleaning it frees the arena
+    char *source; //Buffer the string views of a mapped config point into, kept until the next load or cleanOptions
+    size_t sourceLen;
+    bool sourceMapped; //source is a mapping of the config file rather than a heap buffer
+    bool stringViews; //String arrays hold StringViews (a_sv) rather than char * (a_s), after readConfigMapped
+    struct RootSettings *settings; //Of a root table (setParseThreads and the like), NULL until one is set
+    const struct OptionTable *base; //Template a compound array element falls back to, NULL for every other table
+    uint32_t *seeds; //Seed of each bucket of a frozen table (see freezeConfig), NULL while the table is probed
+    size_t seedMask; //Buckets - 1 of a frozen table
+} OptionTable;
+
+#define OPTION_TABLE(hashmap) ((OptionTable *) (hashmap))
+
+#define HASH_ITER(hashmap, o) for (size_t tmp = 0; ((o) = optionTableNext(hashmap, &tmp)); )
+
+#define HASH_ADD(hashmap, value) optionTableAdd(hashmap, value)
 
 #define HASH_FIND(hashmap, key, out) do{                        \
-    unsigned hash = FIRSTH;                                     \
-    char* k = key;                                              \
-    while (*k) {                                                \
-        hash = (hash * A) ^ (k[0] * B);                         \
-        k++;                                                    \
-    }                                                           \
-    hash %= OPTION_HASHMAP_SIZE;                                \
-                                                                \
-    (out) = (hashmap)[hash];                                    \
-    while ((out) && strcmp(((out))->name, key) != 0) {          \
-        (out) = ((out))->next;                                  \
-    }                                                           \
+    const char *k = (key);                                      \
+    (out) = optionTableFind(hashmap, k, strlen(k));             \
 }while(0)
 
 enum Type {
@@ -80,6 +104,7 @@ typedef struct ArrayOption {
         double *a_d;
         bool *a_b;
         char **a_s;
+        StringView *a_sv; //Instead of a_s in configs loaded with readConfigMapped
         struct {
             struct Option ***a_v; //Array of hash-tables (hash-table is ** and array is *)
             struct Option **a_v_t; //"Template" that all elements in the array will follow
@@ -93,6 +118,24 @@ typedef struct ArrayOption {
     enum Type type;
 } ArrayOption;
 
+//What an option is reset to. A compound's default is its own table, so it has none here
+typedef struct OptionDefault {
+    union {
+        long dv_l;
+        double dv_d;
+        bool dv_b;
+        char *dv_s;
+        StringView dv_sv;
+        struct ArrayOption dv_a;
+    };
+} OptionDefault;
+
+/*
+ * Only what a lookup reads is kept in the option itself: the name to compare, the current value and its type. The
+ * default is only read when the option is reset or written out, so it lives apart (in its own region in an arena
+ * config), which keeps options small and lets more of them share the cache. The elements of a compound array share
+ * the defaults of their template's options.
+ */
 typedef struct Option {
     char *name; //Key
     union {
@@ -100,27 +143,406 @@ typedef struct Option {
         double v_d;
         bool v_b;
         char *v_s;
+        StringView v_sv;
         struct Option **v_v;
         struct ArrayOption v_a;
     };
     enum Type type;
-    union {
-        long dv_l;
-        double dv_d;
-        bool dv_b;
-        char *dv_s;
-        struct Option **dv_v;
-        struct ArrayOption dv_a;
-    };
-    struct Option *next; //Used as a linked list in hash map
+    OptionDefault *def;
 } Option;
 
+/*
+ * One entry of a static schema, see INIT_CONFIG_STATIC. Declared with the STATIC_* macros, so a schema can be a
+ * `static const StaticOption[]` that lives in read-only data; its options point at the defaults in it rather than
+ * copying them.
+ */
+typedef struct StaticOption {
+    const char *name; //NULL ends a schema (STATIC_END)
+    enum Type type;
+    OptionDefault def; //Element type of an array in def.dv_a.type
+    const struct StaticOption *schema; //Options of a compound, or the template of a compound array
+} StaticOption;
+
 size_t getFileSize(const char *filename);
 
+struct Option **optionTableCreate(size_t expected);
+
+struct Option **optionTableCreateArena(size_t chunkSize);
+
+struct Option **optionTableCreateStatic(const StaticOption *schema);
+
+struct Option **optionTableCreateChild(struct Option **parent);
+
+struct Option *optionAlloc(struct Option **table);
+
+void optionTableAdd(struct Option **table, struct Option *opt);
+
+struct Option *optionTableFind(struct Option **table, const char *key, size_t keyLen);
+
+uint32_t optionTableHash(const char *key, size_t keyLen);
+
+struct Option *optionTableFindHashed(struct Option **table, const char *key, size_t keyLen, uint32_t hash);
+
+struct Option **optionTableClone(struct Option **table);
+
+struct Option *optionTableNext(struct Option **table, size_t *cursor);
+
+void optionTableFree(struct Option **table);
+
+/*
+ * Once every option is added the keys of a config don't change, so its tables (compounds and compound array templates
+ * included) can be frozen into minimal perfect hashes: each key has exactly one slot, found from its hash and a seed
+ * per small bucket of keys, so a lookup is one slot and one name compare, hit or miss, and the table shrinks to one
+ * slot per option. Adding an option to a frozen table turns it back into a probed one. Returns false if a table
+ * couldn't be frozen (two of its names share a 32-bit hash), it's left as it is then.
+ */
+bool freezeConfig(struct Option **config);
+
 void readConfig(Option **config, const char *filename);
 
+/*
+ * Like readConfig, but the file is mapped into memory and stays mapped for the life of the config. Strings are not
+ * copied: TEXT options and string arrays are StringViews into the mapping (read them with a StringView or
+ * StringView * out parameter). Every load resets options that the file doesn't set to their defaults.
+ */
+void readConfigMapped(Option **config, const char *filename);
+
+/*
+ * Like readConfig, but the values are loaded from a binary cache at cachePath if it was written for the same file and
+ * none of the files and #include directories it was read from changed since (same device, inode, size and mtime).
+ * Loading one is a mapping of the cache plus a pass over it: strings point into the mapping, which stays mapped until
+ * the next load or cleanOptions, only arrays are copied. Otherwise the file is parsed and the cache (re)written, so a
+ * cache that is stale, damaged, from another build or from before the schema changed just costs one parse. Values are
+ * the ones readConfig gives, except that options the file doesn't set are always reset to their defaults. Returns true
+ * if the values came from the cache.
+ */
+bool readConfigCached(Option **config, const char *filename, const char *cachePath);
+
+/*
+ * Opt-in: compound arrays with many elements are split at their element boundaries first, then the elements are
+ * parsed on up to threads threads (the calling one included). Files matched by an #include are read and preprocessed
+ * on as many threads. Applies to readConfig, readConfigMapped and the push parser. Values come out the same as with
+ * a serial parse, only messages from different elements or files may be interleaved differently. 0 or 1 parses
+ * serially, which is the default. Ignored on Windows.
+ */
+void setParseThreads(Option **config, unsigned threads);
+
+#ifdef LIBCONF_SCAN_SELECT
+//Only in the copy of the library the benchmarks link: switches the structural scanner to its scalar path (or back to
+//SIMD), returns the name of the path now in use ("AVX2", "SSE2" or "scalar" for a build without SIMD)
+const char *setScalarScan(bool scalar);
+#endif
+
+/*
+ * Opt-in cache of preprocessed #include files. An entry is reused as long as the file and everything it includes
+ * (files and the directories their patterns are matched in) have the same device, inode, size and mtime as when it
+ * was read, so repeated includes and reloads skip both the read and the nested preprocessing. A cache can be shared
+ * by any number of configs, it must outlive them (or be detached with setIncludeCache(config, NULL)). A config with
+ * setIncrementalReload bypasses it: its loads need a source map of every included file, which entries don't keep.
+ */
+typedef struct IncludeCache IncludeCache;
+
+typedef struct IncludeCacheStats {
+    size_t hits;
+    size_t misses; //Lookups that had to read the file, because it wasn't cached or had changed
+    size_t entries;
+    size_t bytes; //Preprocessed contents held by the entries
+} IncludeCacheStats;
+
+IncludeCache *includeCacheCreate(void);
+
+void includeCacheFree(IncludeCache *cache);
+
+IncludeCacheStats includeCacheStats(IncludeCache *cache);
+
+void setIncludeCache(Option **config, IncludeCache *cache);
+
+/*
+ * Opt-in: readConfig remembers which file and byte range every top level option was assigned in. Reading the same
+ * file again then only rereads the #include fragments that changed since, and only the options those fragments
+ * assigned before or assign now are reset and parsed again, from their statements in every file in the original
+ * order, so they come out as they would from reading the file into a fresh config. Every other option, compounds
+ * included, is left as it is. It falls back to a full read if the main file, a fragment with #include lines of its
+ * own or the set of files an #include pattern matches changed, or more than a quarter of the fragments or of their
+ * bytes, past which reading everything is faster; a full read then starts from the defaults too, where readConfig
+ * normally keeps values the file no longer assigns. Ignored by readConfigMapped and arena configs.
+ */
+void setIncrementalReload(Option **config, bool enabled);
+
+/*
+ * Opt-in statistics of where a load spent its time and memory. With setParseStats(config, &stats) every following
+ * readConfig, readConfigMapped and readConfigCached that parses the file resets stats and fills it in, NULL turns it
+ * off again. The struct must outlive the loads it's set for, parseStatsFree frees the file list it accumulated.
+ * Without stats a load pays one branch per phase and per allocation; building with LIBCONF_NO_STATS takes the
+ * allocation counters out entirely (mallocs and reallocs then stay 0). A push parser fills in the stats set when it's
+ * created, from configParserCreate to configParserFinish: its file is the name it was given with the bytes fed, and
+ * totalNs is the time spent in its calls.
+ */
+#define PARSE_STATS_PROBES 8 //Buckets of ParseStats.probes, the last one also counts every longer probe
+
+typedef struct ParseFileStats {
+    char *path;
+    size_t bytes; //Read from disk, 0 if the preprocessed file came from the include cache
+    unsigned depth; //0 for the file given to readConfig, 1 for the files it includes and so on
+    bool cached;
+} ParseFileStats;
+
+typedef struct ParseStats {
+    ParseFileStats *files; //In the order they were read, which differs between loads with setParseThreads
+    size_t fileCount;
+    size_t fileCapacity;
+    size_t bytesRead; //Over all files
+    size_t bytesParsed; //Of the preprocessed buffer
+    size_t includes; //Files read for #include lines, nested ones included
+    size_t includeHits; //Of those, taken from the include cache
+    unsigned includeDepth; //Deepest include
+    uint64_t totalNs;
+    uint64_t readNs; //In readFile (or mapping the file), summed over the threads includes were read on
+    uint64_t preprocessNs; //Expanding #include lines, which is where included files are read
+    uint64_t parseNs; //parseConfigWhole, arrays included
+    uint64_t arrayNs; //parseArray, of arrays that aren't inside another array (those are part of their outer one)
+    size_t options; //In the config after the load, compounds and compound array elements included
+    size_t compounds;
+    size_t arrays;
+    size_t arrayElements; //Of every array, nested ones included
+    size_t mallocs; //File buffers, the preprocessed buffer and parsed values (arena chunks for an arena config)
+    size_t reallocs;
+    size_t probes[PARSE_STATS_PROBES]; //Options found after probing 1, 2, ... slots, frozen tables always take 1
+} ParseStats;
+
+void setParseStats(Option **config, ParseStats *stats);
+
+void parseStatsFree(ParseStats *stats);
+
+/*
+ * Opt-in: problems with the file (files that can't be read, unrecognized options, values that don't parse,
+ * unterminated strings, arrays and compounds) go to sink instead of stderr. Every readConfig, readConfigMapped,
+ * parsing readConfigCached and incremental reload resets the counts and items of sink and fills them in. Positions
+ * and paths are only worked out for the diagnostics that get past the limits, so clean files and suppressed
+ * diagnostics don't pay for them.
+ * Positions are in the file the statement is in, except in a config with an include cache: cached files carry no
+ * source map, so there they are lines of the preprocessed text of the main file. A push parser reports to the sink set
+ * when it's created, as one load from configParserCreate to configParserFinish, with lines counted over everything fed.
+ * The sink must outlive the loads it's set for, diagnosticSinkClear frees the items it collected.
+ */
+typedef enum DiagnosticSeverity {
+    DIAGNOSTIC_WARNING,
+    DIAGNOSTIC_ERROR
+} DiagnosticSeverity;
+
+typedef struct Diagnostic {
+    DiagnosticSeverity severity;
+    const char *file;
+    size_t line; //From 1, 0 if it's about a whole file that can't be read or the load (see setMemoryLimit)
+    size_t column; //From 1, in bytes
+    const char *path; //Of the option, e.g. arrc[1].arrb[2], or the name as written if it wasn't recognized
+    const char *message; //A string constant
+} Diagnostic;
+
+typedef struct DiagnosticSink {
+    //Gets every diagnostic that is passed on, one at a time even with setParseThreads. NULL collects them in items
+    void (*emit)(const Diagnostic *diagnostic, void *user);
+    void *user;
+    size_t maxPerLoad; //Diagnostics passed on per load, 0 for no limit
+    size_t maxPerSecond; //Diagnostics passed on per second, over all loads, 0 for no limit
+    size_t errors; //Of the last load, suppressed ones included
+    size_t warnings;
+    size_t suppressed; //Counted, but over one of the limits
+    Diagnostic *items; //Copies of the diagnostics passed on in the last load, if emit is NULL
+    size_t count;
+    size_t capacity;
+    uint64_t windowStart; //Second maxPerSecond is counting in
+    size_t windowCount;
+} DiagnosticSink;
+
+void setDiagnosticSink(Option **config, DiagnosticSink *sink);
+
+void diagnosticSinkClear(DiagnosticSink *sink);
+
+/*
+ * Bytes a config holds, as asked of malloc (the allocator's own overhead isn't included), by what they hold. Counts
+ * what cleanOptions frees: option names, defaults and compound array templates are the caller's and aren't counted.
+ * An arena config is counted by its chunks, so its total also covers chunk space not handed out yet and the copies
+ * arrays leave behind in a chunk when they grow, which is what arenaUnused is. Walks the whole config, compound array
+ * elements included, so it takes about as long as a pass over the config.
+ */
+typedef struct ConfigMemory {
+    size_t tables; //Table headers with their hash and slot arrays (and seeds, once frozen)
+    size_t options; //Options and their defaults
+    size_t elements; //Tables and options of compound array elements
+    size_t strings; //Parsed strings, string array elements included, unless they are views into source
+    size_t arrays; //Element storage of parsed arrays
+    size_t source; //Mapped file, buffer or binary cache that strings point into (readConfigMapped, readConfigCached)
+    size_t other; //Incremental reload record and bindings
+    size_t arenaUnused;
+    size_t total;
+} ConfigMemory;
+
+ConfigMemory configMemory(Option **config);
+
+/*
+ * Opt-in hard limit on the memory of a config, 0 (the default) for none. A load may take the config up to bytes:
+ * what its tables and options hold when the load starts (configMemory without the values of the last load, which this
+ * one replaces) plus every file it reads or maps, the preprocessed text and everything it parses into the config,
+ * counted as they are allocated and without taking back what the load frees again. An allocation that would go over
+ * the limit is refused before it's made (threads take the budget 64 KiB at a time, so a load can be refused that much
+ * per thread early), the load stops and the config goes back to its defaults. That is reported as
+ * an error (line 0) to the diagnostic sink if there is one, to stderr otherwise. Applies to readConfig,
+ * readConfigMapped, incremental reloads, readConfigCached when it parses and push parsers. A push parser is one load
+ * under the limit set when it's created, its buffer of unparsed statements included: once it's over,
+ * configParserFeed returns false and configParserFinish resets the config.
+ */
+void setMemoryLimit(Option **config, size_t bytes);
+
+/*
+ * Push parser for configs that arrive in pieces (pipes, decompressors, ...). Chunks can be split anywhere, complete
+ * statements are parsed as soon as they arrive, so only the statement in progress is kept in memory. name is used in
+ * messages, #include paths are resolved relative to includeDir (NULL for the working directory). configParserFeed
+ * returns false if the data couldn't be taken, for lack of memory or over the limit of setMemoryLimit.
+ * configParserFinish parses whatever is left and frees the parser.
+ */
+typedef struct ConfigParser ConfigParser;
+
+ConfigParser *configParserCreate(Option **config, const char *name, const char *includeDir);
+
+bool configParserFeed(ConfigParser *parser, const char *data, size_t len);
+
+void configParserFinish(ConfigParser *parser);
+
+/*
+ * Writes every option of config (and of its compounds) in the syntax readConfig reads, options sorted by name, so
+ * reading the output into a fresh copy of the schema gives the same values. Strings have no escapes: a string with
+ * both ' and ", with a line starting with # (after blanks) that the preprocessor would take for a macro, or with braces
+ * that don't pair up inside a compound, can't be written, its option is left out with an error message and false is
+ * returned. Also false if writing failed. writeConfigString hands back a null-terminated
+ * heap buffer (free it), NULL only if it ran out of memory.
+ */
+bool writeConfig(Option **config, const char *filename);
+
+bool writeConfigFile(Option **config, FILE *fp);
+
+bool writeConfigFd(Option **config, int fd);
+
+bool writeConfigString(Option **config, char **out, size_t *length);
+
+/*
+ * Versions of a config that threads read while others reload it. get and get_array on a config that readConfig is
+ * filling can see freed strings and arrays, so a shared config never changes a version once it's published:
+ * sharedConfigRead reads the file into a fresh copy of schema (its options at their defaults) and publishes it with
+ * one pointer swap. Readers pin the current version with sharedConfigAcquire and let it go with sharedConfigRelease,
+ * both on the same thread, without locks or atomic read-modify-writes (after a thread's first acquire, which
+ * registers it). Acquires nest, an inner one returns the version the outer one pinned. A replaced version is freed by
+ * a later publish once every thread that was reading when it was replaced has released (epoch based reclamation).
+ * schema must outlive the shared config, and no thread may hold a version when it's freed. Not available on Windows.
+ */
+typedef struct SharedConfig SharedConfig;
+
+SharedConfig *sharedConfigCreate(Option **schema);
+
+bool sharedConfigRead(SharedConfig *shared, const char *filename); //false, keeping the current version, on failure
+
+Option **sharedConfigAcquire(SharedConfig *shared); //The schema's defaults until the first successful read
+
+void sharedConfigRelease(SharedConfig *shared);
+
+unsigned long sharedConfigVersion(SharedConfig *shared); //0 for the defaults, up by one with every published read
+
+void sharedConfigFree(SharedConfig *shared);
+
+/*
+ * Reloads a config automatically when its file or anything it includes changes (Linux only, uses inotify). Every
+ * reload is published like sharedConfigRead does, so a reader sees either the old or the new version and never a
+ * mix. Bursts of writes are collapsed into one reload once nothing has changed for debounceMs (0 for the default).
+ * Readers pin the current version with configWatchAcquire and hand it back with configWatchRelease on the same
+ * thread, like sharedConfigAcquire/sharedConfigRelease. schema must outlive the watch, a reload that can't read the
+ * file keeps the current version.
+ */
+typedef struct ConfigWatch ConfigWatch;
+
+#define CONFIG_WATCH_DEBOUNCE_MS 100
+
+ConfigWatch *configWatchCreate(Option **schema, const char *filename, unsigned debounceMs);
+
+Option **configWatchAcquire(ConfigWatch *watch);
+
+void configWatchRelease(ConfigWatch *watch, Option **config); //config is what configWatchAcquire returned
+
+unsigned long configWatchVersion(ConfigWatch *watch); //1 once the file was read, up by one with every reload
+
+void configWatchFree(ConfigWatch *watch);
+
 struct Option *get_(Option **options, char *optName);
 
+/*
+ * A compiled path is a dotted option name (e.g. "servers[3].port") split and hashed once, so looking it up repeatedly
+ * only probes the tables along the way. A [index] descends into an element of a compound array.
+ */
+typedef struct OptionPathSegment {
+    const char *name; //Points into OptionPath.source, not null-terminated
+    size_t len;
+    uint32_t hash;
+    long index; //Compound array element to continue in, -1 if the segment has no [index]
+} OptionPathSegment;
+
+typedef struct OptionPath {
+    size_t count;
+    OptionPathSegment *segments;
+    char *source;
+} OptionPath;
+
+OptionPath *compilePath(const char *path);
+
+struct Option *getPath(Option **options, const OptionPath *path);
+
+void freePath(OptionPath *path);
+
+/*
+ * A handle is an option resolved ahead of time. readConfig parses new values into the same Option, so the handle
+ * stays valid across reloads (until cleanOptions) and reading through it skips hashing and name compares entirely.
+ * Handles into compound array elements (e.g. "servers[3].port") only last until the next reload, since the elements
+ * are rebuilt every time.
+ */
+typedef const struct Option *OptionHandle;
+
+OptionHandle getHandle(Option **options, char *optName);
+
+/*
+ * Binds an option to a field of a settings struct, e.g. BIND_OPT(config, "server.port", struct Settings, port). After
+ * every readConfig, readConfigMapped, readConfigCached and configParserFinish the bound values are copied into the
+ * struct set with setBindTarget, in one pass over the bindings with no lookups or type dispatch, so a setting is read
+ * with a field access. Paths are dotted names; options in compound array elements can't be bound, as the elements
+ * are rebuilt on every load. The field has to fit the option: long or int for LONG, double for DOUBLE, bool for BOOL,
+ * char * or StringView for TEXT (char * isn't null-terminated after readConfigMapped) and ArrayOption for an array.
+ * Strings and arrays point into the config, like the ones get returns, and last until its next load.
+ * setBindTarget fills target from the current values right away, so a reload can fill a fresh struct to swap in.
+ * Bindings belong to config: shared configs and watches made from it as a schema don't have them.
+ */
+enum BindKind {
+    BIND_LONG,
+    BIND_INT,
+    BIND_DOUBLE,
+    BIND_BOOL,
+    BIND_STRING,
+    BIND_VIEW,
+    BIND_ARRAY
+};
+
+#define BIND_KIND(field) _Generic((field),                      \
+                    long: BIND_LONG,                            \
+                    int: BIND_INT,                              \
+                    double: BIND_DOUBLE,                        \
+                    bool: BIND_BOOL,                            \
+                    char*: BIND_STRING,                         \
+                    const char*: BIND_STRING,                   \
+                    StringView: BIND_VIEW,                      \
+                    ArrayOption: BIND_ARRAY)
+
+#define BIND_OPT(conf, path, type, field) bindOption(conf, path, offsetof(type, field), BIND_KIND(((type *) 0)->field))
+
+bool bindOption(Option **config, const char *path, size_t offset, enum BindKind kind);
+
+void setBindTarget(Option **config, void *target);
+
 void cleanOptions(Option **options);
 
 #define SET_FROM_OPTION(out, o) do{                             \
@@ -132,56 +554,65 @@ void cleanOptions(Option **options);
                     double: (o)->v_d,                           \
                     float: (o)->v_d,                            \
                     char*: (o)->v_s,                            \
+                    StringView: (o)->v_sv,                      \
                     bool: (o)->v_b,                             \
                     bool*: (o)->v_a.a_b,                        \
                     long*: (o)->v_a.a_l,                        \
                     double*: (o)->v_a.a_d,                      \
                     char**: (o)->v_a.a_s,                       \
+                    StringView*: (o)->v_a.a_sv,                 \
                     Option***: (o)->v_a.a_v.a_v,                \
                     ArrayOption*: (o)->v_a.a_a.a_a,             \
                     default: (o)->v_v);                         \
 }while(0)
 
-#define INIT_CONFIG(conf) conf = malloc(OPTION_HASHMAP_SIZE * sizeof(struct Option *));
+#define INIT_CONFIG(conf) conf = optionTableCreate(0);
+
+#define INIT_CONFIG_SIZED(conf, expected) conf = optionTableCreate(expected);
+
+#define INIT_CONFIG_ARENA(conf) conf = optionTableCreateArena(0);
+
+#define INIT_CONFIG_CHILD(conf, parent) conf = optionTableCreateChild(parent); //Shares the arena of parent, if any
 
 #define ADD_OPT_LONG(conf, name_in, default_v) do{              \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = LONG;                                           \
-    opt->dv_l = (default_v);                                    \
-    opt->v_l = opt->dv_l;                                       \
+    opt->def->dv_l = (default_v);                               \
+    opt->v_l = opt->def->dv_l;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0);
 
 #define ADD_OPT_DOUBLE(conf, name_in, default_v) do{            \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = DOUBLE;                                         \
-    opt->dv_d = (default_v);                                    \
-    opt->v_d = opt->dv_d;                                       \
+    opt->def->dv_d = (default_v);                               \
+    opt->v_d = opt->def->dv_d;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0);
 
 #define ADD_OPT_BOOL(conf, name_in, default_v) do{              \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = BOOL;                                           \
-    opt->dv_b = (default_v);                                    \
-    opt->v_b = opt->dv_b;                                       \
+    opt->def->dv_b = (default_v);                               \
+    opt->v_b = opt->def->dv_b;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0);
 
 #define ADD_OPT_STR(conf, name_in, default_v) do{               \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = TEXT;                                           \
-    opt->dv_s = (default_v);                                    \
-    opt->v_s = opt->dv_s;                                       \
+    opt->def->dv_s = (default_v);                               \
+    opt->def->dv_sv.len = opt->def->dv_s ? strlen(opt->def->dv_s) : 0; \
+    opt->v_sv = opt->def->dv_sv;                                \
     HASH_ADD(conf, opt);                                        \
 }while(0);
 
 #define ADD_OPT_COMPOUND(conf, name_in, options) do{            \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = COMPOUND;                                       \
     opt->v_v = options;                                         \
@@ -189,74 +620,122 @@ void cleanOptions(Option **options);
 }while(0)
 
 #define ADD_OPT_ARRAY_LONG(conf, name_in, default_v) do{        \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
-    opt->dv_a.a_l = default_v;                                  \
-    opt->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
-    opt->dv_a.type = LONG;                                      \
-    opt->v_a = opt->dv_a;                                       \
+    opt->def->dv_a.a_l = default_v;                             \
+    opt->def->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
+    opt->def->dv_a.type = LONG;                                 \
+    opt->v_a = opt->def->dv_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ADD_OPT_ARRAY_DOUBLE(conf, name_in, default_v) do{      \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
-    opt->dv_a.a_d = default_v;                                  \
-    opt->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
-    opt->dv_a.type = DOUBLE;                                    \
-    opt->v_a = opt->dv_a;                                       \
+    opt->def->dv_a.a_d = default_v;                             \
+    opt->def->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
+    opt->def->dv_a.type = DOUBLE;                               \
+    opt->v_a = opt->def->dv_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ADD_OPT_ARRAY_BOOL(conf, name_in, default_v) do{        \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
-    opt->dv_a.a_b = default_v;                                  \
-    opt->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
-    opt->dv_a.type = BOOL;                                      \
-    opt->v_a = opt->dv_a;                                       \
+    opt->def->dv_a.a_b = default_v;                             \
+    opt->def->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
+    opt->def->dv_a.type = BOOL;                                 \
+    opt->v_a = opt->def->dv_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ADD_OPT_ARRAY_STR(conf, name_in, default_v, len_in) do{ \
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
-    opt->dv_a.a_s = default_v;                                  \
-    opt->dv_a.len = len_in;                                     \
-    opt->dv_a.type = TEXT;                                      \
-    opt->v_a = opt->dv_a;                                       \
+    opt->def->dv_a.a_s = default_v;                             \
+    opt->def->dv_a.len = len_in;                                \
+    opt->def->dv_a.type = TEXT;                                 \
+    opt->v_a = opt->def->dv_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ADD_OPT_ARRAY_COMPOUND(conf, name_in, template_v, default_v) do{\
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
-    opt->dv_a.a_v.a_v = default_v;                              \
-    opt->dv_a.a_v.a_v_t = template_v;                           \
-    opt->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
-    opt->dv_a.type = COMPOUND;                                  \
-    opt->v_a = opt->dv_a;                                       \
+    opt->def->dv_a.a_v.a_v = default_v;                         \
+    opt->def->dv_a.a_v.a_v_t = template_v;                      \
+    opt->def->dv_a.len = sizeof(default_v) / sizeof((default_v)[0]); \
+    opt->def->dv_a.type = COMPOUND;                             \
+    opt->v_a = opt->def->dv_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ADD_OPT_ARRAY_ARRAY(conf, name_in, template_v, default_v, len_i) do{\
-    struct Option *opt = malloc(sizeof(Option));                \
+    struct Option *opt = optionAlloc(conf);                     \
     opt->name = name_in;                                        \
     opt->type = ARRAY;                                          \
     opt->v_a.a_a.t = template_v;                                \
     opt->v_a.a_a.a_a = default_v;                               \
     opt->v_a.len = len_i;                                       \
     opt->v_a.type = ARRAY;                                      \
+    opt->def->dv_a = opt->v_a;                                  \
     HASH_ADD(conf, opt);                                        \
 }while(0)
 
 #define ARR_LONG(val, leni) (ArrayOption) {.type=LONG, .a_l=(val), .len=(leni)}
 
+/*
+ * A schema declared as data instead of a run of ADD_OPT_* calls, e.g.
+ *
+ *     static const StaticOption server[] = {STATIC_LONG("port", 80), STATIC_STR("host", "localhost"), STATIC_END};
+ *     static const StaticOption schema[] = {STATIC_COMPOUND("server", server), STATIC_BOOL("tls", false), STATIC_END};
+ *     INIT_CONFIG_STATIC(config, schema);
+ *
+ * Each table is built in one pass at its final size, with its options in one block of an arena config (see
+ * INIT_CONFIG_ARENA), instead of one allocation per option and default. The schema and the arrays and strings its
+ * defaults point to must outlive the config. Options can still be added to it with ADD_OPT_*.
+ */
+#define INIT_CONFIG_STATIC(conf, schema) conf = optionTableCreateStatic(schema);
+
+#define STATIC_LONG(name_in, default_v) {.name = (name_in), .type = LONG, .def = {.dv_l = (default_v)}}
+
+#define STATIC_DOUBLE(name_in, default_v) {.name = (name_in), .type = DOUBLE, .def = {.dv_d = (default_v)}}
+
+#define STATIC_BOOL(name_in, default_v) {.name = (name_in), .type = BOOL, .def = {.dv_b = (default_v)}}
+
+//default_v must be a string literal, its length is taken at compile time
+#define STATIC_STR(name_in, default_v) {.name = (name_in), .type = TEXT,                \
+    .def = {.dv_sv = {"" default_v, sizeof("" default_v) - 1}}}
+
+#define STATIC_COMPOUND(name_in, schema_in) {.name = (name_in), .type = COMPOUND, .schema = (schema_in)}
+
+#define STATIC_ARRAY_LONG(name_in, default_v) {.name = (name_in), .type = ARRAY,        \
+    .def = {.dv_a = {.a_l = (long *) (default_v), .len = sizeof(default_v) / sizeof((default_v)[0]), .type = LONG}}}
+
+#define STATIC_ARRAY_DOUBLE(name_in, default_v) {.name = (name_in), .type = ARRAY,      \
+    .def = {.dv_a = {.a_d = (double *) (default_v), .len = sizeof(default_v) / sizeof((default_v)[0]), .type = DOUBLE}}}
+
+#define STATIC_ARRAY_BOOL(name_in, default_v) {.name = (name_in), .type = ARRAY,        \
+    .def = {.dv_a = {.a_b = (bool *) (default_v), .len = sizeof(default_v) / sizeof((default_v)[0]), .type = BOOL}}}
+
+#define STATIC_ARRAY_STR(name_in, default_v, len_in) {.name = (name_in), .type = ARRAY, \
+    .def = {.dv_a = {.a_s = (char **) (default_v), .len = (len_in), .type = TEXT}}}
+
+//Elements follow template_in and the array is empty by default
+#define STATIC_ARRAY_COMPOUND(name_in, template_in) {.name = (name_in), .type = ARRAY,  \
+    .def = {.dv_a = {.type = COMPOUND}}, .schema = (template_in)}
+
+#define STATIC_ARRAY_ARRAY(name_in, template_v, default_v, len_in) {.name = (name_in), .type = ARRAY, \
+    .def = {.dv_a = {.a_a = {.a_a = (ArrayOption *) (default_v), .t = (ArrayOption *) (template_v)}, \
+    .len = (len_in), .type = ARRAY}}}
+
+#define STATIC_END {.name = NULL}
+
 #define get(config, optName, out) do{                           \
     struct Option* o = get_(config, optName);                   \
     if(o) {                                                     \
@@ -270,4 +749,30 @@ void cleanOptions(Option **options);
         (size) = o->v_a.len;                                    \
     }                                                           \
 }while(0)
+
+#define get_path(config, path, out) do{                         \
+    struct Option* o = getPath(config, path);                   \
+    if(o) {                                                     \
+        SET_FROM_OPTION(out, o);                                \
+    }                                                           \
+}while(0)
+#define get_array_path(config, path, out, size) do{             \
+    struct Option* o = getPath(config, path);                   \
+    if(o) {                                                     \
+        SET_FROM_OPTION(out, o);                                \
+        (size) = o->v_a.len;                                    \
+    }                                                           \
+}while(0)
+
+#define get_handle(handle, out) do{                             \
+    if(handle) {                                                \
+        SET_FROM_OPTION(out, handle);                           \
+    }                                                           \
+}while(0)
+#define get_array_handle(handle, out, size) do{                 \
+    if(handle) {                                                \
+        SET_FROM_OPTION(out, handle);                           \
+        (size) = (handle)->v_a.len;                             \
+    }                                                           \
+}while(0)
 #endif
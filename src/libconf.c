@@ -5,22 +5,39 @@
 #include <errno.h>
 #include <string.h>
 #include <glob.h>
+#include <time.h>
+#include <limits.h>
+#include <locale.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#if !defined(LIBCONF_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#elif !defined(LIBCONF_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifndef _WIN32
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #else
 #include <Windows.h>
+#include <io.h>
 #endif
 
-//utility functions
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <poll.h>
+#endif
 
-char *strchrnul_(char *s, char c) {
-    if (*s == '\0' || *(s - 1) == '\0') return NULL;
-    char *val = strchr(s, c);
-    return !val ? s + strlen(s) - 1 : val;
-}
+//utility functions
 
 //strrchr but the end pointer and the length are provided instead of the start pointer
 //searches backwards to find the last occurrence
@@ -43,25 +60,6 @@ bool isFile(const char *path) {
     }
 }
 
-size_t trimn(const char *in, size_t n, char **out) {
-    if (!in) return 0;
-    const char *begin = in;
-    const char *end = in + n - 1;
-    if (begin == end) {
-        if (isspace(*in)) return 0;
-        *out = strdup(in);
-        return strlen(in);
-    }
-
-    while (isspace(*begin))
-        begin++;
-    while (isspace(*end))
-        end--;
-    end++;
-    *out = strndup(begin, end - begin);
-    return end - begin;
-}
-
 void trimnp(char *in, const char *end, char **out) {
     if (!in) return;
     char *begin = in;
@@ -71,750 +69,5579 @@ void trimnp(char *in, const char *end, char **out) {
     *out = begin;
 }
 
-void parseConfigWhole(Option **options, const char *file, char *bufferOriginal, size_t length);
+//structural scanner
 
-char *parseArray(ArrayOption *array, const char *file, const char *optName, const char *buffer, const char *bufferEnd) {
-    if (!array)return NULL;
-    char *arrayStart = strchr(buffer, '[');
-    if (!arrayStart || arrayStart > bufferEnd) {
-        fprintf(stderr,
-                "Error at option %s:%s: Array must start on the same line as the option definition with [\n",
-                file, optName);
-        return NULL;
-    }
+/*
+ * The value parsers look for quotes, brackets, braces and commas. Running strchr once per character they were looking
+ * for meant several passes over the same bytes, and a quote search ran to the end of the file whenever the other
+ * quote type didn't occur, which made large configs quadratic. Instead the buffer is classified 64 bytes at a time
+ * into one bitmask per class and searches walk the set bits, bounded by where the value can end. AVX2 or SSE2 is used
+ * when the compiler targets it (-mavx2 / -march=native for AVX2), defining LIBCONF_NO_SIMD forces the scalar fallback.
+ */
+#define SCAN_BLOCK 64
+#define SCAN_CLASSES 8
 
-    switch (array->type) {
-        case BOOL: {
-            char *arrayEnd = strchr(arrayStart + 1, ']');
-            if (!arrayEnd) {
-                fprintf(stderr, "Error at option %s:%s: Array must end with ]\n", file, optName);
-                return NULL;
-            }
+enum {
+    SCAN_NEWLINE = 1 << 0,
+    SCAN_DQUOTE = 1 << 1,
+    SCAN_SQUOTE = 1 << 2,
+    SCAN_OPEN_BRACKET = 1 << 3,
+    SCAN_CLOSE_BRACKET = 1 << 4,
+    SCAN_OPEN_BRACE = 1 << 5,
+    SCAN_CLOSE_BRACE = 1 << 6,
+    SCAN_COMMA = 1 << 7,
+    SCAN_QUOTES = SCAN_DQUOTE | SCAN_SQUOTE,
+    SCAN_BRACES = SCAN_OPEN_BRACE | SCAN_CLOSE_BRACE,
+    //Classes that are computed together, because the parser asks for them in quick succession
+    SCAN_STRING = SCAN_NEWLINE | SCAN_QUOTES,
+    SCAN_NESTING = SCAN_OPEN_BRACKET | SCAN_CLOSE_BRACKET | SCAN_BRACES | SCAN_COMMA,
+};
 
-            bool *arr = malloc(sizeof(bool) * ARRAY_ALLOCATION);
-            size_t i = 0;
-            size_t arraySize = ARRAY_ALLOCATION;
-            char *nextElement = arrayStart + 1;
-            char *currentElement = arrayStart + 1;
-            do {
-                nextElement = strchr(nextElement + 1, ',');
-                if (nextElement > arrayEnd || !nextElement) nextElement = arrayEnd;
-                char *valueStart;
-                trimnp(currentElement, nextElement, &valueStart);
-                if (arraySize - 2 == i) {
-                    bool *tmp = realloc(arr, (arraySize + ARRAY_ALLOCATION) * sizeof(bool));
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for bool array: %s\n", strerror(errno));
-                        goto clean_b;
-                    }
-                    arr = tmp;
-                }
-                arr[i] = !strncasecmp(valueStart, "true", 4) || !strncasecmp(valueStart, "yes", 3);
-                if (!arr[i] && !(!strncasecmp(valueStart, "false", 5) ||
-                                 !strncasecmp(valueStart, "no", 2))) { // If option is not true or false
-                    fprintf(stderr, "Error at option %s:%s[%zu]: Invalid boolean. Must be true, false, yes or no\n",
-                            file, optName, i);
-                    goto clean_b;
-                }
-                i++;
-                currentElement = nextElement + 1;
-            } while (nextElement != arrayEnd);
+//Masks of one block, bit n is set if byte n of the block belongs to the class. Classes are only computed once
+//something asks for their group, a flat config never needs brackets, braces or commas
+typedef struct ScanBlock {
+    size_t index; //SIZE_MAX before the first block
+    const char *data;
+    unsigned ready; //Classes masks holds
+    uint64_t masks[SCAN_CLASSES];
+    _Alignas(32) char tail[SCAN_BLOCK]; //Zero padded copy of the last block, so loads never go past the buffer
+} ScanBlock;
 
-            if (i != arraySize) {
-                bool *tmp = realloc(arr, i * sizeof(bool));
-                if (!tmp) {
-                    fprintf(stderr, "Error while reallocating memory for bool array: %s\n", strerror(errno));
-                    goto clean_b;
-                }
-                arr = tmp;
-            }
-            array->a_b = arr;
-            array->len = i;
-            return arrayEnd + 1;
-            clean_b:
-            free(arr);
-            return arrayEnd + 1;
-        }
-        case LONG: {
-            char *arrayEnd = strchr(arrayStart + 1, ']');
-            if (!arrayEnd) {
-                fprintf(stderr, "Error at option %s:%s: Array must end with ]\n", file, optName);
-                return NULL;
-            }
+typedef struct Scanner {
+    char *base;
+    size_t length;
+    //Even and odd blocks are cached separately, value parsers usually step back into the block the line started in
+    ScanBlock blocks[2];
+} Scanner;
 
-            long *arr = malloc(sizeof(long) * ARRAY_ALLOCATION);
-            size_t i = 0;
-            size_t arraySize = ARRAY_ALLOCATION;
-            char *nextElement = arrayStart + 1;
-            char *currentElement = arrayStart + 1;
-            do {
-                nextElement = strchr(nextElement + 1, ',');
-                if (nextElement > arrayEnd || !nextElement) nextElement = arrayEnd;
-                char *valueStart;
-                trimnp(currentElement, nextElement, &valueStart);
-                if (arraySize - 2 == i) {
-                    long *tmp = realloc(arr, (arraySize + ARRAY_ALLOCATION) * sizeof(long));
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for long array: %s\n", strerror(errno));
-                        goto clean_l;
-                    }
-                    arr = tmp;
-                }
-                char *endPtr = NULL;
-                arr[i] = strtol(valueStart, &endPtr, 10);
-                if (endPtr == valueStart) {
-                    //error
-                    fprintf(stderr, "Error at option %s:%s[%zu]: Invalid long: %s\n", file, optName, i,
-                            strerror(errno));
-                }
-                i++;
-                currentElement = nextElement + 1;
-            } while (nextElement != arrayEnd);
+static void scannerInit(Scanner *scan, char *buffer, size_t length) {
+    scan->base = buffer;
+    scan->length = length;
+    scan->blocks[0].index = scan->blocks[1].index = SIZE_MAX;
+}
 
-            if (i != arraySize) {
-                long *tmp = realloc(arr, i * sizeof(long));
-                if (!tmp) {
-                    fprintf(stderr, "Error while reallocating memory for long array: %s\n", strerror(errno));
-                    goto clean_l;
-                }
-                arr = tmp;
-            }
-            array->a_l = arr;
-            array->len = i;
-            return arrayEnd + 1;
-            clean_l:
-            free(arr);
-            return arrayEnd + 1;
-        }
-        case DOUBLE: {
-            char *arrayEnd = strchr(arrayStart + 1, ']');
-            if (!arrayEnd) {
-                fprintf(stderr, "Error at option %s:%s: Array must end with ]\n", file, optName);
-                return NULL;
-            }
+#if !defined(LIBCONF_NO_SIMD) && defined(__AVX2__)
+#define SCAN_SIMD
+#define SCAN_SIMD_NAME "AVX2"
+#elif !defined(LIBCONF_NO_SIMD) && defined(__SSE2__)
+#define SCAN_SIMD
+#define SCAN_SIMD_NAME "SSE2"
+#endif
 
-            double *arr = malloc(sizeof(double) * ARRAY_ALLOCATION);
-            size_t i = 0;
-            size_t arraySize = ARRAY_ALLOCATION;
-            char *nextElement = arrayStart + 1;
-            char *currentElement = arrayStart + 1;
-            do {
-                nextElement = strchr(nextElement + 1, ',');
-                if (nextElement > arrayEnd || !nextElement) nextElement = arrayEnd;
-                char *valueStart;
-                trimnp(currentElement, nextElement, &valueStart);
-                if (arraySize - 2 == i) {
-                    double *tmp = realloc(arr, (arraySize + ARRAY_ALLOCATION) * sizeof(double));
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for double array: %s\n", strerror(errno));
-                        goto clean_d;
-                    }
-                    arr = tmp;
-                }
-                char *endPtr = NULL;
-                arr[i] = strtod(valueStart, &endPtr);
-                if (endPtr == valueStart) {
-                    //error
-                    fprintf(stderr, "Error at option %s:%s[%zu]: Invalid double: %s\n", file, optName, i,
-                            strerror(errno));
-                }
-                i++;
-                currentElement = nextElement + 1;
-            } while (nextElement != arrayEnd);
+#if !defined(SCAN_SIMD) || defined(LIBCONF_SCAN_SELECT)
 
-            if (i != arraySize) {
-                double *tmp = realloc(arr, i * sizeof(double));
-                if (!tmp) {
-                    fprintf(stderr, "Error while reallocating memory for double array: %s\n", strerror(errno));
-                    goto clean_d;
-                }
-                arr = tmp;
-            }
-            array->a_d = arr;
-            array->len = i;
-            return arrayEnd + 1;
-            clean_d:
-            free(arr);
-            return arrayEnd + 1;
-        }
-        case TEXT: {
-            char **arr = malloc(sizeof(char *) * ARRAY_ALLOCATION);
-            size_t i = 0;
-            size_t arraySize = ARRAY_ALLOCATION;
-            char *prevElement = arrayStart + 1;
-            char *currentElement = arrayStart + 1;
-            do {
-                if (arraySize - 2 == i) {
-                    char **tmp = realloc(arr, (arraySize + ARRAY_ALLOCATION) * sizeof(char *));
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for string array: %s\n", strerror(errno));
-                        goto clean_s;
-                    }
-                    arr = tmp;
-                }
+//Class index + 1 of every byte, 0 for bytes the parser doesn't look for
+static const unsigned char scanClassOf[256] = {
+        ['\n'] = 1, ['"'] = 2, ['\''] = 3, ['['] = 4, [']'] = 5, ['{'] = 6, ['}'] = 7, [','] = 8
+};
 
-                char *doubleStart = strchr(currentElement, '"');
-                char *singleStart = strchr(currentElement, '\'');
-                char *possibleArrayEnd = strchr(prevElement, ']');
-                if (!possibleArrayEnd) {
-                    fprintf(stderr, "Error at option %s:%s: Array must end with ]\n", file, optName);
-                    goto clean_s;
-                }
-                if ((!doubleStart || possibleArrayEnd < doubleStart) &&
-                    (!singleStart || possibleArrayEnd < singleStart)) {
-                    break;
-                }
-                bool single = (singleStart < doubleStart && singleStart) || (singleStart && !doubleStart);
-                if ((!single && !doubleStart)) {
-                    fprintf(stderr,
-                            "Error at option %s:%s[%zu]: String must start with ' or \"\n",
-                            file, optName, i);
-                    break;
-                }
-                char searchChar = single ? '\'' : '"';
-                char *stringStart = single ? singleStart : doubleStart;
-                stringStart += 1 + (*(stringStart + 1) == '\n');
+//Without SIMD a single pass over the block is cheaper than one per class, so every class is filled in at once
+__attribute__((noinline)) static void scanClassesScalar(ScanBlock *cached, unsigned classes) {
+    (void) classes;
+    const char *p = cached->data;
+    memset(cached->masks, 0, sizeof(cached->masks));
+    for (int i = 0; i < SCAN_BLOCK; ++i) {
+        unsigned char c = scanClassOf[(unsigned char) p[i]];
+        if (c) cached->masks[c - 1] |= (uint64_t) 1 << i;
+    }
+    cached->ready = (1u << SCAN_CLASSES) - 1;
+}
 
-                char *multiLineEnd = strchr(stringStart, searchChar);
-                if (!multiLineEnd) {
-                    fprintf(stderr, "Error at option %s:%s: String must end with ' or \"\n", file, optName);
-                    break;
-                }
+#endif
 
-                if (*(multiLineEnd - 1) == '\n') multiLineEnd--;
+#ifdef SCAN_SIMD
 
-                arr[i] = strndup(stringStart, multiLineEnd - stringStart);
+#ifdef LIBCONF_SCAN_SELECT
+static bool scanScalar = false; //See setScalarScan
+#endif
 
-                prevElement = currentElement;
-                currentElement = strchr(multiLineEnd, ',') + 1;
-                if (!currentElement)break;
-                i++;
-            } while (true);
+//In the order of the class bits
+static const char scanChars[SCAN_CLASSES] = {'\n', '"', '\'', '[', ']', '{', '}', ','};
 
-            if (i != arraySize) {
-                char **tmp = realloc(arr, i * sizeof(char *));
-                if (!tmp) {
-                    fprintf(stderr, "Error while reallocating memory for string array: %s\n", strerror(errno));
-                    goto clean_s;
-                }
-                arr = tmp;
-            }
-            array->a_s = arr;
-            array->len = i;
-            return prevElement;
-            clean_s:
-            free(arr);
-            return prevElement;
-        }
-        case COMPOUND: {
-            Option ***arr = malloc(sizeof(Option **) * ARRAY_ALLOCATION);
-            size_t i = 0;
-            size_t arraySize = ARRAY_ALLOCATION;
-            char *currentElement = arrayStart + 1;
-            do {
-                if (arraySize - 2 == i) {
-                    Option ***tmp = realloc(arr, (arraySize + ARRAY_ALLOCATION) * sizeof(Option **));
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for compound array: %s\n",
-                                strerror(errno));
-                        goto clean_c;
-                    }
-                    arr = tmp;
-                }
+__attribute__((noinline)) static void scanClasses(ScanBlock *cached, unsigned classes) {
+#ifdef LIBCONF_SCAN_SELECT
+    if (scanScalar) {
+        scanClassesScalar(cached, classes);
+        return;
+    }
+#endif
+    const char *p = cached->data;
+#ifdef __AVX2__
+    __m256i lo = _mm256_loadu_si256((const __m256i *) p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *) (p + 32));
+#else
+    __m128i v0 = _mm_loadu_si128((const __m128i *) p);
+    __m128i v1 = _mm_loadu_si128((const __m128i *) (p + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *) (p + 32));
+    __m128i v3 = _mm_loadu_si128((const __m128i *) (p + 48));
+#endif
+    cached->ready |= classes;
+    for (; classes; classes &= classes - 1) {
+        int c = __builtin_ctz(classes);
+#ifdef __AVX2__
+        __m256i needle = _mm256_set1_epi8(scanChars[c]);
+        uint64_t l = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle));
+        uint64_t h = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle));
+        cached->masks[c] = l | h << 32;
+#else
+        __m128i needle = _mm_set1_epi8(scanChars[c]);
+        uint64_t m0 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v0, needle));
+        uint64_t m1 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v1, needle));
+        uint64_t m2 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v2, needle));
+        uint64_t m3 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v3, needle));
+        cached->masks[c] = m0 | m1 << 16 | m2 << 32 | m3 << 48;
+#endif
+    }
+}
 
-                char *compoundStart = strchr(currentElement, '{');
-                char *potentialArrayEnd = strchr(currentElement, ']');
-                if (!compoundStart || compoundStart > potentialArrayEnd) {
-                    break;
-                }
-                int openCount = 1;
-                char *compoundEnd = NULL;
-                for (char *j = compoundStart + 1; j < bufferEnd; ++j) {
-                    if (*j == '{') openCount++;
-                    if (*j == '}') openCount--;
-                    if (!openCount) {
-                        compoundEnd = j;
-                        break;
-                    }
-                }
-                if (openCount) {
-                    fprintf(stderr, "Error at option %s:%s: Compound must end with '}'\n", file, optName);
-                    goto clean_c;
-                }
+#else
+#define scanClasses scanClassesScalar
+#endif
 
-                arr[i] = malloc(sizeof(Option *) * OPTION_HASHMAP_SIZE);
-                /*
-                  Copies all options from the template to each element of the array. It's quite ugly
-                  but seems to work. It should probably be checked over.
-                  It's ugly but better than looping over the entire hashmap using HASH_ITER, then copying
-                  every option, and re-adding it using HASH_ADD. This way the next element in the hashmap
-                  linked list bucket can also be efficiently copied at the same time.
-                 */
-                for (Option **tmp = array->a_v.a_v_t; tmp - (array->a_v.a_v_t) <
-                                                      OPTION_HASHMAP_SIZE; ++tmp) {
-                    Option *o1 = *tmp;
-                    if (!o1) continue;
-                    Option *o1n = malloc(sizeof(*o1));
-                    memcpy(o1n, o1, sizeof(*o1));
-                    arr[i][tmp - array->a_v.a_v_t] = o1n;
-
-                    Option *opt1p = o1n;
-                    for (Option *opt1 = o1n->next; opt1; opt1 = opt1->next) {
-                        Option *o1nnext = malloc(sizeof(*opt1));
-                        memcpy(o1nnext, opt1, sizeof(*opt1));
-                        opt1p->next = o1nnext;
-                        opt1p = opt1;
-                    }
-                }
-                parseConfigWhole(arr[i], file, compoundStart + 1, compoundEnd - compoundStart + 1);
+#ifdef LIBCONF_SCAN_SELECT
+const char *setScalarScan(bool scalar) {
+#ifdef SCAN_SIMD
+    scanScalar = scalar;
+    return scalar ? "scalar" : SCAN_SIMD_NAME;
+#else
+    (void) scalar;
+    return "scalar";
+#endif
+}
+#endif
 
-                i++;
-                currentElement = compoundEnd + 1;
-            } while (true);
+static void scanBlock(Scanner *scan, ScanBlock *cached, size_t block) {
+    cached->index = block;
+    cached->ready = 0;
+    cached->data = scan->base + block * SCAN_BLOCK;
+    if (block * SCAN_BLOCK + SCAN_BLOCK > scan->length) {
+        memset(cached->tail, 0, SCAN_BLOCK);
+        memcpy(cached->tail, cached->data, scan->length - block * SCAN_BLOCK);
+        cached->data = cached->tail;
+    }
+}
 
-            if (i != arraySize) {
-                Option ***tmp = realloc(arr, i * sizeof(Option **));
-                if (!tmp) {
-                    fprintf(stderr, "Error while reallocating memory for compound array: %s\n", strerror(errno));
-                    goto clean_c;
-                }
-                arr = tmp;
-            }
-            array->a_v.a_v = arr;
-            array->len = i;
-            return currentElement;
-            clean_c:
-            free(arr);
-            return currentElement;
+//Written out rather than looped, classes is a constant at every call site so this folds down to the ORs it needs
+static inline uint64_t scanMask(const uint64_t *masks, unsigned classes) {
+    return (classes & SCAN_NEWLINE ? masks[0] : 0) | (classes & SCAN_DQUOTE ? masks[1] : 0) |
+           (classes & SCAN_SQUOTE ? masks[2] : 0) | (classes & SCAN_OPEN_BRACKET ? masks[3] : 0) |
+           (classes & SCAN_CLOSE_BRACKET ? masks[4] : 0) | (classes & SCAN_OPEN_BRACE ? masks[5] : 0) |
+           (classes & SCAN_CLOSE_BRACE ? masks[6] : 0) | (classes & SCAN_COMMA ? masks[7] : 0);
+}
+
+//First character at or after from that belongs to one of the classes, limit if there is none before limit
+static inline char *scanFind(Scanner *scan, const char *from, const char *limit, unsigned classes) {
+    size_t offset = from - scan->base;
+    size_t end = limit - scan->base;
+    if (end > scan->length) end = scan->length;
+    while (offset < end) {
+        size_t block = offset / SCAN_BLOCK;
+        ScanBlock *cached = &scan->blocks[block & 1];
+        if (cached->index != block) scanBlock(scan, cached, block);
+        if (classes & ~cached->ready) {
+            unsigned groups = (classes & SCAN_STRING ? SCAN_STRING : 0) | (classes & SCAN_NESTING ? SCAN_NESTING : 0);
+            scanClasses(cached, groups & ~cached->ready);
         }
-        case ARRAY: {
-            const char *b = strchr(arrayStart + 1, '[');
-            ArrayOption *arr = malloc(ARRAY_ALLOCATION * sizeof(ArrayOption));
-            size_t arrlen = ARRAY_ALLOCATION;
-            size_t i = 0;
-            while (b && b < bufferEnd) {
-                if (i - 2 == arrlen) {
-                    ArrayOption *tmp = realloc(arr, (arrlen + ARRAY_ALLOCATION) * sizeof(ArrayOption));
-                    arrlen += ARRAY_ALLOCATION;
-                    if (!tmp) {
-                        fprintf(stderr, "Error while reallocating memory for array array: %s\n", strerror(errno));
-                        free(arr);
-                        return NULL;
-                    }
-                    arr = tmp;
-                }
-                arr[i].type = array->a_a.t->type;
-                b = parseArray(&(arr[i]), file, optName, b, bufferEnd);
-                if (!b) {
-                    free(arr);
-                    return NULL;
-                }
-                char *next = strchr(b, '[');
-                char *possibleEnd = strchr(b, ']');
-                if (possibleEnd < next) { //end of array reached
-                    if (i + 1 != arrlen) {
-                        ArrayOption *tmp = realloc(arr, (i + 1) * sizeof(ArrayOption));
-                        if (!tmp) {
-                            fprintf(stderr, "Error while reallocating memory for array array: %s\n", strerror(errno));
-                            free(arr);
-                            return NULL;
-                        }
-                        arr = tmp;
-                    }
-                    array->a_a.a_a = arr;
-                    array->len = i + 1;
-                    return possibleEnd;
-                }
-                b = next;
-                i++;
-            }
-            fprintf(stderr,
-                    "Error at option %s:%s: Array in array must start on the same line as the option definition with [\n",
-                    file, optName);
-            free(arr);
-            return NULL;
+        uint64_t mask = scanMask(cached->masks, classes) & ~(uint64_t) 0 << (offset % SCAN_BLOCK);
+        if (mask) {
+            size_t found = block * SCAN_BLOCK + __builtin_ctzll(mask);
+            return found < end ? scan->base + found : (char *) limit;
         }
+        offset = (block + 1) * SCAN_BLOCK;
     }
-    return NULL;
+    return (char *) limit;
 }
 
-void parseConfigWhole(Option **options, const char *file, char *bufferOriginal, size_t length) {
-    char *buffer = bufferOriginal;
-    char *lineEnd = buffer;
+//Number of characters in [from, limit) that belong to one of the classes
+static size_t scanCount(Scanner *scan, const char *from, const char *limit, unsigned classes) {
+    size_t count = 0;
+    while ((from = scanFind(scan, from, limit, classes)) < limit) {
+        size_t offset = from - scan->base;
+        size_t block = offset / SCAN_BLOCK;
+        size_t end = limit - scan->base;
+        //Everything left in this block at once, the first match is where the block's share starts
+        uint64_t mask = scanMask(scan->blocks[block & 1].masks, classes) & ~(uint64_t) 0 << (offset % SCAN_BLOCK);
+        if (end < (block + 1) * SCAN_BLOCK) mask &= ((uint64_t) 1 << (end % SCAN_BLOCK)) - 1;
+        count += __builtin_popcountll(mask);
+        from = scan->base + (block + 1) * SCAN_BLOCK;
+    }
+    return count;
+}
 
-    while ((lineEnd = strchrnul_(lineEnd + 1, '\n')) && lineEnd - bufferOriginal < length) {
-        char *lineBufTrim = NULL;
-        trimnp(buffer, lineEnd, &lineBufTrim);
-        if (!lineBufTrim) { //trim returns length of trimmed string. If the new string is 0, continue to the next line
-            buffer = lineEnd + 1;
-            continue;
-        }
+//numbers
 
-        char *assignIndex = NULL, *endValueIndex = lineEnd;
-        for (char *i = lineBufTrim; i < lineEnd; ++i) {
-            if (*i == '=' && !assignIndex) {
-                assignIndex = i;
-            }
-            if (*i == '/' && *(i + 1) == '/') {
-                endValueIndex = i;
-                break;
-            }
-        }
-        if (!assignIndex) { // If a '//' occurs before a '=', then assignIndex will be null
-            buffer = lineEnd + 1;
-            continue;
-        }
+/*
+ * Locale independent number parsing for option values and arrays. Decimal numbers with at most 19 significant digits
+ * and a power of ten within 1e22 are built from one multiplication or division of two exactly representable doubles,
+ * which is correctly rounded. Anything else (more digits, larger exponents, hex, inf, nan) is handed to strtod.
+ */
+static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-        char *optName = NULL;
-        trimn(lineBufTrim, assignIndex - lineBufTrim, &optName);
+//strtol(s, endPtr, 10) without its whitespace skipping and locale handling, for the common case
+static long parseLong(const char *s, char **endPtr) {
+    const char *p = s;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    const char *digits = p;
+    uint64_t value = 0;
+    while (*p >= '0' && *p <= '9' && p - digits < 18) value = value * 10 + (*p++ - '0');
+    if (*p >= '0' && *p <= '9') return strtol(s, endPtr, 10); //Might not fit
+    if (p == digits) {
+        *endPtr = (char *) s;
+        return 0;
+    }
+    *endPtr = (char *) p;
+    return negative ? -(long) value : (long) value;
+}
 
-        struct Option *optOut = NULL;
-        HASH_FIND(options, optName, optOut);
-        if (!optOut) {
-            fprintf(stderr, "Warning in %s: Unrecognized option '%s' found\n", file, optName);
-            goto loopEnd;
+//strtod in the C locale, decimal points are rewritten for whatever locale the process runs in
+static double strtodC(const char *s, char **endPtr) {
+    char point = *localeconv()->decimal_point;
+    if (point == '.') return strtod(s, endPtr);
+    char copy[128];
+    size_t len = 0;
+    while (len < sizeof(copy) - 1 && s[len] && !strchr(",]\n", s[len])) {
+        copy[len] = s[len] == '.' ? point : s[len];
+        len++;
+    }
+    copy[len] = '\0';
+    char *copyEnd;
+    double value = strtod(copy, &copyEnd);
+    *endPtr = (char *) s + (copyEnd - copy);
+    return value;
+}
+
+static double parseDouble(const char *s, char **endPtr) {
+    const char *p = s;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') p++;
+    uint64_t mantissa = 0;
+    int significant = 0, exponent = 0;
+    bool any = false;
+    for (; *p >= '0' && *p <= '9'; ++p, any = true) {
+        if (mantissa || *p != '0') significant++;
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (*p == '.') {
+        for (++p; *p >= '0' && *p <= '9'; ++p, any = true) {
+            if (mantissa || *p != '0') significant++;
+            mantissa = mantissa * 10 + (*p - '0');
+            exponent--;
+        }
+    }
+    if (!any || significant > 19 || *p == 'x' || *p == 'X') return strtodC(s, endPtr);
+    if ((*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negativeExponent = *e == '-';
+        if (*e == '-' || *e == '+') e++;
+        if (*e >= '0' && *e <= '9') {
+            int value = 0;
+            while (*e >= '0' && *e <= '9') {
+                if (value < 10000) value = value * 10 + (*e - '0');
+                e++;
+            }
+            exponent += negativeExponent ? -value : value;
+            p = e;
         }
+    }
+    if (mantissa > (uint64_t) 1 << 53 || exponent < -22 || exponent > 22) {
+        if (mantissa) return strtodC(s, endPtr);
+        exponent = 0;
+    }
+    double value = (double) mantissa;
+    value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+    *endPtr = (char *) p;
+    return negative ? -value : value;
+}
+
+//load statistics
+
+//What one load with setParseStats collected so far, shared by every thread the load runs on
+typedef struct StatsRecorder {
+    ParseStats *out;
+    atomic_size_t mallocs;
+    atomic_size_t reallocs;
+    _Atomic uint64_t readNs;
+    uint64_t arrayNs; //Only the calling thread parses arrays that aren't inside another array
+    bool failed; //Ran out of memory for the file list
+#ifndef _WIN32
+    pthread_mutex_t lock; //Guards out->files, include files are read on several threads
+#endif
+} StatsRecorder;
+
+//Set on the threads of a load with statistics, so the allocation helpers below can count without being passed it
+static _Thread_local StatsRecorder *allocStats = NULL;
+
+#ifndef LIBCONF_NO_STATS
+#define STATS_COUNT(counter, n) do{                                                     \
+    if (allocStats) atomic_fetch_add_explicit(&allocStats->counter, n, memory_order_relaxed); \
+}while(0)
+#else
+#define STATS_COUNT(counter, n) do{}while(0)
+#endif
+
+static uint64_t monotonicNs(void) {
+    struct timespec ts;
+#ifndef _WIN32
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+//monotonicNs, or 0 without statistics so callers don't have to check twice
+static uint64_t statsClock(const StatsRecorder *stats) {
+    return stats ? monotonicNs() : 0;
+}
+
+static void statsAddFile(StatsRecorder *stats, const char *path, size_t bytes, unsigned depth, bool cached) {
+#ifndef _WIN32
+    pthread_mutex_lock(&stats->lock);
+#endif
+    ParseStats *out = stats->out;
+    if (out->fileCount == out->fileCapacity) {
+        size_t capacity = out->fileCapacity ? out->fileCapacity * 2 : ARRAY_ALLOCATION;
+        ParseFileStats *tmp = realloc(out->files, capacity * sizeof(ParseFileStats));
+        if (tmp) {
+            out->files = tmp;
+            out->fileCapacity = capacity;
+        }
+    }
+    char *copy = out->fileCount < out->fileCapacity ? strdup(path) : NULL;
+    if (copy) {
+        out->files[out->fileCount++] = (ParseFileStats) {copy, bytes, depth, cached};
+    } else {
+        stats->failed = true;
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&stats->lock);
+#endif
+}
+
+//memory limit
+
+//What a load with setMemoryLimit may still allocate, shared by every thread the load runs on
+typedef struct MemoryBudget {
+    size_t limit;
+    atomic_size_t used;
+    atomic_bool exceeded;
+} MemoryBudget;
+
+//Set on the threads of a load with a memory limit, like allocStats
+static _Thread_local MemoryBudget *allocBudget = NULL;
+//Bytes this thread took from allocBudget in one go and hasn't handed out yet, so most allocations don't touch the
+//shared counter. A load can be refused while other threads still hold up to BUDGET_GRANT each
+static _Thread_local size_t budgetLeft = 0;
+#define BUDGET_GRANT (64 * 1024)
+
+//Puts this thread on the budget of a load (NULL for none), dropping what it had left of the one before
+static void budgetEnter(MemoryBudget *budget) {
+    if (allocBudget == budget) return;
+    allocBudget = budget;
+    budgetLeft = 0;
+}
+
+//Takes size bytes from the budget of the load running on this thread, false (errno ENOMEM) if it would go over the
+//limit. Once a load went over, everything it asks for after is refused too, so it stops rather than going on in pieces
+static bool budgetTake(size_t size) {
+    MemoryBudget *budget = allocBudget;
+    if (!budget) return true;
+    if (size <= budgetLeft && !atomic_load_explicit(&budget->exceeded, memory_order_relaxed)) {
+        budgetLeft -= size;
+        return true;
+    }
+    size_t used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    size_t grant;
+    do {
+        if (atomic_load_explicit(&budget->exceeded, memory_order_relaxed) || used > budget->limit ||
+            size > budget->limit - used) {
+            atomic_store_explicit(&budget->exceeded, true, memory_order_relaxed);
+            errno = ENOMEM;
+            return false;
+        }
+        grant = budget->limit - used < BUDGET_GRANT ? budget->limit - used : BUDGET_GRANT;
+        if (grant < size) grant = size;
+    } while (!atomic_compare_exchange_weak_explicit(&budget->used, &used, used + grant, memory_order_relaxed,
+                                                    memory_order_relaxed));
+    budgetLeft += grant - size;
+    return true;
+}
+
+static bool budgetExceeded(void) {
+    return allocBudget && atomic_load_explicit(&allocBudget->exceeded, memory_order_relaxed);
+}
+
+//arena
+
+#define ARENA_ALIGN(size) (((size) + 15) & ~(size_t) 15)
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    size_t used;
+    size_t last; //Offset of the most recent allocation, which can still be grown in place
+    _Alignas(16) unsigned char data[];
+} ArenaChunk;
+
+typedef struct ArenaRegion {
+    ArenaChunk *head;
+} ArenaRegion;
+
+struct ConfigArena {
+    ArenaRegion schema; //Tables and options added with ADD_OPT_*, live until cleanOptions
+    ArenaRegion defaults; //Defaults of the options in schema, kept out of the way of lookups, live as long
+    ArenaRegion values; //Everything readConfig parses into the config, released by the next reload
+    size_t chunkSize;
+};
+
+static void *regionAlloc(ArenaRegion *region, size_t chunkSize, size_t size) {
+    size = ARENA_ALIGN(size);
+    ArenaChunk *chunk = region->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t dataSize = size > chunkSize ? size : chunkSize;
+        if (!budgetTake(sizeof(ArenaChunk) + dataSize)) return NULL;
+        chunk = malloc(sizeof(ArenaChunk) + dataSize);
+        if (!chunk) return NULL;
+        STATS_COUNT(mallocs, 1);
+        chunk->size = dataSize;
+        chunk->used = 0;
+        chunk->next = region->head;
+        region->head = chunk;
+    }
+    chunk->last = chunk->used;
+    chunk->used += size;
+    return chunk->data + chunk->last;
+}
+
+//Grows or shrinks the most recent allocation in place, anything else is copied into a new allocation
+static void *regionRealloc(ArenaRegion *region, size_t chunkSize, void *ptr, size_t oldSize, size_t newSize) {
+    if (!ptr) return regionAlloc(region, chunkSize, newSize);
+    ArenaChunk *chunk = region->head;
+    if (chunk && (unsigned char *) ptr == chunk->data + chunk->last &&
+        chunk->last + ARENA_ALIGN(newSize) <= chunk->size) {
+        chunk->used = chunk->last + ARENA_ALIGN(newSize);
+        return ptr;
+    }
+    if (newSize <= oldSize) return ptr;
+    void *moved = regionAlloc(region, chunkSize, newSize);
+    if (moved) memcpy(moved, ptr, oldSize);
+    return moved;
+}
+
+//Frees every chunk of a region. The first chunk can be kept around so a reload doesn't have to allocate it again
+static void regionRelease(ArenaRegion *region, bool keepOne) {
+    ArenaChunk *chunk = region->head;
+    region->head = NULL;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        if (keepOne && !next) {
+            chunk->used = 0;
+            chunk->last = 0;
+            region->head = chunk;
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+}
+
+//Bytes of the chunks of a region, used (if not NULL) gets how many of them are handed out
+static size_t regionSize(const ArenaRegion *region, size_t *used) {
+    size_t bytes = 0;
+    if (used) *used = 0;
+    for (const ArenaChunk *chunk = region->head; chunk; chunk = chunk->next) {
+        bytes += sizeof(ArenaChunk) + chunk->size;
+        if (used) *used += chunk->used;
+    }
+    return bytes;
+}
+
+//Allocation helpers for parsed values: they come from the arena's value region if there is one, from malloc otherwise
+
+//Set on the extra threads of a parallel compound array parse (see parseCompoundArrayParallel). They allocate arena
+//values from a region of their own, which is added to the arena's value region once they are done
+static _Thread_local ArenaRegion *workerRegion = NULL;
+
+static ArenaRegion *valueRegion(ConfigArena *arena) {
+    return workerRegion ? workerRegion : &arena->values;
+}
+
+static void *valueAlloc(ConfigArena *arena, size_t size) {
+    if (arena) return regionAlloc(valueRegion(arena), arena->chunkSize, size);
+    if (!budgetTake(size)) return NULL;
+    STATS_COUNT(mallocs, 1);
+    return malloc(size);
+}
+
+static void *valueRealloc(ConfigArena *arena, void *ptr, size_t oldSize, size_t newSize) {
+    if (arena) return regionRealloc(valueRegion(arena), arena->chunkSize, ptr, oldSize, newSize);
+    if (newSize > oldSize && !budgetTake(newSize - oldSize)) return NULL;
+    STATS_COUNT(reallocs, 1);
+    return realloc(ptr, newSize);
+}
+
+static char *valueStrndup(ConfigArena *arena, const char *s, size_t n) {
+    if (!arena) {
+        if (!budgetTake(n + 1)) return NULL;
+        STATS_COUNT(mallocs, 1);
+        return strndup(s, n);
+    }
+    char *copy = regionAlloc(valueRegion(arena), arena->chunkSize, n + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+static void valueFree(ConfigArena *arena, void *ptr) {
+    if (!arena) free(ptr);
+}
+
+//option table
+
+//What only the root table of a config holds: its settings and the state kept between its loads. Allocated by the
+//first setter, so compounds and compound array elements don't carry them
+typedef struct RootSettings {
+    unsigned parseThreads; //See setParseThreads
+    IncludeCache *includeCache; //See setIncludeCache
+    struct LoadRecord *record; //See setIncrementalReload, NULL unless it's enabled
+    struct BindingSet *bindings; //See bindOption, NULL unless options are bound
+    ParseStats *stats; //See setParseStats
+    DiagnosticSink *diagnostics; //See setDiagnosticSink
+    size_t memoryLimit; //See setMemoryLimit
+} RootSettings;
+
+static const RootSettings defaultSettings = {0};
+
+//The settings of a root table, defaultSettings if none were set
+static const RootSettings *settingsOf(const OptionTable *root) {
+    return root->settings ? root->settings : &defaultSettings;
+}
+
+//The settings of a root table to change, allocated the first time. NULL if there is no memory for them
+static RootSettings *settingsFor(OptionTable *root) {
+    if (!root->settings) {
+        root->settings = calloc(1, sizeof(RootSettings));
+        if (!root->settings) fprintf(stderr, "Error: Can't allocate memory for config settings: %s\n", strerror(errno));
+    }
+    return root->settings;
+}
+
+#define ROTL64(x, b) (uint64_t) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3) do{                           \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                    \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                    \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+}while(0)
+
+//SipHash-1-3, fast enough for short option names while still keyed against collision flooding
+static uint64_t siphash13(const uint64_t key[2], const char *in, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+    const unsigned char *p = (const unsigned char *) in;
+    const unsigned char *end = p + (len & ~(size_t) 7);
+
+    for (; p != end; p += 8) {
+        uint64_t m;
+        memcpy(&m, p, sizeof(m));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        m = __builtin_bswap64(m);
+#endif
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t b = ((uint64_t) len) << 56;
+    switch (len & 7) {
+        case 7: b |= ((uint64_t) p[6]) << 48; // fallthrough
+        case 6: b |= ((uint64_t) p[5]) << 40; // fallthrough
+        case 5: b |= ((uint64_t) p[4]) << 32; // fallthrough
+        case 4: b |= ((uint64_t) p[3]) << 24; // fallthrough
+        case 3: b |= ((uint64_t) p[2]) << 16; // fallthrough
+        case 2: b |= ((uint64_t) p[1]) << 8; // fallthrough
+        case 1: b |= ((uint64_t) p[0]); // fallthrough
+        default: break;
+    }
+    v3 ^= b;
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//One random SipHash key per process, so a hash can be computed once and reused against any table (see compilePath)
+static uint64_t sipKeyWords[2];
+static bool sipKeyReady = false;
+
+//Picks the seed and derives the key from it, the first time the key is needed
+static void optionTableKeyInit(void) {
+    static uint64_t seed = 0;
+    uint64_t current = __atomic_load_n(&seed, __ATOMIC_RELAXED);
+    if (!current) {
+        uint64_t entropy = 0;
+#ifndef _WIN32
+        if (getentropy(&entropy, sizeof(entropy)) != 0)
+#endif
+            entropy = (uint64_t) time(NULL) ^ ((uint64_t) (uintptr_t) &entropy << 16) ^ (uint64_t) clock();
+        entropy |= 1;
+        //Whichever thread gets here first decides the seed
+        if (__atomic_compare_exchange_n(&seed, &current, entropy, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            current = entropy;
+    }
+    //Threads racing here all derive the same words from the one seed
+    __atomic_store_n(&sipKeyWords[0], splitmix64(&current), __ATOMIC_RELAXED);
+    __atomic_store_n(&sipKeyWords[1], splitmix64(&current), __ATOMIC_RELAXED);
+    __atomic_store_n(&sipKeyReady, true, __ATOMIC_RELEASE);
+}
+
+static inline void optionTableKey(uint64_t key[2]) {
+    if (!__atomic_load_n(&sipKeyReady, __ATOMIC_ACQUIRE)) optionTableKeyInit();
+    key[0] = __atomic_load_n(&sipKeyWords[0], __ATOMIC_RELAXED);
+    key[1] = __atomic_load_n(&sipKeyWords[1], __ATOMIC_RELAXED);
+}
+
+uint32_t optionTableHash(const char *key, size_t keyLen) {
+    uint64_t sipKey[2];
+    optionTableKey(sipKey);
+    uint32_t hash = (uint32_t) siphash13(sipKey, key, keyLen);
+    return hash ? hash : 1; //0 is reserved for empty slots
+}
+
+//Allocates the slot arrays of a table from region, or with calloc if region is NULL
+static bool optionTableAlloc(OptionTable *table, ArenaRegion *region, size_t capacity) {
+    if (region) {
+        table->hashes = regionAlloc(region, table->arena->chunkSize, capacity * sizeof(*table->hashes));
+        table->slots = regionAlloc(region, table->arena->chunkSize, capacity * sizeof(*table->slots));
+        if (!table->hashes || !table->slots) return false;
+        memset(table->hashes, 0, capacity * sizeof(*table->hashes));
+        memset(table->slots, 0, capacity * sizeof(*table->slots));
+    } else {
+        if (!budgetTake(capacity * (sizeof(*table->hashes) + sizeof(*table->slots)))) return false;
+        table->hashes = calloc(capacity, sizeof(*table->hashes));
+        table->slots = calloc(capacity, sizeof(*table->slots));
+        STATS_COUNT(mallocs, 2);
+        if (!table->hashes || !table->slots) {
+            free(table->hashes);
+            free(table->slots);
+            return false;
+        }
+    }
+    table->capacity = capacity;
+    return true;
+}
+
+//An empty table with no slots yet (see optionTableAlloc) and every setting at its default. base is the template of a
+//compound array element, NULL for every other table
+static void optionTableInitHeader(OptionTable *table, ConfigArena *arena, const OptionTable *base) {
+    *table = (OptionTable) {.arena = arena, .base = base};
+}
+
+static struct Option **optionTableCreateIn(ConfigArena *arena, bool ownsArena, size_t expected) {
+    OptionTable *table = arena ? regionAlloc(&arena->schema, arena->chunkSize, sizeof(OptionTable))
+                               : malloc(sizeof(OptionTable));
+    if (!table) {
+        fprintf(stderr, "Error: Can't allocate memory for option table: %s\n", strerror(errno));
+        return NULL;
+    }
+    optionTableInitHeader(table, arena, NULL);
+    table->ownsArena = ownsArena;
+    size_t capacity = OPTION_TABLE_INITIAL_SIZE;
+    while (OPTION_TABLE_MAX_LOAD(capacity) < expected) capacity <<= 1;
+    if (!optionTableAlloc(table, arena ? &arena->schema : NULL, capacity)) {
+        fprintf(stderr, "Error: Can't allocate memory for option table: %s\n", strerror(errno));
+        if (!arena) free(table);
+        return NULL;
+    }
+    return (struct Option **) table;
+}
+
+struct Option **optionTableCreate(size_t expected) {
+    return optionTableCreateIn(NULL, false, expected);
+}
+
+static ConfigArena *configArenaCreate(size_t chunkSize) {
+    ConfigArena *arena = malloc(sizeof(ConfigArena));
+    if (!arena) {
+        fprintf(stderr, "Error: Can't allocate memory for config arena: %s\n", strerror(errno));
+        return NULL;
+    }
+    arena->schema.head = NULL;
+    arena->defaults.head = NULL;
+    arena->values.head = NULL;
+    arena->chunkSize = chunkSize ? chunkSize : CONFIG_ARENA_CHUNK_SIZE;
+    return arena;
+}
+
+static void configArenaFree(ConfigArena *arena) {
+    regionRelease(&arena->values, false);
+    regionRelease(&arena->defaults, false);
+    regionRelease(&arena->schema, false);
+    free(arena);
+}
+
+struct Option **optionTableCreateArena(size_t chunkSize) {
+    ConfigArena *arena = configArenaCreate(chunkSize);
+    if (!arena) return NULL;
+    struct Option **table = optionTableCreateIn(arena, true, 0);
+    if (!table) configArenaFree(arena);
+    return table;
+}
+
+struct Option **optionTableCreateChild(struct Option **parent) {
+    if (!parent) return NULL;
+    return optionTableCreateIn(OPTION_TABLE(parent)->arena, false, 0);
+}
+
+struct Option *optionAlloc(struct Option **handle) {
+    ConfigArena *arena = handle ? OPTION_TABLE(handle)->arena : NULL;
+    struct Option *opt = arena ? regionAlloc(&arena->schema, arena->chunkSize, sizeof(Option)) : malloc(sizeof(Option));
+    OptionDefault *def = arena ? regionAlloc(&arena->defaults, arena->chunkSize, sizeof(OptionDefault))
+                               : malloc(sizeof(OptionDefault));
+    if (!opt || !def) {
+        fprintf(stderr, "Error: Can't allocate memory for option: %s\n", strerror(errno));
+        if (!arena) {
+            free(opt);
+            free(def);
+        }
+        return NULL;
+    }
+    opt->def = def;
+    return opt;
+}
+
+//Places an option into the first free slot of its probe sequence. The table must have a free slot
+static void optionTableInsert(OptionTable *table, uint32_t hash, Option *opt) {
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    while (table->hashes[i]) i = (i + 1) & mask;
+    table->hashes[i] = hash;
+    table->slots[i] = opt;
+}
+
+//Doubles the table, or turns a frozen one (see freezeConfig) back into a probed one with room for another option
+static bool optionTableGrow(OptionTable *table) {
+    OptionTable old = *table;
+    size_t capacity = old.capacity << 1;
+    if (old.seeds) {
+        capacity = OPTION_TABLE_INITIAL_SIZE;
+        while (OPTION_TABLE_MAX_LOAD(capacity) < old.count + 1) capacity <<= 1;
+    }
+    //Compound array elements (tables with a base) are parsed values, everything else is schema
+    ArenaRegion *region = !table->arena ? NULL : table->base ? valueRegion(table->arena) : &table->arena->schema;
+    if (!optionTableAlloc(table, region, capacity)) {
+        *table = old;
+        return false;
+    }
+    table->seeds = NULL;
+    //Fingerprints are full 32-bit hashes, so moving an option never needs its name hashed again
+    for (size_t i = 0; i < old.capacity; ++i) {
+        if (old.hashes[i]) optionTableInsert(table, old.hashes[i], old.slots[i]);
+    }
+    if (!table->arena) {
+        free(old.hashes);
+        free(old.slots);
+        free(old.seeds);
+    }
+    return true;
+}
+
+void optionTableAdd(struct Option **handle, struct Option *opt) {
+    OptionTable *table = OPTION_TABLE(handle);
+    if (!table || !opt) return;
+    if ((table->seeds || table->count + 1 > OPTION_TABLE_MAX_LOAD(table->capacity)) && !optionTableGrow(table)) {
+        fprintf(stderr, "Error: Can't grow option table to add option '%s': %s\n", opt->name, strerror(errno));
+        return;
+    }
+    optionTableInsert(table, optionTableHash(opt->name, strlen(opt->name)), opt);
+    table->count++;
+}
+
+/*
+ * Builds the table of a static schema in one pass: the table is created at its final size and its options are taken
+ * from one block of the schema region, so nothing is allocated per option and nothing is rehashed. Options point at
+ * their defaults in the schema, except compound arrays, whose default has to hold the template table built here.
+ * On failure whatever was built is left to the arena
+ */
+static struct Option **optionTableBuildStatic(ConfigArena *arena, bool ownsArena, const StaticOption *schema) {
+    size_t count = 0;
+    while (schema && schema[count].name) count++;
+    struct Option **handle = optionTableCreateIn(arena, ownsArena, count);
+    if (!handle) return NULL;
+    OptionTable *table = OPTION_TABLE(handle);
+    Option *opts = count ? regionAlloc(&arena->schema, arena->chunkSize, count * sizeof(Option)) : NULL;
+    if (count && !opts) {
+        fprintf(stderr, "Error: Can't allocate memory for options: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const StaticOption *entry = &schema[i];
+        Option *opt = &opts[i];
+        opt->name = (char *) entry->name;
+        opt->type = entry->type;
+        opt->def = (OptionDefault *) &entry->def; //Defaults are only ever read
+        switch (entry->type) {
+            case BOOL:
+                opt->v_b = opt->def->dv_b;
+                break;
+            case LONG:
+                opt->v_l = opt->def->dv_l;
+                break;
+            case DOUBLE:
+                opt->v_d = opt->def->dv_d;
+                break;
+            case TEXT:
+                opt->v_sv = opt->def->dv_sv;
+                break;
+            case COMPOUND:
+                opt->v_v = optionTableBuildStatic(arena, false, entry->schema);
+                if (!opt->v_v) return NULL;
+                break;
+            case ARRAY:
+                if (entry->def.dv_a.type == COMPOUND) {
+                    opt->def = regionAlloc(&arena->defaults, arena->chunkSize, sizeof(OptionDefault));
+                    if (!opt->def) {
+                        fprintf(stderr, "Error: Can't allocate memory for option: %s\n", strerror(errno));
+                        return NULL;
+                    }
+                    *opt->def = entry->def;
+                    opt->def->dv_a.a_v.a_v_t = optionTableBuildStatic(arena, false, entry->schema);
+                    if (!opt->def->dv_a.a_v.a_v_t) return NULL;
+                }
+                opt->v_a = opt->def->dv_a;
+                break;
+        }
+        optionTableInsert(table, optionTableHash(entry->name, strlen(entry->name)), opt);
+        table->count++;
+    }
+    return handle;
+}
+
+struct Option **optionTableCreateStatic(const StaticOption *schema) {
+    ConfigArena *arena = configArenaCreate(0);
+    if (!arena) return NULL;
+    struct Option **table = optionTableBuildStatic(arena, true, schema);
+    if (!table) configArenaFree(arena);
+    return table;
+}
+
+struct Option *optionTableFind(struct Option **handle, const char *key, size_t keyLen) {
+    return optionTableFindHashed(handle, key, keyLen, optionTableHash(key, keyLen));
+}
+
+//Slot of a key in a frozen table: its bucket's seed is mixed into the hash, which is then mapped onto [0, count)
+static inline size_t frozenSlot(uint32_t hash, uint32_t seed, size_t count) {
+    uint32_t x = hash ^ seed * 0x9e3779b9u;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return (size_t) (((uint64_t) x * count) >> 32);
+}
+
+//Looks in the table's own slots only, not in its base
+static Option *optionTableProbe(const OptionTable *table, const char *key, size_t keyLen, uint32_t hash) {
+    if (table->seeds) { //Frozen: the one slot the key can be in
+        size_t i = frozenSlot(hash, table->seeds[hash & table->seedMask], table->capacity);
+        Option *opt = table->slots[i];
+        return table->hashes[i] == hash && !strncmp(opt->name, key, keyLen) && opt->name[keyLen] == '\0' ? opt : NULL;
+    }
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask; table->hashes[i]; i = (i + 1) & mask) {
+        if (table->hashes[i] != hash) continue;
+        Option *opt = table->slots[i];
+        if (!strncmp(opt->name, key, keyLen) && opt->name[keyLen] == '\0') return opt;
+    }
+    return NULL;
+}
+
+struct Option *optionTableFindHashed(struct Option **handle, const char *key, size_t keyLen, uint32_t hash) {
+    const OptionTable *table = OPTION_TABLE(handle);
+    if (!table) return NULL;
+    Option *opt = optionTableProbe(table, key, keyLen, hash);
+    if (!opt && table->base) opt = optionTableProbe(table->base, key, keyLen, hash);
+    return opt;
+}
+
+//Cursor runs over the table's own slots, then over its base's, skipping the base options the table overrides
+struct Option *optionTableNext(struct Option **handle, size_t *cursor) {
+    const OptionTable *table = OPTION_TABLE(handle);
+    for (; *cursor < table->capacity; ++*cursor) {
+        if (table->slots[*cursor]) return table->slots[(*cursor)++];
+    }
+    const OptionTable *base = table->base;
+    if (!base) return NULL;
+    for (; *cursor - table->capacity < base->capacity; ++*cursor) {
+        Option *opt = base->slots[*cursor - table->capacity];
+        if (!opt || optionTableProbe(table, opt->name, strlen(opt->name), base->hashes[*cursor - table->capacity])) {
+            continue;
+        }
+        ++*cursor;
+        return opt;
+    }
+    return NULL;
+}
+
+//Like HASH_ITER, but only visits the options stored in the table itself. For code that writes or frees options, as
+//the ones an element shares with its template belong to the template
+#define OWN_ITER(table, o)                                \
+    for (size_t own = 0; own < (table)->capacity; ++own) \
+        for ((o) = (table)->slots[own]; o; (o) = NULL)
+
+/*
+ * An empty table for a compound array element: every lookup falls through to template until an option is written,
+ * see optionTableFindWritable. Allocated like parsed values, from arena's value region or the heap
+ */
+static struct Option **optionTableOverlayIn(struct Option **template, ConfigArena *arena) {
+    OptionTable *table = valueAlloc(arena, sizeof(OptionTable));
+    if (table) optionTableInitHeader(table, arena, OPTION_TABLE(template));
+    if (!table || !optionTableAlloc(table, arena ? valueRegion(arena) : NULL, OPTION_TABLE_INITIAL_SIZE)) {
+        fprintf(stderr, "Error: Can't allocate memory for option table: %s\n", strerror(errno));
+        valueFree(arena, table);
+        return NULL;
+    }
+    return (struct Option **) table;
+}
+
+/*
+ * Finds an option to write a value into. If the table only shares it with its base, the option is copied into the
+ * table first; the copy of a compound gets an empty table that falls back to the template's compound in turn
+ */
+static Option *optionTableFindWritable(struct Option **handle, const char *key, size_t keyLen) {
+    OptionTable *table = OPTION_TABLE(handle);
+    uint32_t hash = optionTableHash(key, keyLen);
+    Option *opt = optionTableProbe(table, key, keyLen, hash);
+    if (opt || !table->base) return opt;
+    const Option *shared = optionTableProbe(table->base, key, keyLen, hash);
+    if (!shared) return NULL;
+
+    if (table->count + 1 > OPTION_TABLE_MAX_LOAD(table->capacity) && !optionTableGrow(table)) {
+        fprintf(stderr, "Error: Can't grow option table to add option '%s': %s\n", shared->name, strerror(errno));
+        return NULL;
+    }
+    opt = valueAlloc(table->arena, sizeof(Option));
+    if (!opt) {
+        fprintf(stderr, "Error: Can't allocate memory for option: %s\n", strerror(errno));
+        return NULL;
+    }
+    memcpy(opt, shared, sizeof(Option));
+    if (opt->type == COMPOUND) {
+        opt->v_v = optionTableOverlayIn(shared->v_v, table->arena);
+        if (!opt->v_v) {
+            valueFree(table->arena, opt);
+            return NULL;
+        }
+    }
+    optionTableInsert(table, hash, opt);
+    table->count++;
+    return opt;
+}
+
+//Frees a copy optionTableCloneIn gave up on partway, slots it hadn't filled yet are NULL
+static void optionTableCloneFree(OptionTable *copy) {
+    for (size_t i = 0; i < copy->capacity; ++i) {
+        Option *opt = copy->slots[i];
+        if (!opt) continue;
+        if (opt->type == COMPOUND && opt->v_v) optionTableCloneFree(OPTION_TABLE(opt->v_v));
+        if (!copy->base) valueFree(copy->arena, opt->def);
+        valueFree(copy->arena, opt);
+    }
+    optionTableFree((struct Option **) copy);
+}
+
+//Copies the table and every option in it into arena's value region (or the heap if arena is NULL).
+//Compounds get their own copy of the child table. NULL if it runs out of memory
+static struct Option **optionTableCloneIn(struct Option **handle, ConfigArena *arena) {
+    const OptionTable *table = OPTION_TABLE(handle);
+    if (!table) return NULL;
+    OptionTable *copy = valueAlloc(arena, sizeof(OptionTable));
+    if (copy) optionTableInitHeader(copy, arena, table->base);
+    if (!copy || !optionTableAlloc(copy, arena ? valueRegion(arena) : NULL, table->capacity)) {
+        fprintf(stderr, "Error: Can't allocate memory for option table: %s\n", strerror(errno));
+        valueFree(arena, copy);
+        return NULL;
+    }
+    copy->count = table->count;
+    copy->seedMask = table->seedMask;
+    if (table->seeds) { //The slots are laid out for the seeds, a copy without them would probe past its options
+        copy->seeds = valueAlloc(arena, (table->seedMask + 1) * sizeof(*table->seeds));
+        if (!copy->seeds) goto fail;
+        memcpy(copy->seeds, table->seeds, (table->seedMask + 1) * sizeof(*table->seeds));
+    }
+    memcpy(copy->hashes, table->hashes, table->capacity * sizeof(*table->hashes));
+    for (size_t i = 0; i < table->capacity; ++i) {
+        if (!table->hashes[i]) continue;
+        Option *opt = valueAlloc(arena, sizeof(Option));
+        if (!opt) goto fail;
+        const Option *from = table->slots[i];
+        memcpy(opt, from, sizeof(Option));
+        copy->slots[i] = opt;
+        if (opt->type == COMPOUND) opt->v_v = NULL; //Until they are copies of their own, for optionTableCloneFree
+        //Options of an element share their template's defaults, every other table owns its options' defaults
+        if (!table->base) {
+            opt->def = valueAlloc(arena, sizeof(OptionDefault));
+            if (!opt->def) goto fail;
+            memcpy(opt->def, from->def, sizeof(OptionDefault));
+        }
+        if (opt->type == COMPOUND && !(opt->v_v = optionTableCloneIn(from->v_v, arena))) goto fail;
+    }
+    return (struct Option **) copy;
+
+    fail:
+    fprintf(stderr, "Error: Can't allocate memory for option table copy: %s\n", strerror(errno));
+    optionTableCloneFree(copy);
+    return NULL;
+}
+
+struct Option **optionTableClone(struct Option **handle) {
+    return optionTableCloneIn(handle, NULL);
+}
+
+//Frees the table itself, but not the options stored in it. Arena tables are only freed along with their arena
+void optionTableFree(struct Option **handle) {
+    OptionTable *table = OPTION_TABLE(handle);
+    if (!table || table->arena) return;
+    free(table->hashes);
+    free(table->slots);
+    free(table->seeds);
+    free(table);
+}
+
+//freezing
+
+#define FREEZE_BUCKET_LOAD 4 //Keys per bucket of a frozen table, on average
+
+/*
+ * Rebuilds a table as a minimal perfect hash (hash and displace): keys are split into buckets by their hash, and the
+ * buckets, largest first, each get the first seed that sends all their keys to free slots. Every option ends up in
+ * one of exactly count slots, the one frozenSlot gives for its hash. Fails (leaving the table as it is) if two keys
+ * share a 32-bit hash or a bucket runs out of seeds
+ */
+static bool optionTableFreeze(OptionTable *table) {
+    size_t count = table->count;
+    if (table->seeds || !count) return true;
+    size_t buckets = 1;
+    while (buckets * FREEZE_BUCKET_LOAD < count) buckets <<= 1;
+
+    //Keys grouped by bucket (counting sort), then buckets ordered by size, largest first
+    size_t *start = calloc(buckets + 1, sizeof(size_t));
+    size_t *order = malloc(buckets * sizeof(size_t));
+    uint32_t *keys = malloc(count * sizeof(uint32_t));
+    Option **opts = malloc(count * sizeof(Option *));
+    size_t *placed = malloc((count + buckets) * sizeof(size_t));
+    ArenaRegion *region = table->arena ? &table->arena->schema : NULL;
+    size_t chunkSize = table->arena ? table->arena->chunkSize : 0;
+    size_t seedsSize = buckets * sizeof(uint32_t), hashesSize = count * sizeof(uint32_t);
+    uint32_t *seeds = region ? regionAlloc(region, chunkSize, seedsSize) : malloc(seedsSize);
+    uint32_t *hashes = region ? regionAlloc(region, chunkSize, hashesSize) : malloc(hashesSize);
+    Option **slots = region ? regionAlloc(region, chunkSize, count * sizeof(Option *))
+                            : calloc(count, sizeof(Option *));
+    bool frozen = start && order && keys && opts && placed && seeds && hashes && slots;
+    if (frozen) {
+        if (region) memset(slots, 0, count * sizeof(Option *));
+        for (size_t i = 0; i < table->capacity; ++i) {
+            if (table->hashes[i]) start[(table->hashes[i] & (buckets - 1)) + 1]++;
+        }
+        for (size_t b = 0; b < buckets; ++b) start[b + 1] += start[b];
+        size_t maxSize = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            if (start[b + 1] - start[b] > maxSize) maxSize = start[b + 1] - start[b];
+        }
+        size_t *fill = placed; //Borrowed as the write position of each bucket while sorting
+        memcpy(fill, start, buckets * sizeof(size_t));
+        for (size_t i = 0; i < table->capacity; ++i) {
+            if (!table->hashes[i]) continue;
+            size_t at = fill[table->hashes[i] & (buckets - 1)]++;
+            keys[at] = table->hashes[i];
+            opts[at] = table->slots[i];
+        }
+        size_t ordered = 0;
+        for (size_t size = maxSize; size > 0; --size) {
+            for (size_t b = 0; b < buckets; ++b) {
+                if (start[b + 1] - start[b] == size) order[ordered++] = b;
+            }
+        }
+        for (size_t b = 0; b < buckets; ++b) seeds[b] = 0;
+
+        //The last buckets placed have few free slots to hit, so the limit is well above count tries
+        uint64_t maxSeed = (uint64_t) count * 16 + 1024;
+        for (size_t o = 0; frozen && o < ordered; ++o) {
+            size_t b = order[o];
+            size_t first = start[b], size = start[b + 1] - first;
+            for (size_t i = first; frozen && i < first + size; ++i) {
+                for (size_t j = first; j < i; ++j) {
+                    if (keys[i] == keys[j]) frozen = false;
+                }
+            }
+            uint64_t seed = 0;
+            for (; frozen && seed < maxSeed; ++seed) {
+                size_t done = 0;
+                for (; done < size; ++done) {
+                    size_t slot = frozenSlot(keys[first + done], (uint32_t) seed, count);
+                    if (slots[slot]) break;
+                    slots[slot] = opts[first + done];
+                    hashes[slot] = keys[first + done];
+                    placed[done] = slot;
+                }
+                if (done == size) break;
+                while (done) slots[placed[--done]] = NULL;
+            }
+            if (seed == maxSeed) frozen = false;
+            seeds[b] = (uint32_t) seed;
+        }
+    }
+    free(start);
+    free(order);
+    free(keys);
+    free(opts);
+    free(placed);
+    if (!frozen) {
+        if (!region) {
+            free(seeds);
+            free(hashes);
+            free(slots);
+        }
+        return false;
+    }
+    if (!region) {
+        free(table->hashes);
+        free(table->slots);
+    }
+    table->hashes = hashes;
+    table->slots = slots;
+    table->capacity = count;
+    table->seeds = seeds;
+    table->seedMask = buckets - 1;
+    return true;
+}
+
+static bool freezeTable(struct Option **handle) {
+    OptionTable *table = OPTION_TABLE(handle);
+    bool frozen = optionTableFreeze(table);
+    Option *opt;
+    OWN_ITER(table, opt) {
+        if (opt->type == COMPOUND) {
+            frozen &= freezeTable(opt->v_v);
+        } else if (opt->type == ARRAY && opt->def->dv_a.type == COMPOUND && opt->def->dv_a.a_v.a_v_t) {
+            frozen &= freezeTable(opt->def->dv_a.a_v.a_v_t);
+        }
+    }
+    return frozen;
+}
+
+bool freezeConfig(struct Option **config) {
+    if (!config) return false;
+    if (OPTION_TABLE(config)->base) return true; //An element is rebuilt on every load, its template is what to freeze
+    return freezeTable(config);
+}
+
+//A top level statement, from the start of its line to the end of its value
+typedef struct LoggedStatement {
+    Option *opt;
+    size_t start;
+    size_t end;
+} LoggedStatement;
+
+//Where the top level statements of a parse were in its buffer, see setIncrementalReload
+typedef struct StatementLog {
+    Option **options; //Statements inside the compounds of this table aren't logged
+    const char *base;
+    LoggedStatement *items;
+    size_t count;
+    size_t capacity;
+    bool failed; //Ran out of memory, the log is incomplete
+} StatementLog;
+
+//Where the diagnostics of one load go, see setDiagnosticSink
+typedef struct DiagnosticState {
+    DiagnosticSink *sink; //NULL drops them, for statements that were reported before
+    const char *file; //The positions are in if there is no map
+    const char *base; //Buffer the positions are in
+    const struct SourceMap *map; //Where each byte of base came from, NULL if it's all from file
+    size_t firstLine; //Of base in file, a push parser gets its statements a batch at a time
+    size_t passed; //Diagnostics passed on in this load
+    //Last position worked out, the next one is counted from there if it's further on in the same file
+    size_t lastPos;
+    size_t lastLine;
+    size_t lastFile;
+#ifndef _WIN32
+    pthread_mutex_t lock; //Compound array elements are parsed on several threads
+#endif
+} DiagnosticState;
+
+//The table or array being parsed, nested ones chain up to the top level. Only read to spell out a diagnostic's path
+typedef struct ParseScope {
+    const struct ParseScope *parent;
+    const char *name; //NULL for the arrays inside an array
+    size_t index; //Of an array element, SIZE_MAX otherwise
+} ParseScope;
+
+//State of one readConfig that every nested parseConfigWhole/parseArray call shares
+typedef struct ParseContext {
+    const char *file;
+    bool views; //Strings are left in the buffer as views instead of being copied (readConfigMapped)
+    Scanner *scan; //Classifies the buffer being parsed
+    unsigned threads; //Compound arrays are parsed on this many threads if it's more than 1 (setParseThreads)
+    StatementLog *log; //Gets the top level statements if it isn't NULL
+    StatsRecorder *stats; //Gets the time spent in arrays if it isn't NULL, compound array elements are parsed without
+    DiagnosticState *diag; //Gets the messages about the file, they go to stderr if it's NULL
+    const ParseScope *scope; //Of the table or array being parsed, NULL at the top level
+} ParseContext;
+
+static void logStatement(StatementLog *log, Option *opt, const char *start, const char *end) {
+    if (log->failed) return;
+    if (log->count == log->capacity) {
+        size_t capacity = log->capacity ? log->capacity * 2 : ARRAY_ALLOCATION;
+        LoggedStatement *tmp = realloc(log->items, capacity * sizeof(LoggedStatement));
+        if (!tmp) {
+            log->failed = true;
+            return;
+        }
+        log->items = tmp;
+        log->capacity = capacity;
+    }
+    log->items[log->count++] = (LoggedStatement) {opt, start - log->base, end - log->base};
+}
+
+void parseConfigWhole(Option **options, const ParseContext *ctx, char *bufferOriginal, size_t length);
+
+//Reports a problem at at, with the option name[index] in ctx->scope. nameLen -1 takes all of name
+static void diagnose(const ParseContext *ctx, DiagnosticSeverity severity, const char *at, const char *name,
+                     int nameLen, size_t index, const char *message);
+
+#define PARSE_ERROR(ctx, at, name, message) diagnose(ctx, DIAGNOSTIC_ERROR, at, name, -1, SIZE_MAX, message)
+
+static void freeArrayValue(ArrayOption *array, bool views);
+
+static void releaseValues(Option **options, bool views);
+
+static void releaseSource(OptionTable *table);
+
+static void bindValues(Option **config);
+
+static size_t bindingsMemory(const struct BindingSet *bindings);
+
+//Elements of a flat array from the commas between its brackets, so the array can be allocated once at its final size
+static size_t arrayElementCount(Scanner *scan, const char *arrayStart, const char *arrayEnd) {
+    const char *first = arrayStart + 1;
+    while (first < arrayEnd && isspace(*first)) first++;
+    if (first == arrayEnd) return 0; //[]
+    return scanCount(scan, first, arrayEnd, SCAN_COMMA) + 1;
+}
+
+#ifndef _WIN32
+
+#define PARALLEL_MIN_ELEMENTS 64 //Compound arrays with fewer elements are parsed on the calling thread alone
+#define PARALLEL_BATCH 16 //Elements a thread takes at a time, element sizes vary too much to split the array evenly
+
+//Byte range of one compound array element, from its '{' to the matching '}'
+typedef struct CompoundSpan {
+    char *start;
+    char *end;
+} CompoundSpan;
+
+typedef struct CompoundJob {
+    Option ***arr;
+    const CompoundSpan *spans;
+    size_t count;
+    Option **template;
+    ConfigArena *arena;
+    const ParseContext *ctx; //threads is 1 so nested compound arrays are parsed serially, scope is the array's
+    StatsRecorder *counters; //allocStats of the calling thread, for the workers
+    MemoryBudget *budget; //allocBudget of the calling thread, likewise
+    atomic_size_t next; //First element no thread has taken yet
+    atomic_bool failed;
+} CompoundJob;
+
+typedef struct CompoundWorker {
+    CompoundJob *job;
+    pthread_t thread;
+    ArenaRegion region;
+} CompoundWorker;
+
+static void parseCompoundSpans(CompoundJob *job, Scanner *scan) {
+    ParseContext ctx = *job->ctx;
+    ParseScope scope = *ctx.scope; //The array's, every thread sets the index of the element it's parsing
+    ctx.scan = scan;
+    ctx.scope = &scope;
+    size_t first;
+    while ((first = atomic_fetch_add(&job->next, PARALLEL_BATCH)) < job->count) {
+        size_t last = first + PARALLEL_BATCH < job->count ? first + PARALLEL_BATCH : job->count;
+        for (size_t i = first; i < last; ++i) {
+            job->arr[i] = budgetExceeded() ? NULL : optionTableOverlayIn(job->template, job->arena);
+            if (!job->arr[i]) {
+                atomic_store(&job->failed, true);
+                continue;
+            }
+            scope.index = i;
+            parseConfigWhole(job->arr[i], &ctx, job->spans[i].start + 1, job->spans[i].end - job->spans[i].start + 1);
+        }
+    }
+}
+
+static void *compoundWorkerMain(void *arg) {
+    CompoundWorker *worker = arg;
+    //The buffer is only read, but the block cache of a scanner isn't shared
+    Scanner scan;
+    scannerInit(&scan, worker->job->ctx->scan->base, worker->job->ctx->scan->length);
+    workerRegion = &worker->region;
+    allocStats = worker->job->counters;
+    budgetEnter(worker->job->budget);
+    parseCompoundSpans(worker->job, &scan);
+    workerRegion = NULL;
+    allocStats = NULL;
+    budgetEnter(NULL);
+    return NULL;
+}
+
+/*
+ * COMPOUND case of parseArray with setParseThreads: the element boundaries are found first, so the array can be
+ * allocated at its final size and every element parsed into its own slot in any order. Accepts the same input as the
+ * serial loop and stops at the same place.
+ */
+static char *parseCompoundArrayParallel(ArrayOption *array, ConfigArena *arena, const ParseContext *ctx,
+                                        const char *optName, char *arrayStart, const char *bufferEnd) {
+    Scanner *scan = ctx->scan;
+    size_t count = 0;
+    size_t spansSize = ARRAY_ALLOCATION;
+    CompoundSpan *spans = malloc(spansSize * sizeof(CompoundSpan));
+    char *currentElement = arrayStart + 1;
+    if (!spans) goto noMemory;
+    while (true) {
+        //Whichever comes first, looking for the ] on its own would scan to the end of the array for every element
+        char *compoundStart = scanFind(scan, currentElement, bufferEnd, SCAN_OPEN_BRACE | SCAN_CLOSE_BRACKET);
+        if (compoundStart == bufferEnd || *compoundStart == ']') {
+            if (compoundStart != bufferEnd) currentElement = compoundStart + 1;
+            break;
+        }
+        int openCount = 1;
+        char *compoundEnd = compoundStart;
+        while (openCount && (compoundEnd = scanFind(scan, compoundEnd + 1, bufferEnd, SCAN_BRACES)) != bufferEnd) {
+            openCount += *compoundEnd == '{' ? 1 : -1;
+        }
+        if (openCount) {
+            PARSE_ERROR(ctx, compoundStart, optName, "Compound must end with '}'");
+            free(spans);
+            return currentElement;
+        }
+        if (count == spansSize) {
+            CompoundSpan *tmp = realloc(spans, spansSize * 2 * sizeof(CompoundSpan));
+            if (!tmp) goto noMemory;
+            spans = tmp;
+            spansSize *= 2;
+        }
+        spans[count++] = (CompoundSpan) {compoundStart, compoundEnd};
+        currentElement = compoundEnd + 1;
+    }
+    Option ***arr = count ? valueAlloc(arena, count * sizeof(Option **)) : NULL;
+    if (count && !arr) goto noMemory;
+
+    ParseScope scope = {ctx->scope, optName, 0};
+    ParseContext serial = *ctx;
+    serial.threads = 1;
+    serial.stats = NULL;
+    serial.scope = &scope;
+    CompoundJob job = {.arr = arr, .spans = spans, .count = count, .template = array->a_v.a_v_t, .arena = arena,
+                       .ctx = &serial, .counters = allocStats, .budget = allocBudget};
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+
+    //The calling thread parses elements too, and no more threads are started than there are batches for
+    size_t workers = count < PARALLEL_MIN_ELEMENTS ? 0 : ctx->threads - 1;
+    if (workers > (count - 1) / PARALLEL_BATCH) workers = (count - 1) / PARALLEL_BATCH;
+    CompoundWorker *pool = workers ? calloc(workers, sizeof(CompoundWorker)) : NULL;
+    size_t started = 0;
+    for (; pool && started < workers; ++started) {
+        pool[started].job = &job;
+        if (pthread_create(&pool[started].thread, NULL, compoundWorkerMain, &pool[started])) break;
+    }
+    parseCompoundSpans(&job, scan);
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(pool[i].thread, NULL);
+        //The chunks go behind the head of the value region, which keeps serving allocations
+        ArenaChunk *chunk = pool[i].region.head;
+        if (!chunk) continue;
+        ArenaChunk *last = chunk;
+        while (last->next) last = last->next;
+        ArenaRegion *values = valueRegion(arena);
+        if (values->head) {
+            last->next = values->head->next;
+            values->head->next = chunk;
+        } else {
+            values->head = chunk;
+        }
+    }
+    free(pool);
+    free(spans);
+
+    if (atomic_load(&job.failed)) {
+        for (size_t i = 0; !arena && i < count; ++i) {
+            if (!arr[i]) continue;
+            if (ctx->views) releaseValues(arr[i], true);
+            cleanOptions(arr[i]);
+        }
+        valueFree(arena, arr);
+        return currentElement;
+    }
+    array->a_v.a_v = arr;
+    array->len = count;
+    return currentElement;
+    noMemory:
+    fprintf(stderr, "Error while allocating memory for compound array: %s\n", strerror(errno));
+    free(spans);
+    return currentElement;
+}
+
+#endif
+
+char *parseArray(ArrayOption *array, ConfigArena *arena, const ParseContext *ctx, const char *optName,
+                 const char *buffer, const char *bufferEnd) {
+    if (!array)return NULL;
+    Scanner *scan = ctx->scan;
+    char *arrayStart = scanFind(scan, buffer, bufferEnd, SCAN_OPEN_BRACKET);
+    if (arrayStart == bufferEnd) {
+        PARSE_ERROR(ctx, buffer, optName, "Array must start on the same line as the option definition with [");
+        return NULL;
+    }
+
+    switch (array->type) {
+        case BOOL: {
+            char *arrayEnd = scanFind(scan, arrayStart + 1, bufferEnd, SCAN_CLOSE_BRACKET);
+            if (arrayEnd == bufferEnd) {
+                PARSE_ERROR(ctx, arrayStart, optName, "Array must end with ]");
+                return NULL;
+            }
+
+            size_t count = arrayElementCount(scan, arrayStart, arrayEnd);
+            bool *arr = count ? valueAlloc(arena, sizeof(bool) * count) : NULL;
+            if (count && !arr) {
+                fprintf(stderr, "Error while allocating memory for bool array: %s\n", strerror(errno));
+                return arrayEnd + 1;
+            }
+            char *currentElement = arrayStart + 1;
+            for (size_t i = 0; i < count; ++i) {
+                char *nextElement = scanFind(scan, currentElement, arrayEnd, SCAN_COMMA);
+                char *valueStart;
+                trimnp(currentElement, nextElement, &valueStart);
+                arr[i] = !strncasecmp(valueStart, "true", 4) || !strncasecmp(valueStart, "yes", 3);
+                if (!arr[i] && !(!strncasecmp(valueStart, "false", 5) ||
+                                 !strncasecmp(valueStart, "no", 2))) { // If option is not true or false
+                    diagnose(ctx, DIAGNOSTIC_ERROR, valueStart, optName, -1, i,
+                             "Invalid boolean. Must be true, false, yes or no");
+                    valueFree(arena, arr);
+                    return arrayEnd + 1;
+                }
+                currentElement = nextElement + 1;
+            }
+            array->a_b = arr;
+            array->len = count;
+            return arrayEnd + 1;
+        }
+        case LONG: {
+            char *arrayEnd = scanFind(scan, arrayStart + 1, bufferEnd, SCAN_CLOSE_BRACKET);
+            if (arrayEnd == bufferEnd) {
+                PARSE_ERROR(ctx, arrayStart, optName, "Array must end with ]");
+                return NULL;
+            }
+
+            size_t count = arrayElementCount(scan, arrayStart, arrayEnd);
+            long *arr = count ? valueAlloc(arena, sizeof(long) * count) : NULL;
+            if (count && !arr) {
+                fprintf(stderr, "Error while allocating memory for long array: %s\n", strerror(errno));
+                return arrayEnd + 1;
+            }
+            char *currentElement = arrayStart + 1;
+            for (size_t i = 0; i < count; ++i) {
+                char *nextElement = scanFind(scan, currentElement, arrayEnd, SCAN_COMMA);
+                char *valueStart;
+                trimnp(currentElement, nextElement, &valueStart);
+                char *endPtr = NULL;
+                arr[i] = parseLong(valueStart, &endPtr);
+                if (endPtr == valueStart) {
+                    diagnose(ctx, DIAGNOSTIC_ERROR, valueStart, optName, -1, i, "Invalid long");
+                }
+                currentElement = nextElement + 1;
+            }
+            array->a_l = arr;
+            array->len = count;
+            return arrayEnd + 1;
+        }
+        case DOUBLE: {
+            char *arrayEnd = scanFind(scan, arrayStart + 1, bufferEnd, SCAN_CLOSE_BRACKET);
+            if (arrayEnd == bufferEnd) {
+                PARSE_ERROR(ctx, arrayStart, optName, "Array must end with ]");
+                return NULL;
+            }
+
+            size_t count = arrayElementCount(scan, arrayStart, arrayEnd);
+            double *arr = count ? valueAlloc(arena, sizeof(double) * count) : NULL;
+            if (count && !arr) {
+                fprintf(stderr, "Error while allocating memory for double array: %s\n", strerror(errno));
+                return arrayEnd + 1;
+            }
+            char *currentElement = arrayStart + 1;
+            for (size_t i = 0; i < count; ++i) {
+                char *nextElement = scanFind(scan, currentElement, arrayEnd, SCAN_COMMA);
+                char *valueStart;
+                trimnp(currentElement, nextElement, &valueStart);
+                char *endPtr = NULL;
+                arr[i] = parseDouble(valueStart, &endPtr);
+                if (endPtr == valueStart) {
+                    diagnose(ctx, DIAGNOSTIC_ERROR, valueStart, optName, -1, i, "Invalid double");
+                }
+                currentElement = nextElement + 1;
+            }
+            array->a_d = arr;
+            array->len = count;
+            return arrayEnd + 1;
+        }
+        case TEXT: {
+            //Elements are either copied strings (char *) or views into the buffer (StringView)
+            size_t elementSize = ctx->views ? sizeof(StringView) : sizeof(char *);
+            char *arr = valueAlloc(arena, elementSize * ARRAY_ALLOCATION);
+            size_t i = 0;
+            size_t arraySize = ARRAY_ALLOCATION;
+            char *afterString = arrayStart + 1; //The closing ] is looked for past the last string, strings may hold one
+            char *currentElement = arrayStart + 1;
+            //First ] past the last string. Only looked for again once a string ends past it, rescanning the rest of the
+            //array for every string would make long string arrays quadratic
+            char *possibleArrayEnd = arrayStart;
+            if (!arr) {
+                fprintf(stderr, "Error while allocating memory for string array: %s\n", strerror(errno));
+                goto clean_s;
+            }
+            do {
+                if (arraySize - 2 == i) {
+                    char *tmp = valueRealloc(arena, arr, arraySize * elementSize, arraySize * 2 * elementSize);
+                    if (!tmp) {
+                        fprintf(stderr, "Error while reallocating memory for string array: %s\n", strerror(errno));
+                        goto clean_s;
+                    }
+                    arr = tmp;
+                    arraySize *= 2;
+                }
+
+                char *stringStart = scanFind(scan, currentElement, bufferEnd, SCAN_QUOTES);
+                if (possibleArrayEnd < afterString) {
+                    possibleArrayEnd = scanFind(scan, afterString, bufferEnd, SCAN_CLOSE_BRACKET);
+                }
+                if (possibleArrayEnd == bufferEnd) {
+                    PARSE_ERROR(ctx, arrayStart, optName, "Array must end with ]");
+                    goto clean_s;
+                }
+                if (possibleArrayEnd < stringStart) break;
+                bool single = *stringStart == '\'';
+                stringStart += 1 + (*(stringStart + 1) == '\n');
+
+                char *multiLineEnd = single ? scanFind(scan, stringStart, bufferEnd, SCAN_SQUOTE)
+                                            : scanFind(scan, stringStart, bufferEnd, SCAN_DQUOTE);
+                if (multiLineEnd == bufferEnd) {
+                    PARSE_ERROR(ctx, stringStart, optName, "String must end with ' or \"");
+                    break;
+                }
+
+                afterString = multiLineEnd + 1;
+                if (*(multiLineEnd - 1) == '\n') multiLineEnd--;
+
+                if (ctx->views) {
+                    ((StringView *) arr)[i] = (StringView) {stringStart, multiLineEnd - stringStart};
+                } else {
+                    ((char **) arr)[i] = valueStrndup(arena, stringStart, multiLineEnd - stringStart);
+                }
+
+                i++;
+                char *comma = scanFind(scan, multiLineEnd, bufferEnd, SCAN_COMMA);
+                if (comma == bufferEnd) break; //Last element of the last statement in the buffer
+                currentElement = comma + 1;
+            } while (true);
+
+            if (i == 0) { //[], shrinking to nothing would free the array
+                valueFree(arena, arr);
+                arr = NULL;
+            } else if (i != arraySize) {
+                char *tmp = valueRealloc(arena, arr, arraySize * elementSize, i * elementSize);
+                if (!tmp) {
+                    fprintf(stderr, "Error while reallocating memory for string array: %s\n", strerror(errno));
+                    goto clean_s;
+                }
+                arr = tmp;
+            }
+            array->a_s = (char **) arr; //a_sv shares the pointer
+            array->len = i;
+            goto end_s;
+            clean_s:
+            for (size_t j = 0; !ctx->views && !arena && j < i; ++j) free(((char **) arr)[j]);
+            valueFree(arena, arr);
+            end_s: {
+                char *arrayEnd = scanFind(scan, afterString, bufferEnd, SCAN_CLOSE_BRACKET);
+                return arrayEnd == bufferEnd ? afterString : arrayEnd + 1;
+            }
+        }
+        case COMPOUND: {
+#ifndef _WIN32
+            if (ctx->threads > 1) return parseCompoundArrayParallel(array, arena, ctx, optName, arrayStart, bufferEnd);
+#endif
+            //Arrays inside the elements are timed as part of this one
+            ParseScope scope = {ctx->scope, optName, 0};
+            ParseContext element = *ctx;
+            element.stats = NULL;
+            element.scope = &scope;
+            Option ***arr = valueAlloc(arena, sizeof(Option **) * ARRAY_ALLOCATION);
+            size_t i = 0;
+            size_t arraySize = ARRAY_ALLOCATION;
+            char *currentElement = arrayStart + 1;
+            if (!arr) {
+                fprintf(stderr, "Error while allocating memory for compound array: %s\n", strerror(errno));
+                return currentElement;
+            }
+            do {
+                if (arraySize - 2 == i) {
+                    Option ***tmp = valueRealloc(arena, arr, arraySize * sizeof(Option **),
+                                                arraySize * 2 * sizeof(Option **));
+                    if (!tmp) {
+                        fprintf(stderr, "Error while reallocating memory for compound array: %s\n",
+                                strerror(errno));
+                        goto clean_c;
+                    }
+                    arr = tmp;
+                    arraySize *= 2;
+                }
+
+                //Whichever comes first, looking for the ] on its own would scan to the end of the array for every
+                //element
+                char *compoundStart = scanFind(scan, currentElement, bufferEnd, SCAN_OPEN_BRACE | SCAN_CLOSE_BRACKET);
+                if (compoundStart == bufferEnd || *compoundStart == ']') {
+                    if (compoundStart != bufferEnd) currentElement = compoundStart + 1;
+                    break;
+                }
+                int openCount = 1;
+                char *compoundEnd = compoundStart;
+                while (openCount &&
+                       (compoundEnd = scanFind(scan, compoundEnd + 1, bufferEnd, SCAN_BRACES)) != bufferEnd) {
+                    openCount += *compoundEnd == '{' ? 1 : -1;
+                }
+                if (openCount) {
+                    PARSE_ERROR(ctx, compoundStart, optName, "Compound must end with '}'");
+                    goto clean_c;
+                }
+
+                //Every element starts out empty, sharing the template's options until its own values are parsed
+                arr[i] = optionTableOverlayIn(array->a_v.a_v_t, arena);
+                if (!arr[i]) goto clean_c;
+                scope.index = i;
+                parseConfigWhole(arr[i], &element, compoundStart + 1, compoundEnd - compoundStart + 1);
+
+                i++;
+                currentElement = compoundEnd + 1;
+            } while (true);
+
+            if (i == 0) { //[], shrinking to nothing would free the array
+                valueFree(arena, arr);
+                arr = NULL;
+            } else if (i != arraySize) {
+                Option ***tmp = valueRealloc(arena, arr, arraySize * sizeof(Option **), i * sizeof(Option **));
+                if (!tmp) {
+                    fprintf(stderr, "Error while reallocating memory for compound array: %s\n", strerror(errno));
+                    goto clean_c;
+                }
+                arr = tmp;
+            }
+            array->a_v.a_v = arr;
+            array->len = i;
+            return currentElement;
+            clean_c:
+            for (size_t j = 0; !arena && j < i; ++j) {
+                if (ctx->views) releaseValues(arr[j], true);
+                cleanOptions(arr[j]);
+            }
+            valueFree(arena, arr);
+            return currentElement;
+        }
+        case ARRAY: {
+            const char *b = scanFind(scan, arrayStart + 1, bufferEnd, SCAN_OPEN_BRACKET);
+            char *emptyEnd = scanFind(scan, arrayStart + 1, bufferEnd, SCAN_CLOSE_BRACKET);
+            if (emptyEnd < b) { //[], the next [ belongs to something else
+                array->a_a.a_a = NULL;
+                array->len = 0;
+                return emptyEnd + 1;
+            }
+            ArrayOption *arr = valueAlloc(arena, ARRAY_ALLOCATION * sizeof(ArrayOption));
+            size_t arrlen = ARRAY_ALLOCATION;
+            size_t i = 0;
+            ParseScope scope = {ctx->scope, optName, 0};
+            ParseContext inner = *ctx;
+            inner.scope = &scope;
+            if (!arr) {
+                fprintf(stderr, "Error while allocating memory for array array: %s\n", strerror(errno));
+                return NULL;
+            }
+            while (b < bufferEnd) {
+                if (i == arrlen) {
+                    ArrayOption *tmp = valueRealloc(arena, arr, arrlen * sizeof(ArrayOption),
+                                                    arrlen * 2 * sizeof(ArrayOption));
+                    if (!tmp) {
+                        fprintf(stderr, "Error while reallocating memory for array array: %s\n", strerror(errno));
+                        goto clean_a;
+                    }
+                    arrlen *= 2;
+                    arr = tmp;
+                }
+                //Inner arrays start out as the template, which holds the templates of nested compounds and arrays
+                arr[i] = *array->a_a.t;
+                arr[i].a_l = NULL;
+                arr[i].len = 0;
+                scope.index = i;
+                b = parseArray(&(arr[i]), arena, &inner, NULL, b, bufferEnd);
+                if (!b) goto clean_a;
+                char *next = scanFind(scan, b, bufferEnd, SCAN_OPEN_BRACKET);
+                char *possibleEnd = scanFind(scan, b, bufferEnd, SCAN_CLOSE_BRACKET);
+                if (possibleEnd < next) { //end of array reached
+                    if (i + 1 != arrlen) {
+                        ArrayOption *tmp = valueRealloc(arena, arr, arrlen * sizeof(ArrayOption),
+                                                        (i + 1) * sizeof(ArrayOption));
+                        if (!tmp) {
+                            fprintf(stderr, "Error while reallocating memory for array array: %s\n", strerror(errno));
+                            i++;
+                            goto clean_a;
+                        }
+                        arr = tmp;
+                    }
+                    array->a_a.a_a = arr;
+                    array->len = i + 1;
+                    return possibleEnd + 1;
+                }
+                b = next;
+                i++;
+            }
+            PARSE_ERROR(ctx, arrayStart, optName,
+                        "Array in array must start on the same line as the option definition with [");
+            clean_a:
+            for (size_t j = 0; !arena && j < i; ++j) freeArrayValue(&arr[j], ctx->views);
+            valueFree(arena, arr);
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+void parseConfigWhole(Option **options, const ParseContext *ctx, char *bufferOriginal, size_t length) {
+    ConfigArena *arena = OPTION_TABLE(options)->arena;
+    Scanner *scan = ctx->scan;
+    char *buffer = bufferOriginal;
+    char *bufferEnd = bufferOriginal + length;
+    char *lineEnd;
+
+    while (buffer < bufferEnd) {
+        if (budgetExceeded()) return; //Went over setMemoryLimit, the load is undone
+        //memchr is vectorized by the C library and lines are short, so the line itself is walked directly
+        lineEnd = memchr(buffer, '\n', bufferEnd - buffer);
+        if (!lineEnd) lineEnd = bufferEnd;
+        char *assignIndex = lineEnd, *endValueIndex = lineEnd;
+        for (char *i = buffer; i < lineEnd; ++i) {
+            if (*i == '=' && assignIndex == lineEnd) {
+                assignIndex = i;
+            }
+            if (*i == '/' && *(i + 1) == '/') {
+                endValueIndex = i;
+                break;
+            }
+        }
+
+        char *lineBufTrim = NULL;
+        trimnp(buffer, lineEnd, &lineBufTrim);
+        if (assignIndex >= endValueIndex) { // No '=', or a '//' occurs before it
+            buffer = lineEnd + 1;
+            continue;
+        }
+
+        //The name is looked up where it is in the buffer, messages use the option's own copy of it
+        char *nameEnd = assignIndex;
+        while (nameEnd > lineBufTrim && isspace(*(nameEnd - 1))) nameEnd--;
+
+        struct Option *optOut = optionTableFindWritable(options, lineBufTrim, nameEnd - lineBufTrim);
+        if (!optOut) {
+            diagnose(ctx, DIAGNOSTIC_WARNING, lineBufTrim, lineBufTrim, (int) (nameEnd - lineBufTrim), SIZE_MAX,
+                     "Unrecognized option");
+            goto loopEnd;
+        }
+        const char *optName = optOut->name;
 
         switch (optOut->type) {
             case TEXT: {
-                if (optOut->v_s != optOut->dv_s && optOut->v_s) free(optOut->v_s);
-
-                char *doubleStart = strchr(assignIndex + 1, '"');
-                char *singleStart = strchr(assignIndex + 1, '\'');
-                bool single = (singleStart < doubleStart && singleStart) || (singleStart && !doubleStart);
-                if ((!single && !doubleStart) || (single ? singleStart > endValueIndex : doubleStart > endValueIndex)) {
-                    fprintf(stderr,
-                            "Error at option %s:%s: String must start on the same line as the option definition with ' or \"\n",
-                            file, optName);
+                char *stringStart = scanFind(scan, assignIndex + 1, endValueIndex, SCAN_QUOTES);
+                if (stringStart == endValueIndex) {
+                    PARSE_ERROR(ctx, assignIndex, optName,
+                                "String must start on the same line as the option definition with ' or \"");
+                    break;
+                }
+                bool single = *stringStart == '\'';
+                stringStart += 1 + (*(stringStart + 1) == '\n');
+
+                char *multiLineEnd = single ? scanFind(scan, stringStart, bufferEnd, SCAN_SQUOTE)
+                                            : scanFind(scan, stringStart, bufferEnd, SCAN_DQUOTE);
+                if (multiLineEnd == bufferEnd) {
+                    PARSE_ERROR(ctx, stringStart, optName, "String must end with ' or \"");
+                    break;
+                }
+
+                lineEnd = scanFind(scan, multiLineEnd, bufferEnd, SCAN_NEWLINE);
+                if (*(multiLineEnd - 1) == '\n') multiLineEnd--;
+
+                if (ctx->views) {
+                    optOut->v_sv = (StringView) {stringStart, multiLineEnd - stringStart};
+                } else {
+                    if (optOut->v_s != optOut->def->dv_s && optOut->v_s) valueFree(arena, optOut->v_s);
+                    optOut->v_s = valueStrndup(arena, stringStart, multiLineEnd - stringStart);
+                    optOut->v_sv.len = multiLineEnd - stringStart;
+                }
+                break;
+            }
+            case LONG: {
+                char *endPtr = NULL;
+                char *start = NULL;
+                trimnp(assignIndex + 1, endValueIndex, &start);
+                long tempL = parseLong(start, &endPtr);
+                if (endPtr == start) {
+                    //error
+                    PARSE_ERROR(ctx, start, optName, "Invalid long");
+                    optOut->v_l = optOut->def->dv_l;
+                } else {
+                    optOut->v_l = tempL;
+                }
+                break;
+            }
+            case DOUBLE: {
+                char *endPtr = NULL;
+                char *start = NULL;
+                trimnp(assignIndex + 1, endValueIndex, &start);
+                double tempD = parseDouble(start, &endPtr);
+                if (endPtr == start) {
+                    //error
+                    PARSE_ERROR(ctx, start, optName, "Invalid double");
+                    optOut->v_d = optOut->def->dv_d;
+                } else {
+                    optOut->v_d = tempD;
+                }
+                break;
+            }
+            case BOOL: {
+                char *start = NULL;
+                trimnp(assignIndex + 1, endValueIndex, &start);
+                if (!strncasecmp(start, "true", 4) || !strncasecmp(start, "yes", 3)) {
+                    optOut->v_b = true;
+                    break;
+                } else if (!(!strncasecmp(start, "false", 5) || !strncasecmp(start, "no", 2))) {
+                    PARSE_ERROR(ctx, start, optName, "Invalid boolean. Must be true, false, yes or no");
+                    optOut->v_b = optOut->def->dv_b;
+                    break;
+                }
+                optOut->v_b = false;
+                break;
+            }
+            case COMPOUND: {
+                char *compoundStart = scanFind(scan, assignIndex + 1, endValueIndex, SCAN_OPEN_BRACE);
+                if (compoundStart == endValueIndex) {
+                    PARSE_ERROR(ctx, assignIndex, optName, "Compound must start with '{'");
+                    return;
+                }
+                int openCount = 1;
+                char *compoundEnd = compoundStart;
+                while (openCount &&
+                       (compoundEnd = scanFind(scan, compoundEnd + 1, bufferEnd, SCAN_BRACES)) != bufferEnd) {
+                    openCount += *compoundEnd == '{' ? 1 : -1;
+                }
+                if (openCount) {
+                    PARSE_ERROR(ctx, compoundStart, optName, "Compound must end with '}'");
+                    return;
+                }
+
+                ParseScope scope = {ctx->scope, optName, SIZE_MAX};
+                ParseContext inner = *ctx;
+                inner.scope = &scope;
+                parseConfigWhole(optOut->v_v, &inner, compoundStart + 1, compoundEnd - compoundStart + 1);
+                lineEnd = scanFind(scan, compoundEnd, bufferEnd, SCAN_NEWLINE);
+                break;
+            }
+            case ARRAY: {
+                ArrayOption previous = optOut->v_a;
+                uint64_t arrayStart = statsClock(ctx->stats);
+                char *arrayEnd = parseArray(&(optOut->v_a), arena, ctx, optName, assignIndex,
+                                            bufferOriginal + length);
+                if (ctx->stats) ctx->stats->arrayNs += statsClock(ctx->stats) - arrayStart;
+                //a_l aliases the data pointer of every array type
+                if (previous.a_l != optOut->v_a.a_l && previous.a_l != optOut->def->dv_a.a_l && !arena) {
+                    freeArrayValue(&previous, ctx->views);
+                }
+                if (!arrayEnd)break;
+                lineEnd = arrayEnd;
+                break;
+            }
+        }
+        if (ctx->log && options == ctx->log->options) {
+            logStatement(ctx->log, optOut, buffer, lineEnd < bufferEnd ? lineEnd + 1 : bufferEnd);
+        }
+
+
+        loopEnd:
+        buffer = lineEnd + 1;
+    }
+}
+
+static void diagnoseFile(DiagnosticState *state, const char *file, const char *message);
+
+//readFile, reporting to diag instead of stderr if it isn't NULL
+static size_t readFileIn(const char *filename, char **bufferOut, DiagnosticState *diag) {
+    size_t length;
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        if (diag) diagnoseFile(diag, filename, "Can't open file");
+        else fprintf(stderr, "Error: Can't open file '%s': '%s'\n", filename, strerror(errno));
+        return 0;
+    }
+
+    length = getFileSize(filename);
+    if (length == 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    (*bufferOut) = budgetTake(length + 2) ? malloc(length + 2) : NULL;
+    STATS_COUNT(mallocs, 1);
+    if (!(*bufferOut)) {
+        if (!budgetExceeded()) { //Going over the memory limit is reported once, by the load
+            if (diag) diagnoseFile(diag, filename, "Can't allocate memory for reading file");
+            else fprintf(stderr, "Error: Can't allocate memory for reading file '%s': '%s'\n", filename,
+                         strerror(errno));
+        }
+        fclose(fp);
+        free((*bufferOut));
+        return 0;
+    }
+    if (!fread((*bufferOut), 1, length, fp)) {
+        if (diag) diagnoseFile(diag, filename, "Can't read file");
+        else fprintf(stderr, "Error: Can't read file '%s': '%s'\n", filename, strerror(errno));
+        fclose(fp);
+        free((*bufferOut));
+        return 0;
+    }
+    fclose(fp);
+
+    if ((*bufferOut)[length - 1] != '\n') { //Ensure that string ends in new line (makes things nicer)
+        length++;
+        (*bufferOut)[length - 1] = '\n';
+    }
+    (*bufferOut)[length] = '\0'; //Must be null terminated
+    return length;
+}
+
+size_t readFile(const char *filename, char **bufferOut) {
+    return readFileIn(filename, bufferOut, NULL);
+}
+
+//include cache
+
+//What a file looked like when it was read, a cached file is reused as long as none of its dependencies changed
+typedef struct FileStamp {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtimeNs;
+    bool exists; //Missing directories of #include patterns are dependencies too, they might show up
+    bool regular;
+} FileStamp;
+
+typedef struct IncludeDep {
+    char *path;
+    FileStamp stamp;
+} IncludeDep;
+
+//Everything a preprocessed file was built from: itself, the files it included and the directories they were found in
+typedef struct IncludeDeps {
+    IncludeDep *items;
+    size_t count;
+    size_t capacity;
+    bool uncacheable; //A pattern had wildcards in its directory, which a single directory stamp can't cover
+} IncludeDeps;
+
+//Entries are never modified once they are in the cache, a reload that finds one stale replaces it instead
+typedef struct IncludeEntry {
+    struct IncludeEntry *next; //Next entry in the same bucket
+    uint32_t hash;
+    char *path;
+    char *content;
+    size_t len;
+    IncludeDeps deps;
+    atomic_size_t refs; //The cache holds one, every preprocessor using the content another
+} IncludeEntry;
+
+struct IncludeCache {
+#ifndef _WIN32
+    pthread_mutex_t lock; //Buckets and sizes, lookups happen on the threads of readIncludeFiles
+#endif
+    IncludeEntry **buckets;
+    size_t capacity; //Always a power of two
+    size_t count;
+    size_t bytes;
+    atomic_size_t hits;
+    atomic_size_t misses;
+};
+
+#ifndef _WIN32
+#define CACHE_LOCK(cache) pthread_mutex_lock(&(cache)->lock)
+#define CACHE_UNLOCK(cache) pthread_mutex_unlock(&(cache)->lock)
+#else
+#define CACHE_LOCK(cache)
+#define CACHE_UNLOCK(cache)
+#endif
+
+static bool fileStamp(const char *path, FileStamp *out) {
+    struct stat st;
+    memset(out, 0, sizeof(FileStamp));
+    if (stat(path, &st)) return false;
+    out->dev = st.st_dev;
+    out->ino = st.st_ino;
+    out->size = st.st_size;
+#ifndef _WIN32
+    out->mtimeNs = (uint64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    out->mtimeNs = (uint64_t) st.st_mtime * 1000000000;
+#endif
+    out->exists = true;
+    out->regular = S_ISREG(st.st_mode);
+    return true;
+}
+
+static bool stampEqual(const FileStamp *a, const FileStamp *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->size == b->size && a->mtimeNs == b->mtimeNs &&
+           a->exists == b->exists && a->regular == b->regular;
+}
+
+static void depsAdd(IncludeDeps *deps, const char *path, const FileStamp *stamp) {
+    if (deps->count == deps->capacity) {
+        size_t capacity = deps->capacity ? deps->capacity * 2 : 4;
+        IncludeDep *tmp = realloc(deps->items, capacity * sizeof(IncludeDep));
+        if (!tmp) {
+            deps->uncacheable = true;
+            return;
+        }
+        deps->items = tmp;
+        deps->capacity = capacity;
+    }
+    deps->items[deps->count].path = strdup(path);
+    deps->items[deps->count].stamp = *stamp;
+    if (deps->items[deps->count].path) deps->count++;
+    else deps->uncacheable = true;
+}
+
+static void depsMerge(IncludeDeps *deps, const IncludeDeps *from) {
+    for (size_t i = 0; i < from->count; ++i) depsAdd(deps, from->items[i].path, &from->items[i].stamp);
+    if (from->uncacheable) deps->uncacheable = true;
+}
+
+static void depsFree(IncludeDeps *deps) {
+    for (size_t i = 0; i < deps->count; ++i) free(deps->items[i].path);
+    free(deps->items);
+    memset(deps, 0, sizeof(IncludeDeps));
+}
+
+//Whether the dependencies from first on still look like they did when they were read
+static bool depsUnchanged(const IncludeDeps *deps, size_t first) {
+    for (size_t i = first; i < deps->count; ++i) {
+        FileStamp now;
+        fileStamp(deps->items[i].path, &now);
+        if (!stampEqual(&deps->items[i].stamp, &now)) return false;
+    }
+    return true;
+}
+
+//The first dependency is the file itself, its stamp was just taken by the caller
+static bool depsCurrent(const IncludeDeps *deps, const FileStamp *self) {
+    if (deps->count == 0 || !stampEqual(&deps->items[0].stamp, self)) return false;
+    return depsUnchanged(deps, 1);
+}
+
+static void includeEntryRelease(IncludeEntry *entry) {
+    if (!entry || atomic_fetch_sub(&entry->refs, 1) != 1) return;
+    free(entry->path);
+    free(entry->content);
+    depsFree(&entry->deps);
+    free(entry);
+}
+
+IncludeCache *includeCacheCreate(void) {
+    IncludeCache *cache = calloc(1, sizeof(IncludeCache));
+    if (cache) cache->buckets = calloc(OPTION_TABLE_INITIAL_SIZE, sizeof(IncludeEntry *));
+    if (!cache || !cache->buckets) {
+        fprintf(stderr, "Error: Can't allocate memory for include cache: %s\n", strerror(errno));
+        free(cache);
+        return NULL;
+    }
+    cache->capacity = OPTION_TABLE_INITIAL_SIZE;
+#ifndef _WIN32
+    pthread_mutex_init(&cache->lock, NULL);
+#endif
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    return cache;
+}
+
+void includeCacheFree(IncludeCache *cache) {
+    if (!cache) return;
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        IncludeEntry *entry = cache->buckets[i];
+        while (entry) {
+            IncludeEntry *next = entry->next;
+            includeEntryRelease(entry);
+            entry = next;
+        }
+    }
+#ifndef _WIN32
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache->buckets);
+    free(cache);
+}
+
+IncludeCacheStats includeCacheStats(IncludeCache *cache) {
+    IncludeCacheStats stats = {0};
+    if (!cache) return stats;
+    CACHE_LOCK(cache);
+    stats.entries = cache->count;
+    stats.bytes = cache->bytes;
+    CACHE_UNLOCK(cache);
+    stats.hits = atomic_load(&cache->hits);
+    stats.misses = atomic_load(&cache->misses);
+    return stats;
+}
+
+void setIncludeCache(struct Option **config, IncludeCache *cache) {
+    RootSettings *settings = config ? settingsFor(OPTION_TABLE(config)) : NULL;
+    if (settings) settings->includeCache = cache;
+}
+
+//Must be called with the lock held
+static IncludeEntry *includeCacheFind(IncludeCache *cache, const char *path, uint32_t hash) {
+    for (IncludeEntry *entry = cache->buckets[hash & (cache->capacity - 1)]; entry; entry = entry->next) {
+        if (entry->hash == hash && !strcmp(entry->path, path)) return entry;
+    }
+    return NULL;
+}
+
+//Puts entry into the cache in place of any older entry of the same path
+static void includeCachePut(IncludeCache *cache, IncludeEntry *entry) {
+    CACHE_LOCK(cache);
+    IncludeEntry **slot = &cache->buckets[entry->hash & (cache->capacity - 1)];
+    for (; *slot; slot = &(*slot)->next) {
+        IncludeEntry *old = *slot;
+        if (old->hash != entry->hash || strcmp(old->path, entry->path) != 0) continue;
+        *slot = old->next;
+        cache->count--;
+        cache->bytes -= old->len;
+        includeEntryRelease(old);
+        break;
+    }
+    if (cache->count == cache->capacity) { //Keeps chains short, buckets are only ever doubled
+        IncludeEntry **buckets = calloc(cache->capacity * 2, sizeof(IncludeEntry *));
+        if (buckets) {
+            for (size_t i = 0; i < cache->capacity; ++i) {
+                IncludeEntry *e = cache->buckets[i];
+                while (e) {
+                    IncludeEntry *next = e->next;
+                    e->next = buckets[e->hash & (cache->capacity * 2 - 1)];
+                    buckets[e->hash & (cache->capacity * 2 - 1)] = e;
+                    e = next;
+                }
+            }
+            free(cache->buckets);
+            cache->buckets = buckets;
+            cache->capacity *= 2;
+        }
+    }
+    slot = &cache->buckets[entry->hash & (cache->capacity - 1)];
+    entry->next = *slot;
+    *slot = entry;
+    cache->count++;
+    cache->bytes += entry->len;
+    CACHE_UNLOCK(cache);
+}
+
+//preprocessor
+
+//A file a SourceMap has spans of
+typedef struct SourceFile {
+    char *path;
+    bool leaf; //No #include lines, so its one span is the whole file
+} SourceFile;
+
+//A run of preprocessed output copied unchanged from one file
+typedef struct SourceSpan {
+    size_t out; //Where the run starts in the output
+    size_t len;
+    size_t file; //Index into SourceMap.files
+    size_t offset; //Where the run starts in its file
+} SourceSpan;
+
+//An #include pattern and the files it matched, in glob order
+typedef struct SourcePattern {
+    char *pattern;
+    char *dir; //Directory it's matched in, as in the include dependencies
+    char **matches;
+    size_t count;
+} SourcePattern;
+
+//Where each byte of a preprocessed buffer came from, see setIncrementalReload
+typedef struct SourceMap {
+    SourceFile *files;
+    size_t fileCount;
+    size_t fileCapacity;
+    SourceSpan *spans;
+    size_t spanCount;
+    size_t spanCapacity;
+    SourcePattern *patterns;
+    size_t patternCount;
+    size_t patternCapacity;
+    bool failed; //Ran out of memory, the map is incomplete
+} SourceMap;
+
+//Makes room for one more item, or marks the map as failed
+static bool mapReserve(SourceMap *map, void **items, size_t count, size_t *capacity, size_t itemSize) {
+    if (map->failed) return false;
+    if (count < *capacity) return true;
+    size_t size = *capacity ? *capacity * 2 : ARRAY_ALLOCATION;
+    void *tmp = realloc(*items, size * itemSize);
+    if (!tmp) {
+        map->failed = true;
+        return false;
+    }
+    *items = tmp;
+    *capacity = size;
+    return true;
+}
+
+static void mapAddFile(SourceMap *map, const char *path, bool leaf) {
+    char *copy = strdup(path);
+    if (!copy || !mapReserve(map, (void **) &map->files, map->fileCount, &map->fileCapacity, sizeof(SourceFile))) {
+        map->failed = true;
+        free(copy);
+        return;
+    }
+    map->files[map->fileCount++] = (SourceFile) {copy, leaf};
+}
+
+static void mapAddSpan(SourceMap *map, size_t out, size_t len, size_t file, size_t offset) {
+    if (!len || !mapReserve(map, (void **) &map->spans, map->spanCount, &map->spanCapacity, sizeof(SourceSpan))) {
+        return;
+    }
+    map->spans[map->spanCount++] = (SourceSpan) {out, len, file, offset};
+}
+
+static void mapAddPattern(SourceMap *map, const char *pattern, const char *dir, char **matches, size_t count) {
+    if (!mapReserve(map, (void **) &map->patterns, map->patternCount, &map->patternCapacity, sizeof(SourcePattern))) {
+        return;
+    }
+    SourcePattern *added = &map->patterns[map->patternCount];
+    added->pattern = strdup(pattern);
+    added->dir = strdup(dir);
+    added->matches = count ? malloc(count * sizeof(char *)) : NULL;
+    added->count = 0;
+    map->patternCount++;
+    if (!added->pattern || !added->dir || (count && !added->matches)) {
+        map->failed = true;
+        return;
+    }
+    for (; added->count < count; ++added->count) {
+        if (!(added->matches[added->count] = strdup(matches[added->count]))) {
+            map->failed = true;
+            return;
+        }
+    }
+}
+
+//Appends the map of an included file whose output starts at out
+static void mapAppend(SourceMap *map, const SourceMap *from, size_t out) {
+    if (from->failed) map->failed = true;
+    size_t firstFile = map->fileCount;
+    for (size_t i = 0; i < from->fileCount; ++i) mapAddFile(map, from->files[i].path, from->files[i].leaf);
+    for (size_t i = 0; i < from->spanCount; ++i) {
+        const SourceSpan *span = &from->spans[i];
+        mapAddSpan(map, out + span->out, span->len, firstFile + span->file, span->offset);
+    }
+    for (size_t i = 0; i < from->patternCount; ++i) {
+        const SourcePattern *pattern = &from->patterns[i];
+        mapAddPattern(map, pattern->pattern, pattern->dir, pattern->matches, pattern->count);
+    }
+}
+
+static void mapFree(SourceMap *map) {
+    for (size_t i = 0; i < map->fileCount; ++i) free(map->files[i].path);
+    for (size_t i = 0; i < map->patternCount; ++i) {
+        for (size_t j = 0; j < map->patterns[i].count; ++j) free(map->patterns[i].matches[j]);
+        free(map->patterns[i].matches);
+        free(map->patterns[i].pattern);
+        free(map->patterns[i].dir);
+    }
+    free(map->files);
+    free(map->spans);
+    free(map->patterns);
+    memset(map, 0, sizeof(SourceMap));
+}
+
+static size_t mapMemory(const SourceMap *map) {
+    size_t bytes = map->fileCapacity * sizeof(SourceFile) + map->spanCapacity * sizeof(SourceSpan) +
+                   map->patternCapacity * sizeof(SourcePattern);
+    for (size_t i = 0; i < map->fileCount; ++i) bytes += strlen(map->files[i].path) + 1;
+    for (size_t i = 0; i < map->patternCount; ++i) {
+        const SourcePattern *pattern = &map->patterns[i];
+        bytes += pattern->count * sizeof(char *);
+        if (pattern->pattern) bytes += strlen(pattern->pattern) + 1;
+        if (pattern->dir) bytes += strlen(pattern->dir) + 1;
+        for (size_t j = 0; j < pattern->count; ++j) bytes += strlen(pattern->matches[j]) + 1;
+    }
+    return bytes;
+}
+
+//diagnostics
+
+#define DIAGNOSTIC_PATH_MAX 512 //Longer option paths are cut off
+
+static size_t countLines(const char *from, const char *to) {
+    size_t lines = 0;
+    while (from < to && (from = memchr(from, '\n', to - from))) {
+        lines++;
+        from++;
+    }
+    return lines;
+}
+
+//Last span that starts at or before pos, spans are in output order
+static size_t mapSpanAt(const SourceMap *map, size_t pos) {
+    size_t low = 0, high = map->spanCount;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (map->spans[mid].out <= pos) low = mid;
+        else high = mid;
+    }
+    return low;
+}
+
+/*
+ * File, line and column of at. Lines are counted from the last position worked out if at is further on in the same
+ * file, so a file with many diagnostics is still only counted through once. With a map only the spans of at's own
+ * file are counted; the #include lines left out between them never hold the new line they end with
+ */
+static void diagnosticPosition(DiagnosticState *state, const char *at, Diagnostic *out) {
+    const SourceMap *map = state->map;
+    size_t pos = at - state->base;
+    size_t span = map ? mapSpanAt(map, pos) : 0;
+    size_t file = map ? map->spans[span].file : 0;
+    if (file != state->lastFile || pos < state->lastPos) {
+        state->lastFile = file;
+        state->lastPos = 0;
+        state->lastLine = file ? 1 : state->firstLine;
+    }
+    if (!map) {
+        state->lastLine += countLines(state->base + state->lastPos, at);
+    } else {
+        for (size_t s = mapSpanAt(map, state->lastPos); s <= span; ++s) {
+            const SourceSpan *run = &map->spans[s];
+            size_t from = run->out > state->lastPos ? run->out : state->lastPos;
+            size_t to = run->out + run->len < pos ? run->out + run->len : pos;
+            if (run->file == file && from < to) state->lastLine += countLines(state->base + from, state->base + to);
+        }
+    }
+    state->lastPos = pos;
+
+    const char *lineStart = state->base + (map ? map->spans[span].out : 0);
+    const char *newLine = at > lineStart ? strrchr_(at - 1, at - lineStart, '\n') : NULL;
+    out->file = map ? map->files[file].path : state->file;
+    out->line = state->lastLine;
+    out->column = at - (newLine ? newLine + 1 : lineStart) + 1;
+}
+
+//Appends name[index] to the path of length len in out, which has room for size bytes. Returns the new length
+static size_t pathAppend(char *out, size_t len, size_t size, const char *name, int nameLen, size_t index) {
+    int n = name ? snprintf(out + len, size - len, "%s%.*s", len ? "." : "", nameLen, name) : 0;
+    len = n < 0 || len + n >= size ? size - 1 : len + n;
+    if (index == SIZE_MAX) return len;
+    n = snprintf(out + len, size - len, "[%zu]", index);
+    return n < 0 || len + n >= size ? size - 1 : len + n;
+}
+
+static size_t scopePath(const ParseScope *scope, char *out, size_t size) {
+    if (!scope) return 0;
+    size_t len = scopePath(scope->parent, out, size);
+    return pathAppend(out, len, size, scope->name, -1, scope->index);
+}
+
+static void diagnosticAppend(DiagnosticSink *sink, const Diagnostic *diagnostic) {
+    if (sink->count == sink->capacity) {
+        size_t capacity = sink->capacity ? sink->capacity * 2 : ARRAY_ALLOCATION;
+        Diagnostic *tmp = realloc(sink->items, capacity * sizeof(Diagnostic));
+        if (!tmp) {
+            sink->suppressed++;
+            return;
+        }
+        sink->items = tmp;
+        sink->capacity = capacity;
+    }
+    char *file = strdup(diagnostic->file);
+    char *path = strdup(diagnostic->path);
+    if (!file || !path) {
+        free(file);
+        free(path);
+        sink->suppressed++;
+        return;
+    }
+    Diagnostic *item = &sink->items[sink->count++];
+    *item = *diagnostic;
+    item->file = file;
+    item->path = path;
+}
+
+//Forgets what the last load collected, keeping the allocation of items
+static void diagnosticSinkReset(DiagnosticSink *sink) {
+    for (size_t i = 0; i < sink->count; ++i) {
+        free((char *) sink->items[i].file);
+        free((char *) sink->items[i].path);
+    }
+    sink->count = 0;
+    sink->errors = 0;
+    sink->warnings = 0;
+    sink->suppressed = 0;
+}
+
+//Points the positions of the following diagnostics at base, a buffer read from file or described by map
+static void diagnosticsSource(DiagnosticState *state, const char *file, const char *base, const SourceMap *map) {
+    state->file = file;
+    state->base = base;
+    state->map = map;
+    state->firstLine = 1;
+    state->lastPos = 0;
+    state->lastLine = 1;
+    state->lastFile = 0;
+}
+
+void diagnosticSinkClear(DiagnosticSink *sink) {
+    if (!sink) return;
+    diagnosticSinkReset(sink);
+    free(sink->items);
+    sink->items = NULL;
+    sink->capacity = 0;
+}
+
+void setDiagnosticSink(struct Option **config, DiagnosticSink *sink) {
+    RootSettings *settings = config ? settingsFor(OPTION_TABLE(config)) : NULL;
+    if (settings) settings->diagnostics = sink;
+}
+
+//Counts a diagnostic, true if it gets past the limits of the sink. Called with state->lock held
+static bool diagnosticAdmit(DiagnosticState *state, DiagnosticSeverity severity) {
+    DiagnosticSink *sink = state->sink;
+    if (severity == DIAGNOSTIC_ERROR) sink->errors++;
+    else sink->warnings++;
+    bool pass = !sink->maxPerLoad || state->passed < sink->maxPerLoad;
+    if (pass && sink->maxPerSecond) {
+        uint64_t now = monotonicNs();
+        if (now - sink->windowStart >= 1000000000u) {
+            sink->windowStart = now;
+            sink->windowCount = 0;
+        }
+        pass = sink->windowCount++ < sink->maxPerSecond;
+    }
+    if (pass) state->passed++;
+    else sink->suppressed++;
+    return pass;
+}
+
+static void diagnosticEmit(DiagnosticSink *sink, const Diagnostic *diagnostic) {
+    if (sink->emit) sink->emit(diagnostic, sink->user);
+    else diagnosticAppend(sink, diagnostic);
+}
+
+static void diagnose(const ParseContext *ctx, DiagnosticSeverity severity, const char *at, const char *name,
+                     int nameLen, size_t index, const char *message) {
+    DiagnosticState *state = ctx->diag;
+    char path[DIAGNOSTIC_PATH_MAX];
+    path[0] = '\0';
+    if (!state) {
+        pathAppend(path, scopePath(ctx->scope, path, sizeof(path)), sizeof(path), name, nameLen, index);
+        if (severity == DIAGNOSTIC_WARNING) fprintf(stderr, "Warning in %s: %s '%s' found\n", ctx->file, message, path);
+        else fprintf(stderr, "Error at option %s:%s: %s\n", ctx->file, path, message);
+        return;
+    }
+    DiagnosticSink *sink = state->sink;
+    if (!sink) return;
+
+#ifndef _WIN32
+    pthread_mutex_lock(&state->lock);
+#endif
+    if (diagnosticAdmit(state, severity)) {
+        pathAppend(path, scopePath(ctx->scope, path, sizeof(path)), sizeof(path), name, nameLen, index);
+        Diagnostic diagnostic = {.severity = severity, .path = path, .message = message};
+        diagnosticPosition(state, at, &diagnostic);
+        diagnosticEmit(sink, &diagnostic);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&state->lock);
+#endif
+}
+
+//A file of the load that couldn't be read, an error about the whole file (line 0)
+static void diagnoseFile(DiagnosticState *state, const char *file, const char *message) {
+    DiagnosticSink *sink = state->sink;
+    if (!sink) return;
+#ifndef _WIN32
+    pthread_mutex_lock(&state->lock);
+#endif
+    if (diagnosticAdmit(state, DIAGNOSTIC_ERROR)) {
+        Diagnostic diagnostic = {.severity = DIAGNOSTIC_ERROR, .file = file, .path = "", .message = message};
+        diagnosticEmit(sink, &diagnostic);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&state->lock);
+#endif
+}
+
+//How #include files are read, passed down to nested includes
+typedef struct IncludeContext {
+    unsigned threads;
+    IncludeCache *cache; //NULL if the config has none
+    bool sourceMaps; //Every file gets a SourceMap, which bypasses the cache
+    unsigned depth; //Of the file being preprocessed, 0 for the one given to readConfig
+    StatsRecorder *stats; //Gets the files read if it isn't NULL
+    DiagnosticState *diag; //Gets the files that can't be read if it isn't NULL, stderr does otherwise
+} IncludeContext;
+
+//One file matched by an #include, read and preprocessed by whichever thread gets to it
+typedef struct IncludeFile {
+    char *path;
+    const char *dirPath; //Nested includes are resolved against the directory of the #include pattern
+    char *content; //Preprocessed contents, NULL if the file couldn't be read
+    size_t len;
+    IncludeEntry *entry; //Cache entry content belongs to, NULL if the file owns it
+    SourceMap map; //Of content, if the context asks for source maps
+} IncludeFile;
+
+//Text of the original buffer up to a macro, followed by the files the #include it ended at matched
+typedef struct IncludeSegment {
+    const char *text;
+    size_t textLen;
+    size_t firstFile;
+    size_t fileCount;
+    char *dirPath;
+} IncludeSegment;
+
+typedef struct IncludeJob {
+    IncludeFile *files;
+    IncludeDeps *deps; //One per file if the dependencies are collected, NULL otherwise
+    size_t count;
+    const IncludeContext *inc;
+    MemoryBudget *budget; //allocBudget of the thread that started the job
+    atomic_size_t next;
+} IncludeJob;
+
+static size_t preprocess(char *bufferOriginal, size_t bufferOriginalLen, char **bufferOut, const char *dirPath,
+                         const IncludeContext *inc, IncludeDeps *deps, SourceMap *map);
+
+//Reads and preprocesses a file, or takes it from the cache. deps gets what the file was built from if it isn't NULL
+static void readIncludeFile(IncludeFile *file, const IncludeContext *inc, IncludeDeps *deps) {
+    if (budgetExceeded()) return; //The load is stopping anyway
+    IncludeCache *cache = inc->cache;
+    FileStamp stamp;
+    uint32_t hash = 0;
+    bool stamped = (cache || deps) && fileStamp(file->path, &stamp) && stamp.regular;
+    if (cache && stamped && !inc->sourceMaps) {
+        hash = optionTableHash(file->path, strlen(file->path));
+        CACHE_LOCK(cache);
+        IncludeEntry *entry = includeCacheFind(cache, file->path, hash);
+        if (entry) atomic_fetch_add(&entry->refs, 1);
+        CACHE_UNLOCK(cache);
+        if (entry && depsCurrent(&entry->deps, &stamp)) {
+            atomic_fetch_add(&cache->hits, 1);
+            file->entry = entry;
+            file->content = entry->content;
+            file->len = entry->len;
+            if (deps) depsMerge(deps, &entry->deps);
+            if (inc->stats) statsAddFile(inc->stats, file->path, 0, inc->depth + 1, true);
+            return;
+        }
+        includeEntryRelease(entry);
+        atomic_fetch_add(&cache->misses, 1);
+    } else if (!stamped && !isFile(file->path)) {
+        return; //Directories and such are skipped silently
+    }
+
+    char *fileBuf = NULL;
+    uint64_t readStart = statsClock(inc->stats);
+    size_t len = readFileIn(file->path, &fileBuf, inc->diag);
+    if (inc->stats) {
+        atomic_fetch_add(&inc->stats->readNs, statsClock(inc->stats) - readStart);
+        statsAddFile(inc->stats, file->path, len, inc->depth + 1, false);
+    }
+    if (!len) {
+        if (!budgetExceeded()) { //Going over the memory limit is reported by the load, see limitExceeded
+            if (inc->diag) diagnoseFile(inc->diag, file->path, "Unable to read included file");
+            else fprintf(stderr, "Error: unable to read file: %s\n", file->path);
+        }
+        if (deps && stamped) depsAdd(deps, file->path, &stamp); //Noticed once it has contents
+        return;
+    }
+    IncludeDeps own = {0};
+    IncludeDeps *fileDeps = cache || deps ? &own : NULL;
+    if (fileDeps) depsAdd(fileDeps, file->path, &stamp);
+    SourceMap *map = inc->sourceMaps ? &file->map : NULL;
+    if (map) mapAddFile(map, file->path, false);
+    IncludeContext nested = *inc;
+    nested.depth++;
+    file->len = preprocess(fileBuf, len, &file->content, file->dirPath, &nested, fileDeps, map);
+    if (file->content != fileBuf) free(fileBuf);
+    if (deps) depsMerge(deps, &own);
+    if (!cache || inc->sourceMaps || own.uncacheable) { //Lookups skip the cache with source maps, so would never hit
+        depsFree(&own);
+        return;
+    }
+
+    IncludeEntry *entry = malloc(sizeof(IncludeEntry));
+    char *path = strdup(file->path);
+    if (!entry || !path) {
+        free(entry);
+        free(path);
+        depsFree(&own);
+        return;
+    }
+    entry->hash = hash;
+    entry->path = path;
+    entry->content = file->content;
+    entry->len = file->len;
+    entry->deps = own;
+    atomic_init(&entry->refs, 2); //The cache's and this file's
+    file->entry = entry;
+    includeCachePut(cache, entry);
+}
+
+static void *includeWorkerMain(void *arg) {
+    IncludeJob *job = arg;
+    //A file that is the only one of its #include gets the threads for its own nested includes
+    IncludeContext nested = *job->inc;
+    if (job->count > 1) nested.threads = 1;
+    StatsRecorder *counters = allocStats; //Runs on the calling thread too, which keeps its own
+    allocStats = nested.stats;
+    budgetEnter(job->budget);
+    size_t i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        readIncludeFile(&job->files[i], &nested, job->deps ? &job->deps[i] : NULL);
+    }
+    allocStats = counters;
+    return NULL;
+}
+
+//Reads and preprocesses every file, on up to inc->threads threads (the calling one included)
+static void readIncludeFiles(IncludeFile *files, IncludeDeps *deps, size_t count, const IncludeContext *inc) {
+    IncludeJob job = {.files = files, .deps = deps, .count = count, .inc = inc, .budget = allocBudget};
+    atomic_init(&job.next, 0);
+    size_t workers = inc->threads > 1 ? inc->threads - 1 : 0;
+    if (workers > count - 1) workers = count - 1;
+#ifndef _WIN32
+    pthread_t *pool = workers ? malloc(workers * sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    for (; pool && started < workers; ++started) {
+        if (pthread_create(&pool[started], NULL, includeWorkerMain, &job)) break;
+    }
+    includeWorkerMain(&job);
+    for (size_t i = 0; i < started; ++i) pthread_join(pool[i], NULL);
+    free(pool);
+#else
+    includeWorkerMain(&job);
+#endif
+}
+
+static char *patternDir(const char *pattern, const char *dirEnd) {
+    return dirEnd > pattern ? strndup(pattern, dirEnd - pattern) : strdup(".");
+}
+
+//The directory an #include pattern is matched in is a dependency too, files that show up in it change the output
+static void addPatternDep(IncludeDeps *deps, const char *pattern, const char *dirEnd) {
+    char *dir = patternDir(pattern, dirEnd);
+    if (!dir || strpbrk(dir, "*?[")) {
+        deps->uncacheable = true;
+    } else {
+        FileStamp stamp;
+        fileStamp(dir, &stamp);
+        depsAdd(deps, dir, &stamp);
+    }
+    free(dir);
+}
+
+/*
+ * Replaces #include lines with the preprocessed contents of the files their pattern matches, in glob order. All
+ * #include lines are collected first, then the files are read (on inc->threads threads, see setParseThreads) and the
+ * output is assembled in one allocation. The output is null terminated, if there are no macros it's the original
+ * buffer. deps, if not NULL, gets the files and directories the output was built from (see IncludeCache). map, if not
+ * NULL, gets the spans of the output; its last file must be the one bufferOriginal was read from
+ */
+static size_t preprocess(char *bufferOriginal, size_t bufferOriginalLen, char **bufferOut, const char *dirPath,
+                         const IncludeContext *inc, IncludeDeps *deps, SourceMap *map) {
+    if (map && !map->fileCount) {
+        map->failed = true;
+        map = NULL;
+    }
+    size_t self = map ? map->fileCount - 1 : 0;
+    size_t firstPattern = map ? map->patternCount : 0;
+    size_t dirPathLen = strlen(dirPath);
+    IncludeSegment *segments = NULL;
+    size_t segmentCount = 0, segmentsSize = 0;
+    IncludeFile *files = NULL;
+    size_t fileCount = 0, filesSize = 0;
+    char *macroStart = bufferOriginal;
+    char *prevMacroEnd = bufferOriginal;
+
+    while ((macroStart = strchr(macroStart, '#')) && macroStart - bufferOriginal < bufferOriginalLen) {
+        char *lineBegin = strrchr_(macroStart, macroStart - prevMacroEnd, '\n') + 1;
+        if (lineBegin == NULL + 1) { // 1 was added to lineBegin, so it will be NULL + 1 if it would usually be NULL
+            lineBegin = prevMacroEnd;
+        }
+        for (; lineBegin < macroStart; lineBegin++) { //Macro has to be the only thing on the line
+            if (!isspace(*lineBegin)) goto eol;
+        }
+
+        char *lineEnd = strchr(macroStart + 1, '\n');
+        if (!(strncmp(macroStart + 1, "include", 7))) {
+            char *pathStart = memchr(macroStart + 7, '"', lineEnd - macroStart);
+            if (!pathStart) {
+                fprintf(stderr, "Error: macro #include must have a path specified in '\"'\n");
+                goto eol;
+            }
+            pathStart++;
+            char *pathEnd = memchr(pathStart, '"', lineEnd - (pathStart));
+            if (!pathEnd) {
+                fprintf(stderr, "Error: macro #include must have a path specified in '\"'\n");
+                goto eol;
+            }
+            char *fileName = malloc(((pathEnd - pathStart + dirPathLen + 1) * sizeof(char)));
+            memcpy(fileName, dirPath, dirPathLen);
+            memcpy(fileName + dirPathLen, pathStart, pathEnd - pathStart);
+            fileName[pathEnd - pathStart + dirPathLen] = '\0'; //Must be null-terminated
+            if (inc->depth >= INCLUDE_MAX_DEPTH) {
+                if (inc->diag) {
+                    diagnoseFile(inc->diag, fileName, "#include nested too deep, left out");
+                } else {
+                    fprintf(stderr, "Error: #include \"%s\" nested deeper than %d files is left out\n", fileName,
+                            INCLUDE_MAX_DEPTH);
+                }
+                free(fileName);
+                goto eol;
+            }
+
+            //Get path to the parent directory used to find other files which may be included
+            char *parentDirI = strrchr(fileName, '/') + 1;
+            if (parentDirI == NULL + 1) parentDirI = fileName;
+            if (deps) addPatternDep(deps, fileName, parentDirI);
+
+            glob_t glob_result;
+            memset(&glob_result, 0, sizeof(glob_result));
+
+            int glob_return = glob(fileName, GLOB_TILDE, NULL, &glob_result);
+            if (map && glob_return != GLOB_NOSPACE && glob_return != GLOB_ABORTED) {
+                char *dir = patternDir(fileName, parentDirI);
+                if (dir) mapAddPattern(map, fileName, dir, glob_result.gl_pathv, glob_result.gl_pathc);
+                else map->failed = true;
+                free(dir);
+            }
+
+            switch (glob_return) {
+                case GLOB_NOSPACE: {
+                    if (inc->diag) diagnoseFile(inc->diag, fileName, "Out of memory matching #include pattern");
+                    else fprintf(stderr, "Error: glob() failed with return code GLOB_NOSPACE (Out of memory)\n");
+                    globfree(&glob_result);
+                    free(fileName);
+                    goto eol;
+                }
+                case GLOB_ABORTED: {
+                    if (inc->diag) diagnoseFile(inc->diag, fileName, "Read error matching #include pattern");
+                    else fprintf(stderr, "Error: glob() failed with return code GLOB_ABORTED (Read error)\n");
+                    globfree(&glob_result);
+                    free(fileName);
+                    goto eol;
+                }
+                case GLOB_NOMATCH: {
+                    if (inc->diag) diagnoseFile(inc->diag, fileName, "No files found matching #include pattern");
+                    else fprintf(stderr, "Error: No files found matching pattern '%s'\n", fileName);
+                    globfree(&glob_result);
+                    free(fileName);
+                    goto eol;
+                }
+                default: {
                     break;
                 }
-                char searchChar = single ? '\'' : '"';
-                char *stringStart = single ? singleStart : doubleStart;
-                stringStart += 1 + (*(stringStart + 1) == '\n');
+            }
+
+            if (segmentCount == segmentsSize) {
+                size_t size = segmentsSize ? segmentsSize * 2 : ARRAY_ALLOCATION;
+                IncludeSegment *tmp = realloc(segments, size * sizeof(IncludeSegment));
+                if (!tmp) goto noMemory;
+                segments = tmp;
+                segmentsSize = size;
+            }
+            if (fileCount + glob_result.gl_pathc > filesSize) {
+                size_t size = filesSize ? filesSize : ARRAY_ALLOCATION;
+                while (fileCount + glob_result.gl_pathc > size) size *= 2;
+                IncludeFile *tmp = realloc(files, size * sizeof(IncludeFile));
+                if (!tmp) goto noMemory;
+                files = tmp;
+                filesSize = size;
+            }
+
+            IncludeSegment *segment = &segments[segmentCount++];
+            segment->text = prevMacroEnd;
+            segment->textLen = macroStart - prevMacroEnd; //Everything leading up to the macro
+            segment->firstFile = fileCount;
+            segment->fileCount = glob_result.gl_pathc;
+            segment->dirPath = strndup(fileName, parentDirI - fileName);
+            for (size_t i = 0; i < glob_result.gl_pathc; ++i) {
+                files[fileCount++] = (IncludeFile) {.path = strdup(glob_result.gl_pathv[i]),
+                                                    .dirPath = segment->dirPath};
+            }
+            globfree(&glob_result);
+            free(fileName);
+
+            prevMacroEnd = lineEnd;
+            goto eol;
+
+            noMemory:
+            fprintf(stderr, "Error: unable to reallocate more memory for macro processing buffer: %s\n",
+                    strerror(errno));
+            globfree(&glob_result);
+            free(fileName);
+        }
+        eol:
+        macroStart++;
+    }
+    if (!segmentCount) {
+        free(segments);
+        free(files);
+        if (map) {
+            if (!map->failed) map->files[self].leaf = map->patternCount == firstPattern;
+            mapAddSpan(map, 0, bufferOriginalLen, self, 0);
+        }
+        (*bufferOut) = bufferOriginal;
+        return bufferOriginalLen;
+    }
+
+    if (fileCount) {
+        IncludeDeps *fileDeps = deps ? calloc(fileCount, sizeof(IncludeDeps)) : NULL;
+        if (deps && !fileDeps) deps->uncacheable = true;
+        readIncludeFiles(files, fileDeps, fileCount, inc);
+        for (size_t i = 0; fileDeps && i < fileCount; ++i) { //In glob order, whichever thread read the file
+            depsMerge(deps, &fileDeps[i]);
+            depsFree(&fileDeps[i]);
+        }
+        free(fileDeps);
+    }
+
+    size_t tailLen = (bufferOriginal + bufferOriginalLen) - prevMacroEnd;
+    size_t outLen = tailLen;
+    for (size_t i = 0; i < segmentCount; ++i) outLen += segments[i].textLen;
+    for (size_t i = 0; i < fileCount; ++i) outLen += files[i].len;
+
+    char *bufferO = budgetTake(outLen + 1) ? malloc(outLen + 1) : NULL;
+    STATS_COUNT(mallocs, 1);
+    char *buffer = bufferO;
+    if (bufferO) {
+        for (size_t i = 0; i < segmentCount; ++i) {
+            if (map) mapAddSpan(map, buffer - bufferO, segments[i].textLen, self, segments[i].text - bufferOriginal);
+            memcpy(buffer, segments[i].text, segments[i].textLen);
+            buffer += segments[i].textLen;
+            for (size_t f = segments[i].firstFile; f < segments[i].firstFile + segments[i].fileCount; ++f) {
+                if (!files[f].len) continue;
+                if (map) mapAppend(map, &files[f].map, buffer - bufferO);
+                memcpy(buffer, files[f].content, files[f].len); // Copy everything from included file into new buffer
+                buffer += files[f].len;
+            }
+        }
+        if (map) mapAddSpan(map, buffer - bufferO, tailLen, self, prevMacroEnd - bufferOriginal);
+        memcpy(buffer, prevMacroEnd, tailLen);
+        buffer += tailLen;
+        *buffer = '\0'; //Must be null terminated
+    } else {
+        //Over the memory limit the load is reported as a whole
+        if (!budgetExceeded()) {
+            fprintf(stderr, "Error: unable to allocate memory for macro processing buffer: %s\n", strerror(errno));
+        }
+        if (map) map->failed = true;
+    }
+
+    for (size_t i = 0; i < fileCount; ++i) {
+        mapFree(&files[i].map);
+        free(files[i].path);
+        if (files[i].entry) includeEntryRelease(files[i].entry);
+        else free(files[i].content);
+    }
+    for (size_t i = 0; i < segmentCount; ++i) free(segments[i].dirPath);
+    free(files);
+    free(segments);
+    if (!bufferO) {
+        (*bufferOut) = bufferOriginal;
+        return bufferOriginalLen;
+    }
+    (*bufferOut) = bufferO;
+    return buffer - bufferO;
+}
+
+size_t preprocessor(char *bufferOriginal, size_t bufferOriginalLen, char **bufferOut, char *dirPath,
+                    unsigned threads, IncludeCache *cache) {
+    IncludeContext inc = {.threads = threads, .cache = cache};
+    return preprocess(bufferOriginal, bufferOriginalLen, bufferOut, dirPath, &inc, NULL, NULL);
+}
+
+//Frees the value parsed into opt and points it back at its default. Values in an arena (owned is false) are left for
+//the arena to release, and strings that are views into the source buffer aren't freed
+static void releaseOption(Option *opt, bool owned, bool views) {
+    switch (opt->type) {
+        case BOOL:
+            opt->v_b = opt->def->dv_b;
+            break;
+        case LONG:
+            opt->v_l = opt->def->dv_l;
+            break;
+        case DOUBLE:
+            opt->v_d = opt->def->dv_d;
+            break;
+        case TEXT:
+            if (owned && !views && opt->v_s != opt->def->dv_s) free(opt->v_s);
+            opt->v_sv = opt->def->dv_sv;
+            break;
+        case COMPOUND:
+            releaseValues(opt->v_v, views);
+            break;
+        case ARRAY:
+            if (owned && opt->v_a.a_l != opt->def->dv_a.a_l) freeArrayValue(&opt->v_a, views);
+            opt->v_a = opt->def->dv_a;
+            break;
+    }
+}
+
+//Frees the values parsed into options by the last load and points every option back at its default
+static void releaseValues(Option **options, bool views) {
+    bool owned = !OPTION_TABLE(options)->arena;
+    Option *opt;
+    OWN_ITER(OPTION_TABLE(options), opt) {
+            releaseOption(opt, owned, views);
+        }
+}
+
+//incremental reload
+
+#define RELOAD_FULL_SHARE 4 //A reload that changes more than 1/RELOAD_FULL_SHARE of the files or bytes is done in full
+#define RELOAD_SAMPLE_MIN 256 //Dependencies from which a sample of them is stamped first, see reloadChanged
+#define RELOAD_SAMPLE_STRIDE 8
+
+//A top level statement of the last load: the option it assigns and where its text is
+typedef struct SourcePiece {
+    Option *opt;
+    size_t span; //Index into the spans of the record's map
+    size_t offset; //In the span's file
+    size_t len;
+} SourcePiece;
+
+typedef struct LoadRecord {
+    char *filename; //NULL if the last load can't be reloaded incrementally
+    SourceMap map; //Only which file each span is from is used after the load, offsets in the output go stale
+    IncludeDeps deps;
+    SourcePiece *pieces; //In the order of the preprocessed output, so grouped by span
+    size_t pieceCount;
+    //First map file read from each dependency (SIZE_MAX for directories), and for each map file the next one read from
+    //the same path, so a changed dependency finds its files without comparing paths
+    size_t *depFiles;
+    size_t *sameFiles;
+} LoadRecord;
+
+static void recordClear(LoadRecord *record) {
+    free(record->filename);
+    mapFree(&record->map);
+    depsFree(&record->deps);
+    free(record->pieces);
+    free(record->depFiles);
+    free(record->sameFiles);
+    memset(record, 0, sizeof(LoadRecord));
+}
+
+static size_t recordMemory(const LoadRecord *record) {
+    size_t bytes = sizeof(LoadRecord) + mapMemory(&record->map) + record->deps.capacity * sizeof(IncludeDep) +
+                   record->pieceCount * sizeof(SourcePiece);
+    for (size_t i = 0; i < record->deps.count; ++i) bytes += strlen(record->deps.items[i].path) + 1;
+    if (record->filename) bytes += strlen(record->filename) + 1;
+    if (record->depFiles) bytes += record->deps.count * sizeof(size_t) + 1;
+    if (record->sameFiles) bytes += record->map.fileCount * sizeof(size_t) + 1;
+    return bytes;
+}
+
+//Turns the statements of a full load into pieces. A statement that isn't within one span (an #include line in the
+//middle of a value) leaves the record unusable
+static void recordStatements(LoadRecord *record, const char *filename, const StatementLog *log) {
+    const SourceMap *map = &record->map;
+    if (log->failed || map->failed || record->deps.uncacheable) return;
+    SourcePiece *pieces = log->count ? malloc(log->count * sizeof(SourcePiece)) : NULL;
+    if (log->count && !pieces) return;
+    size_t span = 0;
+    for (size_t i = 0; i < log->count; ++i) {
+        const LoggedStatement *statement = &log->items[i];
+        while (span < map->spanCount && map->spans[span].out + map->spans[span].len <= statement->start) span++;
+        if (span == map->spanCount || statement->start < map->spans[span].out ||
+            statement->end > map->spans[span].out + map->spans[span].len) {
+            free(pieces);
+            return;
+        }
+        size_t offset = map->spans[span].offset + statement->start - map->spans[span].out;
+        pieces[i] = (SourcePiece) {statement->opt, span, offset, statement->end - statement->start};
+    }
+
+    //Files by path, to link the dependencies to them
+    size_t capacity = 16;
+    while (capacity < map->fileCount * 2) capacity *= 2;
+    size_t *slots = calloc(capacity, sizeof(size_t)); //File index + 1, 0 if empty
+    size_t *depFiles = malloc(record->deps.count * sizeof(size_t) + 1);
+    size_t *sameFiles = malloc(map->fileCount * sizeof(size_t) + 1);
+    record->filename = strdup(filename);
+    if (!slots || !depFiles || !sameFiles || !record->filename) {
+        free(record->filename);
+        record->filename = NULL;
+        free(slots);
+        free(depFiles);
+        free(sameFiles);
+        free(pieces);
+        return;
+    }
+    for (size_t f = map->fileCount; f-- > 0;) { //Backwards, so every chain runs in file order
+        const char *path = map->files[f].path;
+        size_t i = optionTableHash(path, strlen(path)) & (capacity - 1);
+        while (slots[i] && strcmp(map->files[slots[i] - 1].path, path)) i = (i + 1) & (capacity - 1);
+        sameFiles[f] = slots[i] ? slots[i] - 1 : SIZE_MAX;
+        slots[i] = f + 1;
+    }
+    for (size_t d = 0; d < record->deps.count; ++d) {
+        const char *path = record->deps.items[d].path;
+        size_t i = optionTableHash(path, strlen(path)) & (capacity - 1);
+        while (slots[i] && strcmp(map->files[slots[i] - 1].path, path)) i = (i + 1) & (capacity - 1);
+        depFiles[d] = slots[i] ? slots[i] - 1 : SIZE_MAX;
+    }
+    free(slots);
+    record->pieces = pieces;
+    record->pieceCount = log->count;
+    record->depFiles = depFiles;
+    record->sameFiles = sameFiles;
+}
+
+//Options by address, open addressing
+typedef struct OptionSet {
+    Option **slots;
+    size_t capacity; //Always a power of two
+    size_t count;
+} OptionSet;
+
+static size_t optionSetSlot(const OptionSet *set, const Option *opt) {
+    size_t i = (size_t) (((uint64_t) (uintptr_t) opt >> 4) * 0x9E3779B97F4A7C15ull) & (set->capacity - 1);
+    while (set->slots[i] && set->slots[i] != opt) i = (i + 1) & (set->capacity - 1);
+    return i;
+}
+
+static bool optionSetHas(const OptionSet *set, const Option *opt) {
+    return set->capacity && set->slots[optionSetSlot(set, opt)] == opt;
+}
+
+static bool optionSetAdd(OptionSet *set, Option *opt) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        OptionSet grown = {calloc(set->capacity ? set->capacity * 2 : 64, sizeof(Option *)),
+                           set->capacity ? set->capacity * 2 : 64, set->count};
+        if (!grown.slots) return false;
+        for (size_t i = 0; i < set->capacity; ++i) {
+            if (set->slots[i]) grown.slots[optionSetSlot(&grown, set->slots[i])] = set->slots[i];
+        }
+        free(set->slots);
+        *set = grown;
+    }
+    size_t i = optionSetSlot(set, opt);
+    if (!set->slots[i]) {
+        set->slots[i] = opt;
+        set->count++;
+    }
+    return true;
+}
+
+//The directory an #include pattern is matched in changed, which is harmless as long as every pattern matched in it
+//still matches the same files (a fragment replaced by a rename changes its directory too)
+static bool patternsUnchanged(const SourceMap *map, const char *dir) {
+    bool found = false;
+    for (size_t i = 0; i < map->patternCount; ++i) {
+        const SourcePattern *pattern = &map->patterns[i];
+        if (strcmp(pattern->dir, dir)) continue;
+        found = true;
+        glob_t result;
+        memset(&result, 0, sizeof(result));
+        int ret = glob(pattern->pattern, GLOB_TILDE, NULL, &result);
+        bool same = (!ret || ret == GLOB_NOMATCH) && result.gl_pathc == pattern->count;
+        for (size_t j = 0; same && j < pattern->count; ++j) same = !strcmp(result.gl_pathv[j], pattern->matches[j]);
+        globfree(&result);
+        if (!same) return false;
+    }
+    return found;
+}
+
+//A file of the record's map that changed since the last load
+typedef struct ChangedFile {
+    bool changed;
+    bool spanned; //Part of the output, an empty file isn't
+    char *content;
+    size_t len;
+    StatementLog log; //Statements of the new contents
+} ChangedFile;
+
+/*
+ * Reloads the fragments that changed since the last load (see setIncrementalReload). Returns false if that isn't
+ * possible, in which case the caller does a full load. Options may have been reset by then, but that only ever
+ * happens to options the full load assigns again
+ */
+static bool reloadChanged(Option **config, const char *filename, DiagnosticState *diag) {
+    OptionTable *root = OPTION_TABLE(config);
+    LoadRecord *record = settingsOf(root)->record;
+    if (!record->filename || strcmp(record->filename, filename)) return false;
+    SourceMap *map = &record->map;
+    IncludeDeps *deps = &record->deps;
+
+    bool done = false;
+    size_t changedCount = 0;
+    FileStamp *stamps = malloc(deps->count * sizeof(FileStamp) + 1);
+    ChangedFile *changed = calloc(map->fileCount + 1, sizeof(ChangedFile));
+    OptionSet affected = {0};
+    SourcePiece *pieces = NULL;
+    char *text = NULL;
+    FILE *fp = NULL;
+    if (!stamps || !changed) goto end;
+
+    uint64_t totalBytes = 0, changedBytes = 0;
+    for (size_t i = 0; i < deps->count; ++i) {
+        if (deps->items[i].stamp.regular) totalBytes += deps->items[i].stamp.size;
+    }
+    //With many files every RELOAD_SAMPLE_STRIDEth is stamped first, and if half of those changed the reload is done in
+    //full without stamping the rest. Closer to the share the exact count below decides
+    size_t sampled = 0, sampledChanged = 0;
+    if (deps->count >= RELOAD_SAMPLE_MIN) {
+        for (size_t i = 0; i < deps->count; i += RELOAD_SAMPLE_STRIDE, ++sampled) {
+            fileStamp(deps->items[i].path, &stamps[i]);
+            if (!stampEqual(&deps->items[i].stamp, &stamps[i])) sampledChanged++;
+        }
+        if (sampledChanged * 2 > sampled) goto end;
+    }
+    for (size_t i = 0; i < deps->count; ++i) {
+        const IncludeDep *dep = &deps->items[i];
+        if (!sampled || i % RELOAD_SAMPLE_STRIDE) fileStamp(dep->path, &stamps[i]);
+        if (stampEqual(&dep->stamp, &stamps[i])) continue;
+        if (!dep->stamp.regular) { //A directory patterns are matched in
+            if (!stamps[i].exists || stamps[i].regular || !patternsUnchanged(map, dep->path)) goto end;
+            continue;
+        }
+        if (!stamps[i].regular || record->depFiles[i] == SIZE_MAX) goto end; //Was empty, it isn't in the output
+        for (size_t f = record->depFiles[i]; f != SIZE_MAX; f = record->sameFiles[f]) {
+            if (changed[f].changed) continue;
+            if (!map->files[f].leaf) goto end;
+            changed[f].changed = true;
+            changedCount++;
+        }
+        //Every changed fragment is parsed twice, so past a share of the files or their bytes a full load is faster.
+        //Given up as soon as it's clear, the full load stamps every file again anyway
+        changedBytes += dep->stamp.size > stamps[i].size ? dep->stamp.size : stamps[i].size;
+        if (changedCount * RELOAD_FULL_SHARE > map->fileCount || changedBytes * RELOAD_FULL_SHARE > totalBytes) {
+            goto end;
+        }
+    }
+
+    if (!changedCount) { //Nothing to parse, at most a directory was touched
+        for (size_t i = 0; i < deps->count; ++i) deps->items[i].stamp = stamps[i];
+        done = true;
+        goto end;
+    }
+    for (size_t f = 0; f < map->fileCount; ++f) {
+        FileStamp stamp;
+        if (!changed[f].changed || (fileStamp(map->files[f].path, &stamp) && !stamp.size)) continue;
+        changed[f].len = readFileIn(map->files[f].path, &changed[f].content, diag);
+        //Conservative, a fragment that mentions #include anywhere might have gained an #include line
+        if (!changed[f].len || strstr(changed[f].content, "#include")) goto end;
+    }
+
+    //Whatever the changed fragments assign now, parsed into config only to be reset and parsed in order below
+    for (size_t f = 0; f < map->fileCount; ++f) {
+        if (!changed[f].changed) continue;
+        changed[f].log = (StatementLog) {.options = config, .base = changed[f].content};
+        if (!changed[f].len) continue;
+        Scanner scan;
+        scannerInit(&scan, changed[f].content, changed[f].len);
+        if (diag) diagnosticsSource(diag, map->files[f].path, changed[f].content, NULL);
+        ParseContext ctx = {.file = map->files[f].path, .scan = &scan, .threads = settingsOf(root)->parseThreads,
+                            .log = &changed[f].log, .diag = diag};
+        parseConfigWhole(config, &ctx, changed[f].content, changed[f].len);
+        if (changed[f].log.failed) goto end;
+    }
+
+    size_t count = record->pieceCount;
+    for (size_t i = 0; i < record->pieceCount; ++i) {
+        if (!changed[map->spans[record->pieces[i].span].file].changed) continue;
+        count--;
+        if (!optionSetAdd(&affected, record->pieces[i].opt)) goto end;
+    }
+    for (size_t s = 0; s < map->spanCount; ++s) {
+        ChangedFile *file = &changed[map->spans[s].file];
+        if (!file->changed) continue;
+        file->spanned = true;
+        count += file->log.count;
+    }
+    pieces = count ? malloc(count * sizeof(SourcePiece)) : NULL;
+    if (count && !pieces) goto end;
+    size_t next = 0;
+    for (size_t s = 0, old = 0; s < map->spanCount; ++s) {
+        const ChangedFile *file = &changed[map->spans[s].file];
+        for (; old < record->pieceCount && record->pieces[old].span == s; ++old) {
+            if (!file->changed) pieces[next++] = record->pieces[old];
+        }
+        for (size_t i = 0; file->changed && i < file->log.count; ++i) {
+            const LoggedStatement *statement = &file->log.items[i];
+            pieces[next++] = (SourcePiece) {statement->opt, s, statement->start, statement->end - statement->start};
+            if (!optionSetAdd(&affected, statement->opt)) goto end;
+        }
+    }
+    for (size_t f = 0; f < map->fileCount; ++f) {
+        if (changed[f].changed && !changed[f].spanned && changed[f].log.count) goto end; //Was empty, has no span
+    }
+
+    //Every statement of an affected option, from whichever file it's in, parsed again in order from its default
+    size_t textLen = 0;
+    for (size_t i = 0; i < next; ++i) {
+        if (optionSetHas(&affected, pieces[i].opt)) textLen += pieces[i].len + 1;
+    }
+    for (size_t i = 0; i < affected.capacity; ++i) {
+        if (affected.slots[i]) releaseOption(affected.slots[i], true, false);
+    }
+    text = malloc(textLen + 1);
+    if (!text) goto end;
+    char *out = text;
+    size_t openFile = SIZE_MAX;
+    for (size_t i = 0; i < next; ++i) {
+        const SourcePiece *piece = &pieces[i];
+        if (!optionSetHas(&affected, piece->opt)) continue;
+        size_t f = map->spans[piece->span].file;
+        if (changed[f].changed) {
+            memcpy(out, changed[f].content + piece->offset, piece->len);
+        } else {
+            if (f != openFile) {
+                if (fp) fclose(fp);
+                fp = fopen(map->files[f].path, "rb");
+                openFile = f;
+            }
+            if (!fp || fseek(fp, (long) piece->offset, SEEK_SET)) goto end;
+            size_t got = fread(out, 1, piece->len, fp);
+            if (got + 1 == piece->len) out[got++] = '\n'; //The new line readFile added to the end of the file
+            if (got != piece->len) goto end;
+        }
+        out += piece->len;
+        if (out[-1] != '\n') *out++ = '\n';
+    }
+    *out = '\0';
+    Scanner scan;
+    scannerInit(&scan, text, out - text);
+    //Statements of unchanged files were reported when they were parsed, the changed ones just now
+    DiagnosticState muted = {.sink = NULL};
+    ParseContext ctx = {.file = filename, .scan = &scan, .threads = settingsOf(root)->parseThreads, .diag = diag ? &muted : NULL};
+    parseConfigWhole(config, &ctx, text, out - text);
+
+    free(record->pieces);
+    record->pieces = pieces;
+    record->pieceCount = next;
+    pieces = NULL;
+    for (size_t i = 0; i < deps->count; ++i) deps->items[i].stamp = stamps[i];
+    done = true;
+
+    end:
+    if (fp) fclose(fp);
+    for (size_t f = 0; changed && f < map->fileCount; ++f) {
+        free(changed[f].content);
+        free(changed[f].log.items);
+    }
+    free(changed);
+    free(stamps);
+    free(affected.slots);
+    free(pieces);
+    free(text);
+    return done;
+}
+
+#ifndef _WIN32
+
+/*
+ * Maps a file privately with enough zero bytes reserved past its end that, like a buffer from readFile, it can be
+ * ended with a new line and is null-terminated. Only the page holding that new line (if one is missing) gets copied.
+ */
+static char *mapFile(const char *filename, size_t *length, size_t *mappedLength, DiagnosticState *diag) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        if (diag) diagnoseFile(diag, filename, "Can't open file");
+        else fprintf(stderr, "Error: Can't open file '%s': '%s'\n", filename, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t total = (size + 2 + pageSize - 1) / pageSize * pageSize;
+    if (!budgetTake(total)) { //Reported by the load, see limitExceeded
+        close(fd);
+        return NULL;
+    }
+
+    //Reserve the whole range as zero pages, then put the file over the start of it
+    char *reserved = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        if (diag) diagnoseFile(diag, filename, "Can't map file");
+        else fprintf(stderr, "Error: Can't map file '%s': '%s'\n", filename, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    char *buffer = mmap(reserved, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED) {
+        if (diag) diagnoseFile(diag, filename, "Can't map file");
+        else fprintf(stderr, "Error: Can't map file '%s': '%s'\n", filename, strerror(errno));
+        munmap(reserved, total);
+        return NULL;
+    }
+    madvise(buffer, size, MADV_SEQUENTIAL);
+
+    if (buffer[size - 1] != '\n') buffer[size++] = '\n';
+    *length = size;
+    *mappedLength = total;
+    return buffer;
+}
+
+#endif
+
+static bool holdsStringArray(const Option *opt) {
+    if (opt->type == ARRAY) return opt->v_a.type == TEXT;
+    if (opt->type != COMPOUND) return false;
+    Option *inner;
+    HASH_ITER(opt->v_v, inner) {
+            if (holdsStringArray(inner)) return true;
+        }
+    return false;
+}
+
+//After a mapped load, gives string arrays that the file didn't set a StringView copy of their default, so every
+//string array of the config can be read the same way. Only the pointers are copied, not the strings
+static void viewDefaultStrings(Option **options) {
+    OptionTable *table = OPTION_TABLE(options);
+    ConfigArena *arena = table->arena;
+    Option *opt;
+    //A template holds char * strings, so an element can't share the string arrays (or compounds with string arrays)
+    //it didn't set. It gets its own copy of those first
+    if (table->base) {
+        OWN_ITER(table->base, opt) {
+                if (holdsStringArray(opt)) optionTableFindWritable(options, opt->name, strlen(opt->name));
+            }
+    }
+    OWN_ITER(table, opt) {
+            if (opt->type == COMPOUND) {
+                viewDefaultStrings(opt->v_v);
+            } else if (opt->type == ARRAY && opt->v_a.type == COMPOUND && opt->v_a.a_l != opt->def->dv_a.a_l) {
+                for (size_t i = 0; i < opt->v_a.len; ++i) viewDefaultStrings(opt->v_a.a_v.a_v[i]);
+            } else if (opt->type == ARRAY && opt->v_a.type == TEXT && opt->v_a.a_s == opt->def->dv_a.a_s) {
+                StringView *views = valueAlloc(arena, opt->def->dv_a.len * sizeof(StringView));
+                if (!views) continue;
+                for (size_t i = 0; i < opt->def->dv_a.len; ++i) {
+                    char *str = opt->def->dv_a.a_s[i];
+                    views[i] = (StringView) {str, str ? strlen(str) : 0};
+                }
+                opt->v_a.a_sv = views;
+            }
+        }
+}
+
+static void releaseSource(OptionTable *table) {
+    if (!table->source) return;
+#ifndef _WIN32
+    if (table->sourceMapped) munmap(table->source, table->sourceLen);
+    else
+#endif
+        free(table->source);
+    table->source = NULL;
+    table->sourceLen = 0;
+    table->sourceMapped = false;
+    table->stringViews = false;
+}
+
+//Values of the last load can't just be overwritten if they are views into its source or live in an arena region that
+//is about to be reused, so in those cases options go back to their defaults first. The record of the last load is
+//dropped, a full load makes a new one
+static void beginLoad(OptionTable *root, bool mapped) {
+    ConfigArena *arena = root->arena;
+    if (settingsOf(root)->record) recordClear(settingsOf(root)->record);
+    if (mapped || root->source || (arena && arena->values.head)) {
+        releaseValues((Option **) root, root->source != NULL);
+        releaseSource(root);
+        if (arena) regionRelease(&arena->values, true);
+    }
+}
+
+//Empties the statistics of the last load, keeping the allocation of the file list
+static void statsReset(ParseStats *out) {
+    for (size_t i = 0; i < out->fileCount; ++i) free(out->files[i].path);
+    ParseFileStats *files = out->files;
+    size_t capacity = out->fileCapacity;
+    *out = (ParseStats) {.files = files, .fileCapacity = capacity};
+}
+
+static void statsCountArray(ParseStats *out, const ArrayOption *array);
+
+//Counts the options a table stores itself and how far each one is from the slot its hash starts probing at
+static void statsCountTable(ParseStats *out, Option **options) {
+    const OptionTable *table = OPTION_TABLE(options);
+    size_t mask = table->capacity - 1;
+    Option *opt;
+    OWN_ITER(table, opt) {
+        size_t probes = table->seeds ? 1 : ((own - (table->hashes[own] & mask)) & mask) + 1;
+        out->probes[probes < PARSE_STATS_PROBES ? probes - 1 : PARSE_STATS_PROBES - 1]++;
+        out->options++;
+        if (opt->type == COMPOUND) {
+            out->compounds++;
+            statsCountTable(out, opt->v_v);
+        } else if (opt->type == ARRAY) {
+            out->arrays++;
+            statsCountArray(out, &opt->v_a);
+        }
+    }
+}
+
+static void statsCountArray(ParseStats *out, const ArrayOption *array) {
+    out->arrayElements += array->len;
+    for (size_t i = 0; i < array->len; ++i) {
+        if (array->type == COMPOUND) statsCountTable(out, array->a_v.a_v[i]);
+        else if (array->type == ARRAY) statsCountArray(out, &array->a_a.a_a[i]);
+    }
+}
+
+//Starts recording a load into out, which is reset
+static void statsStart(StatsRecorder *stats, ParseStats *out) {
+    *stats = (StatsRecorder) {.out = out};
+    atomic_init(&stats->mallocs, 0);
+    atomic_init(&stats->reallocs, 0);
+    atomic_init(&stats->readNs, 0);
+#ifndef _WIN32
+    pthread_mutex_init(&stats->lock, NULL);
+#endif
+    statsReset(out);
+}
+
+static void statsFinish(StatsRecorder *stats, Option **config) {
+    ParseStats *out = stats->out;
+    out->readNs = atomic_load(&stats->readNs);
+    out->arrayNs = stats->arrayNs;
+    out->mallocs = atomic_load(&stats->mallocs);
+    out->reallocs = atomic_load(&stats->reallocs);
+    for (size_t i = 0; i < out->fileCount; ++i) {
+        const ParseFileStats *file = &out->files[i];
+        out->bytesRead += file->bytes;
+        if (!file->depth) continue;
+        out->includes++;
+        out->includeHits += file->cached;
+        if (file->depth > out->includeDepth) out->includeDepth = file->depth;
+    }
+    if (stats->failed) fprintf(stderr, "Error: Can't allocate memory for the file list of parse statistics\n");
+    statsCountTable(out, config);
+#ifndef _WIN32
+    pthread_mutex_destroy(&stats->lock);
+#endif
+}
+
+//Whether a parsed string is a view into the source buffer of root rather than a copy of its own
+static bool inSource(const OptionTable *root, const char *s) {
+    return root->source && s >= root->source && s < root->source + root->sourceLen;
+}
+
+static void memoryCountArray(ConfigMemory *out, const OptionTable *root, const ArrayOption *array);
+
+//Adds a table and its own options, and their parsed values if values is set. Compound array elements (and the
+//compounds in them) are counted as elements
+static void memoryCountTable(ConfigMemory *out, const OptionTable *root, Option **options, bool element,
+                             bool values) {
+    const OptionTable *table = OPTION_TABLE(options);
+    size_t *tables = element ? &out->elements : &out->tables;
+    size_t *opts = element ? &out->elements : &out->options;
+    *tables += sizeof(OptionTable) + table->capacity * (sizeof(*table->hashes) + sizeof(*table->slots));
+    if (table->seeds) *tables += (table->seedMask + 1) * sizeof(*table->seeds);
+    Option *opt;
+    OWN_ITER(table, opt) {
+            //An element shares its template's defaults, an arena config's are counted by their region
+            *opts += sizeof(Option) + (table->base || root->arena ? 0 : sizeof(OptionDefault));
+            if (opt->type == COMPOUND) {
+                memoryCountTable(out, root, opt->v_v, element, values);
+            } else if (!values) {
+                continue;
+            } else if (opt->type == TEXT && opt->v_s && opt->v_s != opt->def->dv_s && !inSource(root, opt->v_s)) {
+                out->strings += opt->v_sv.len + 1;
+            } else if (opt->type == ARRAY && opt->v_a.a_l != opt->def->dv_a.a_l) {
+                memoryCountArray(out, root, &opt->v_a);
+            }
+        }
+}
+
+static void memoryCountArray(ConfigMemory *out, const OptionTable *root, const ArrayOption *array) {
+    switch (array->type) {
+        case BOOL:
+            out->arrays += array->len * sizeof(bool);
+            break;
+        case LONG:
+            out->arrays += array->len * sizeof(long);
+            break;
+        case DOUBLE:
+            out->arrays += array->len * sizeof(double);
+            break;
+        case TEXT:
+            if (root->stringViews) {
+                out->arrays += array->len * sizeof(StringView);
+                break;
+            }
+            out->arrays += array->len * sizeof(char *);
+            for (size_t i = 0; i < array->len; ++i) {
+                const char *s = array->a_s[i];
+                if (s && !inSource(root, s)) out->strings += strlen(s) + 1;
+            }
+            break;
+        case COMPOUND:
+            out->arrays += array->len * sizeof(Option **);
+            for (size_t i = 0; i < array->len; ++i) memoryCountTable(out, root, array->a_v.a_v[i], true, true);
+            break;
+        case ARRAY:
+            out->arrays += array->len * sizeof(ArrayOption);
+            for (size_t i = 0; i < array->len; ++i) memoryCountArray(out, root, &array->a_a.a_a[i]);
+            break;
+    }
+}
+
+ConfigMemory configMemory(struct Option **config) {
+    ConfigMemory out = {0};
+    const OptionTable *root = OPTION_TABLE(config);
+    if (!root) return out;
+    memoryCountTable(&out, root, config, false, true);
+    if (root->source) out.source = root->sourceLen;
+    if (settingsOf(root)->record) out.other += recordMemory(settingsOf(root)->record);
+    if (settingsOf(root)->bindings) out.other += bindingsMemory(settingsOf(root)->bindings);
+    size_t counted = out.tables + out.options + out.elements + out.strings + out.arrays;
+    const ConfigArena *arena = root->arena;
+    if (arena && root->ownsArena) {
+        size_t defaults;
+        size_t chunks = sizeof(ConfigArena) + regionSize(&arena->schema, NULL) +
+                        regionSize(&arena->defaults, &defaults) + regionSize(&arena->values, NULL);
+        out.options += defaults;
+        counted += defaults;
+        out.arenaUnused = chunks > counted ? chunks - counted : 0;
+        counted += out.arenaUnused;
+    }
+    out.total = counted + out.source + out.other;
+    return out;
+}
+
+//What a load under setMemoryLimit starts from: the config without the values of the last load
+static size_t memoryBaseline(struct Option **config) {
+    const OptionTable *root = OPTION_TABLE(config);
+    ConfigMemory memory = {0};
+    if (settingsOf(root)->record) memory.other += recordMemory(settingsOf(root)->record);
+    if (settingsOf(root)->bindings) memory.other += bindingsMemory(settingsOf(root)->bindings);
+    const ConfigArena *arena = root->arena;
+    if (arena) {
+        return memory.other + sizeof(ConfigArena) + regionSize(&arena->schema, NULL) +
+               regionSize(&arena->defaults, NULL);
+    }
+    memoryCountTable(&memory, root, config, false, false);
+    return memory.tables + memory.options + memory.other;
+}
+
+void setMemoryLimit(struct Option **config, size_t bytes) {
+    RootSettings *settings = config ? settingsFor(OPTION_TABLE(config)) : NULL;
+    if (settings) settings->memoryLimit = bytes;
+}
+
+//loadConfig, with stats NULL unless setParseStats was called
+static bool loadFile(struct Option **config, const char *filename, bool mapped, IncludeDeps *deps,
+                     StatsRecorder *stats, DiagnosticState *diag) {
+    OptionTable *root = OPTION_TABLE(config);
+    LoadRecord *record = mapped || root->arena ? NULL : settingsOf(root)->record;
+    if (record && reloadChanged(config, filename, diag)) return true;
+    if (diag) { //Fragments an incremental reload parsed are parsed again
+        diagnosticSinkReset(diag->sink);
+        diag->passed = 0;
+    }
+    beginLoad(root, mapped);
+    if (record) releaseValues(config, false); //Both kinds of reload give what a fresh config would
+
+    char *bufferOriginal = NULL;
+    size_t length = 0;
+    size_t mappedLength = 0;
+    IncludeDeps *collect = record ? &record->deps : deps;
+    if (collect) { //Stamped before reading, so a write that races the read shows up as a change
+        FileStamp stamp;
+        fileStamp(filename, &stamp);
+        depsAdd(collect, filename, &stamp);
+    }
+    uint64_t start = statsClock(stats);
+#ifndef _WIN32
+    if (mapped) {
+        bufferOriginal = mapFile(filename, &length, &mappedLength, diag);
+    } else
+#endif
+        length = readFileIn(filename, &bufferOriginal, diag);
+    if (stats) {
+        atomic_fetch_add(&stats->readNs, statsClock(stats) - start);
+        statsAddFile(stats, filename, length, 0, false);
+    }
+    if (!length) return false;
+
+    //Get path to the parent directory used to find other files which may be included
+    char *parentDirI = strrchr(filename, '/') + 1;
+    if (parentDirI == NULL + 1) parentDirI = (char *) filename;
+    char *parentDir = strndup(filename, parentDirI - filename);
+
+    //Process macros before parsing file. Diagnostics are placed with the map of an incremental reload, or one of their
+    //own; cached includes have none, so a config with an include cache goes without
+    char *buffer = NULL;
+    SourceMap diagMap = {0};
+    SourceMap *map = record ? &record->map : diag && !settingsOf(root)->includeCache ? &diagMap : NULL;
+    IncludeContext inc = {.threads = settingsOf(root)->parseThreads, .cache = settingsOf(root)->includeCache, .sourceMaps = map != NULL,
+                          .stats = stats, .diag = diag};
+    if (map) mapAddFile(map, filename, false);
+    start = statsClock(stats);
+    size_t len = preprocess(bufferOriginal, length, &buffer, parentDir, &inc, collect, map);
+    free(parentDir);
+    if (stats) {
+        stats->out->preprocessNs = statsClock(stats) - start;
+        stats->out->bytesParsed = len;
+    }
+    if (diag) diagnosticsSource(diag, filename, buffer, map && !map->failed ? map : NULL);
+
+#ifndef NDEBUG
+    FILE *fp = fopen("debug/preprocessor-output.txt", "w");
+    if (fp) {
+        fwrite(buffer, sizeof(char), len, fp);
+        fclose(fp);
+    }
+#endif
+
+    Scanner scan;
+    scannerInit(&scan, buffer, len);
+    StatementLog log = {.options = config, .base = buffer};
+    ParseContext ctx = {.file = filename, .views = mapped, .scan = &scan, .threads = settingsOf(root)->parseThreads,
+                        .log = record ? &log : NULL, .stats = stats, .diag = diag};
+    start = statsClock(stats);
+    parseConfigWhole(config, &ctx, buffer, len);
+    if (stats) stats->out->parseNs = statsClock(stats) - start;
+    mapFree(&diagMap);
+    if (record) {
+        recordStatements(record, filename, &log);
+        free(log.items);
+        if (deps) depsMerge(deps, &record->deps);
+    }
+
+    if (mapped) {
+        viewDefaultStrings(config);
+        root->stringViews = true;
+        //Views point into whichever buffer got parsed, so that one is kept until the next load or cleanOptions
+        if (buffer == bufferOriginal) {
+            root->source = bufferOriginal;
+            root->sourceLen = mappedLength;
+            root->sourceMapped = mappedLength != 0;
+            return true;
+        }
+        root->source = buffer;
+        root->sourceLen = len;
+        root->sourceMapped = false;
+#ifndef _WIN32
+        if (mappedLength) {
+            munmap(bufferOriginal, mappedLength);
+            return true;
+        }
+#endif
+        free(bufferOriginal);
+        return true;
+    }
+
+    if (buffer != bufferOriginal) free(buffer); //preprocessor hands back the original buffer if there were no macros
+    free(bufferOriginal);
+    return true;
+}
+
+//loadFile, filling in the ParseStats of setParseStats if there are any
+static bool loadCounted(struct Option **config, const char *filename, bool mapped, IncludeDeps *deps,
+                        DiagnosticState *diag) {
+    ParseStats *out = settingsOf(OPTION_TABLE(config))->stats;
+    if (!out) return loadFile(config, filename, mapped, deps, NULL, diag);
+
+    StatsRecorder stats;
+    statsStart(&stats, out);
+    uint64_t start = statsClock(&stats);
+    allocStats = &stats;
+    bool loaded = loadFile(config, filename, mapped, deps, &stats, diag);
+    allocStats = NULL;
+    out->totalNs = statsClock(&stats) - start;
+    statsFinish(&stats, config);
+    return loaded;
+}
+
+//Undoes a load that went over the memory limit and reports it
+static void limitExceeded(OptionTable *root, size_t limit, const char *filename, DiagnosticState *diag) {
+    beginLoad(root, true); //Whatever the load got through goes, every option is back at its default
+    if (!diag) {
+        fprintf(stderr, "Error: Memory limit of %zu bytes exceeded while reading '%s', config reset to its defaults\n",
+                limit, filename);
+        return;
+    }
+    //Not held back by the limits of the sink, it's the one diagnostic that says the load didn't happen
+    Diagnostic diagnostic = {.severity = DIAGNOSTIC_ERROR, .file = filename, .path = "",
+                             .message = "Memory limit exceeded, config reset to its defaults"};
+    diag->sink->errors++;
+    diag->passed++;
+    diagnosticEmit(diag->sink, &diagnostic);
+}
+
+//loadCounted under the limit of setMemoryLimit, if there is one. A load that goes over it is undone
+static bool loadLimited(struct Option **config, const char *filename, bool mapped, IncludeDeps *deps,
+                        DiagnosticState *diag) {
+    OptionTable *root = OPTION_TABLE(config);
+    if (!settingsOf(root)->memoryLimit) return loadCounted(config, filename, mapped, deps, diag);
+
+    MemoryBudget budget = {.limit = settingsOf(root)->memoryLimit};
+    atomic_init(&budget.used, memoryBaseline(config));
+    atomic_init(&budget.exceeded, false);
+    budgetEnter(&budget);
+    bool loaded = loadCounted(config, filename, mapped, deps, diag);
+    budgetEnter(NULL);
+    if (!atomic_load(&budget.exceeded)) return loaded;
+    limitExceeded(root, budget.limit, filename, diag);
+    return false;
+}
+
+//Returns false if the file couldn't be read. deps, if not NULL, gets the file and everything it includes
+static bool loadConfig(struct Option **config, const char *filename, bool mapped, IncludeDeps *deps) {
+    if (!config) {
+        fprintf(stderr, "Error: Config '%s' not yet initialized\n", filename);
+        return false;
+    }
+    DiagnosticState diag = {.sink = settingsOf(OPTION_TABLE(config))->diagnostics};
+    if (!diag.sink) return loadLimited(config, filename, mapped, deps, NULL);
+
+    diagnosticSinkReset(diag.sink);
+#ifndef _WIN32
+    pthread_mutex_init(&diag.lock, NULL);
+#endif
+    bool loaded = loadLimited(config, filename, mapped, deps, &diag);
+#ifndef _WIN32
+    pthread_mutex_destroy(&diag.lock);
+#endif
+    return loaded;
+}
+
+void readConfig(struct Option **config, const char *filename) {
+    loadConfig(config, filename, false, NULL);
+    bindValues(config);
+}
+
+void readConfigMapped(struct Option **config, const char *filename) {
+    loadConfig(config, filename, true, NULL);
+    bindValues(config);
+}
+
+void setParseStats(struct Option **config, ParseStats *stats) {
+    RootSettings *settings = config ? settingsFor(OPTION_TABLE(config)) : NULL;
+    if (settings) settings->stats = stats;
+}
+
+void parseStatsFree(ParseStats *stats) {
+    if (!stats) return;
+    statsReset(stats);
+    free(stats->files);
+    stats->files = NULL;
+    stats->fileCapacity = 0;
+}
+
+void setParseThreads(struct Option **config, unsigned threads) {
+    RootSettings *settings = config ? settingsFor(OPTION_TABLE(config)) : NULL;
+    if (settings) settings->parseThreads = threads;
+}
+
+void setIncrementalReload(struct Option **config, bool enabled) {
+    if (!config) return;
+    OptionTable *root = OPTION_TABLE(config);
+    LoadRecord *record = settingsOf(root)->record;
+    if (enabled && !record) {
+        RootSettings *settings = settingsFor(root);
+        if (!settings) return;
+        settings->record = calloc(1, sizeof(LoadRecord));
+        if (!settings->record) fprintf(stderr, "Error: Can't allocate memory for load record: %s\n", strerror(errno));
+    } else if (!enabled && record) {
+        recordClear(record);
+        free(record);
+        root->settings->record = NULL;
+    }
+}
+
+//binary cache
+
+/*
+ * A cache file is the values of a load in the byte order and type sizes of the machine that wrote it, checked by the
+ * header: the magic, the format version, sizeof long, double and bool and 0x01020304 as a uint32_t, followed by the
+ * fingerprint of the schema it was written for (see schemaFingerprint). Then come the dependencies of the load (path
+ * and FileStamp of every file and directory it was read from, the config file first) and the root table. A table is a
+ * uint64_t count and that many options: name, type and value. Strings are a uint64_t length, the bytes and a '\0', so a
+ * mapped cache can be pointed into directly. Nothing holds an address, so the file can be mapped anywhere
+ */
+#define CACHE_MAGIC "LIBCONF"
+#define CACHE_VERSION 2
+#define CACHE_ORDER 0x01020304
+
+//Fixed, unlike the key of option tables, so a fingerprint means the same in every process
+static const uint64_t fingerprintKey[2] = {0x6c6962636f6e6621ULL, 0x736368656d612121ULL};
+
+static uint64_t fingerprintMix(uint64_t hash, const void *data, size_t len) {
+    uint64_t key[2] = {fingerprintKey[0] ^ hash, fingerprintKey[1]};
+    return siphash13(key, data, len);
+}
+
+static uint64_t schemaFingerprint(Option **options);
+
+static uint64_t arrayFingerprint(const ArrayOption *array) {
+    uint64_t hash = fingerprintMix(array->type, &array->len, sizeof(array->len));
+    switch (array->type) {
+        case BOOL:
+            return fingerprintMix(hash, array->a_b, array->len * sizeof(bool));
+        case LONG:
+            return fingerprintMix(hash, array->a_l, array->len * sizeof(long));
+        case DOUBLE:
+            return fingerprintMix(hash, array->a_d, array->len * sizeof(double));
+        case TEXT:
+            for (size_t i = 0; i < array->len; ++i) {
+                hash = array->a_s[i] ? fingerprintMix(hash, array->a_s[i], strlen(array->a_s[i]) + 1)
+                                     : fingerprintMix(hash, NULL, 0);
+            }
+            return hash;
+        case COMPOUND:
+            return array->a_v.a_v_t ? hash ^ schemaFingerprint(array->a_v.a_v_t) : hash;
+        case ARRAY:
+            if (array->a_a.t) hash = fingerprintMix(hash ^ arrayFingerprint(array->a_a.t), NULL, 0);
+            for (size_t i = 0; i < array->len; ++i) {
+                hash = fingerprintMix(hash ^ arrayFingerprint(&array->a_a.a_a[i]), NULL, 0);
+            }
+            return hash;
+    }
+    return hash;
+}
+
+/*
+ * Name, type and default of every option of the table, compounds and the templates of compound arrays included. The
+ * options are summed up rather than chained, slot order depends on the per-process key of the table
+ */
+static uint64_t schemaFingerprint(Option **options) {
+    const OptionTable *table = OPTION_TABLE(options);
+    uint64_t sum = fingerprintMix(0, &table->count, sizeof(table->count));
+    Option *opt;
+    OWN_ITER(table, opt) {
+            uint64_t hash = fingerprintMix(opt->type, opt->name, strlen(opt->name));
+            switch (opt->type) {
+                case BOOL:
+                    hash = fingerprintMix(hash, &opt->def->dv_b, sizeof(bool));
+                    break;
+                case LONG:
+                    hash = fingerprintMix(hash, &opt->def->dv_l, sizeof(long));
+                    break;
+                case DOUBLE:
+                    hash = fingerprintMix(hash, &opt->def->dv_d, sizeof(double));
+                    break;
+                case TEXT:
+                    hash = fingerprintMix(hash, opt->def->dv_sv.ptr, opt->def->dv_sv.ptr ? opt->def->dv_sv.len : 0);
+                    break;
+                case COMPOUND:
+                    hash = fingerprintMix(hash ^ schemaFingerprint(opt->v_v), NULL, 0);
+                    break;
+                case ARRAY:
+                    hash = fingerprintMix(hash ^ arrayFingerprint(&opt->def->dv_a), NULL, 0);
+                    break;
+            }
+            sum += hash;
+        }
+    return sum;
+}
+
+//The cache file is built in memory first, then written out in one go
+typedef struct CacheWriter {
+    char *data;
+    size_t len;
+    size_t capacity;
+    bool failed;
+} CacheWriter;
+
+static void cachePut(CacheWriter *w, const void *data, size_t len) {
+    if (w->failed) return;
+    if (w->capacity - w->len < len) {
+        size_t capacity = w->capacity ? w->capacity : 4096;
+        while (capacity - w->len < len) capacity *= 2;
+        char *tmp = realloc(w->data, capacity);
+        if (!tmp) {
+            w->failed = true;
+            return;
+        }
+        w->data = tmp;
+        w->capacity = capacity;
+    }
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
+}
+
+static void cachePutU8(CacheWriter *w, uint8_t value) {
+    cachePut(w, &value, sizeof(value));
+}
+
+static void cachePutU64(CacheWriter *w, uint64_t value) {
+    cachePut(w, &value, sizeof(value));
+}
+
+static void cachePutString(CacheWriter *w, const char *s, size_t len) {
+    cachePutU64(w, len);
+    cachePut(w, s, len);
+    cachePutU8(w, 0);
+}
+
+static void cachePutTable(CacheWriter *w, Option **options);
+
+static void cachePutArray(CacheWriter *w, const ArrayOption *array) {
+    cachePutU8(w, array->type);
+    cachePutU64(w, array->len);
+    switch (array->type) {
+        case BOOL:
+            cachePut(w, array->a_b, array->len * sizeof(bool));
+            break;
+        case LONG:
+            cachePut(w, array->a_l, array->len * sizeof(long));
+            break;
+        case DOUBLE:
+            cachePut(w, array->a_d, array->len * sizeof(double));
+            break;
+        case TEXT:
+            for (size_t i = 0; i < array->len; ++i) {
+                if (!array->a_s[i]) w->failed = true;
+                else cachePutString(w, array->a_s[i], strlen(array->a_s[i]));
+            }
+            break;
+        case COMPOUND:
+            for (size_t i = 0; i < array->len; ++i) cachePutTable(w, array->a_v.a_v[i]);
+            break;
+        case ARRAY:
+            for (size_t i = 0; i < array->len; ++i) cachePutArray(w, &array->a_a.a_a[i]);
+            break;
+    }
+}
+
+/*
+ * Strings and arrays the file didn't set are left out, a cached load starts from the defaults. Scalars are always
+ * written, whether a value is a default the file didn't set is only known while the schema's defaults stay the same,
+ * which the fingerprint in the header makes sure of. Compound array elements only have the options their `{...}` set,
+ * the rest is still shared with the template when they are loaded back
+ */
+static void cachePutTable(CacheWriter *w, Option **options) {
+    size_t countAt = w->len;
+    uint64_t count = 0;
+    cachePutU64(w, 0);
+    Option *opt;
+    OWN_ITER(OPTION_TABLE(options), opt) {
+            if (opt->type == TEXT && opt->v_s == opt->def->dv_s) continue;
+            if (opt->type == ARRAY && opt->v_a.a_l == opt->def->dv_a.a_l) continue;
+            cachePutString(w, opt->name, strlen(opt->name));
+            cachePutU8(w, opt->type);
+            switch (opt->type) {
+                case BOOL:
+                    cachePutU8(w, opt->v_b);
+                    break;
+                case LONG:
+                    cachePut(w, &opt->v_l, sizeof(long));
+                    break;
+                case DOUBLE:
+                    cachePut(w, &opt->v_d, sizeof(double));
+                    break;
+                case TEXT:
+                    cachePutString(w, opt->v_sv.ptr, opt->v_sv.len);
+                    break;
+                case COMPOUND:
+                    cachePutTable(w, opt->v_v);
+                    break;
+                case ARRAY:
+                    cachePutArray(w, &opt->v_a);
+                    break;
+            }
+            count++;
+        }
+    if (!w->failed) memcpy(w->data + countAt, &count, sizeof(count));
+}
+
+static void cachePutStamp(CacheWriter *w, const FileStamp *stamp) {
+    cachePutU64(w, stamp->dev);
+    cachePutU64(w, stamp->ino);
+    cachePutU64(w, stamp->size);
+    cachePutU64(w, stamp->mtimeNs);
+    cachePutU8(w, stamp->exists);
+    cachePutU8(w, stamp->regular);
+}
+
+//Written to a temporary file that is renamed over cachePath, so a reader never maps half a cache
+static void writeCache(Option **config, const IncludeDeps *deps, const char *cachePath) {
+    CacheWriter w = {0};
+    uint32_t header[2] = {CACHE_VERSION, CACHE_ORDER};
+    cachePut(&w, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    cachePut(&w, header, sizeof(header));
+    cachePutU8(&w, sizeof(long));
+    cachePutU8(&w, sizeof(double));
+    cachePutU8(&w, sizeof(bool));
+    cachePutU64(&w, schemaFingerprint(config));
+    cachePutU64(&w, deps->count);
+    for (size_t i = 0; i < deps->count; ++i) {
+        cachePutString(&w, deps->items[i].path, strlen(deps->items[i].path));
+        cachePutStamp(&w, &deps->items[i].stamp);
+    }
+    cachePutTable(&w, config);
+    if (w.failed) {
+        fprintf(stderr, "Error: Can't allocate memory for cache '%s': %s\n", cachePath, strerror(errno));
+        free(w.data);
+        return;
+    }
+
+    size_t pathLen = strlen(cachePath);
+    char *tmpPath = malloc(pathLen + sizeof(".tmp"));
+    if (!tmpPath) {
+        free(w.data);
+        return;
+    }
+    memcpy(tmpPath, cachePath, pathLen);
+    memcpy(tmpPath + pathLen, ".tmp", sizeof(".tmp"));
+    FILE *fp = fopen(tmpPath, "wb");
+    bool written = fp && fwrite(w.data, 1, w.len, fp) == w.len;
+    if (fp && fclose(fp)) written = false;
+#ifdef _WIN32
+    if (written) remove(cachePath); //rename doesn't replace an existing file on Windows
+#endif
+    if (!written || rename(tmpPath, cachePath)) {
+        fprintf(stderr, "Error: Can't write cache '%s': '%s'\n", cachePath, strerror(errno));
+        remove(tmpPath);
+    }
+    free(tmpPath);
+    free(w.data);
+}
+
+//Bounds checked reads from a cache file, a cache that ends early or doesn't fit the schema is just not used
+typedef struct CacheReader {
+    char *pos;
+    char *end;
+    ConfigArena *arena;
+} CacheReader;
+
+static bool cacheGet(CacheReader *r, void *out, size_t len) {
+    if ((size_t) (r->end - r->pos) < len) return false;
+    memcpy(out, r->pos, len);
+    r->pos += len;
+    return true;
+}
+
+static bool cacheGetU8(CacheReader *r, uint8_t *out) {
+    return cacheGet(r, out, sizeof(*out));
+}
+
+static bool cacheGetU64(CacheReader *r, uint64_t *out) {
+    return cacheGet(r, out, sizeof(*out));
+}
+
+//Points into the cache instead of copying, the string is null-terminated there
+static bool cacheGetString(CacheReader *r, char **out, size_t *len) {
+    uint64_t n;
+    if (!cacheGetU64(r, &n) || (uint64_t) (r->end - r->pos) <= n || r->pos[n] != '\0') return false;
+    *out = r->pos;
+    *len = n;
+    r->pos += n + 1;
+    return true;
+}
+
+static bool cacheGetStamp(CacheReader *r, FileStamp *stamp) {
+    uint8_t exists, regular;
+    if (!cacheGetU64(r, &stamp->dev) || !cacheGetU64(r, &stamp->ino) || !cacheGetU64(r, &stamp->size) ||
+        !cacheGetU64(r, &stamp->mtimeNs) || !cacheGetU8(r, &exists) || !cacheGetU8(r, &regular)) {
+        return false;
+    }
+    stamp->exists = exists;
+    stamp->regular = regular;
+    return true;
+}
+
+static bool cacheGetTable(CacheReader *r, Option **options);
+
+/*
+ * Reads an array into array, which holds the schema's array (for the templates of compound elements and nested
+ * arrays). Typed arrays are copied out of the cache, a parsed array is freed like any other. Every step leaves array
+ * in a state releaseValues can clean up, so a cache that turns out to be broken halfway is simply released
+ */
+static bool cacheGetArray(CacheReader *r, ArrayOption *array) {
+    uint8_t type;
+    uint64_t len;
+    if (!cacheGetU8(r, &type) || type != array->type || !cacheGetU64(r, &len)) return false;
+    if (len > (uint64_t) (r->end - r->pos)) return false; //Every element takes at least a byte
+    size_t elementSize;
+    switch (type) {
+        case BOOL:
+            elementSize = sizeof(bool);
+            break;
+        case LONG:
+            elementSize = sizeof(long);
+            break;
+        case DOUBLE:
+            elementSize = sizeof(double);
+            break;
+        case TEXT:
+            elementSize = sizeof(char *);
+            break;
+        case COMPOUND:
+            elementSize = sizeof(Option **);
+            break;
+        case ARRAY:
+            elementSize = sizeof(ArrayOption);
+            break;
+        default:
+            return false;
+    }
+    void *data = valueAlloc(r->arena, (len ? len : 1) * elementSize);
+    if (!data) return false;
+    array->a_l = data;
+    array->len = 0;
+    switch (type) {
+        case BOOL:
+        case LONG:
+        case DOUBLE:
+            if (!cacheGet(r, data, len * elementSize)) return false;
+            array->len = len;
+            break;
+        case TEXT:
+            for (uint64_t i = 0; i < len; ++i) {
+                size_t n;
+                if (!cacheGetString(r, &array->a_s[i], &n)) return false;
+                array->len++;
+            }
+            break;
+        case COMPOUND:
+            for (uint64_t i = 0; i < len; ++i) {
+                //Every element starts out sharing the template's options, like a parsed one
+                array->a_v.a_v[i] = optionTableOverlayIn(array->a_v.a_v_t, r->arena);
+                if (!array->a_v.a_v[i]) return false;
+                array->len++;
+                if (!cacheGetTable(r, array->a_v.a_v[i])) return false;
+            }
+            break;
+        case ARRAY:
+            for (uint64_t i = 0; i < len; ++i) {
+                ArrayOption *inner = &array->a_a.a_a[i];
+                *inner = *array->a_a.t;
+                inner->a_l = NULL;
+                inner->len = 0;
+                array->len++;
+                if (!cacheGetArray(r, inner)) return false;
+            }
+            break;
+    }
+    return true;
+}
+
+static bool cacheGetTable(CacheReader *r, Option **options) {
+    uint64_t count;
+    if (!cacheGetU64(r, &count)) return false;
+    for (uint64_t i = 0; i < count; ++i) {
+        char *name;
+        size_t nameLen;
+        uint8_t type;
+        if (!cacheGetString(r, &name, &nameLen) || !cacheGetU8(r, &type)) return false;
+        Option *opt = optionTableFindWritable(options, name, nameLen);
+        if (!opt || opt->type != type) return false;
+        switch (opt->type) {
+            case BOOL: {
+                uint8_t value;
+                if (!cacheGetU8(r, &value)) return false;
+                opt->v_b = value;
+                break;
+            }
+            case LONG:
+                if (!cacheGet(r, &opt->v_l, sizeof(long))) return false;
+                break;
+            case DOUBLE:
+                if (!cacheGet(r, &opt->v_d, sizeof(double))) return false;
+                break;
+            case TEXT: {
+                char *s;
+                size_t len;
+                if (!cacheGetString(r, &s, &len)) return false;
+                opt->v_sv = (StringView) {s, len};
+                break;
+            }
+            case COMPOUND:
+                if (!cacheGetTable(r, opt->v_v)) return false;
+                break;
+            case ARRAY:
+                if (!cacheGetArray(r, &opt->v_a)) return false;
+                break;
+        }
+    }
+    return true;
+}
+
+//Maps the cache privately, like mapFile, so values can be written to without touching the file. Quiet if it's missing
+static char *mapCache(const char *cachePath, size_t *length) {
+#ifndef _WIN32
+    int fd = open(cachePath, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    char *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    *length = st.st_size;
+    return data;
+#else
+    FILE *fp = fopen(cachePath, "rb");
+    if (!fp) return NULL;
+    size_t size = getFileSize(cachePath);
+    char *data = size ? malloc(size) : NULL;
+    if (!data || fread(data, 1, size, fp) != size) {
+        free(data);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    *length = size;
+    return data;
+#endif
+}
+
+//Loads the cache if it was written for filename and nothing it was read from changed since. Options must be at their
+//defaults
+static bool loadCache(Option **config, const char *filename, const char *cachePath) {
+    OptionTable *root = OPTION_TABLE(config);
+    size_t length = 0;
+    char *data = mapCache(cachePath, &length);
+    if (!data) return false;
+    CacheReader r = {data, data + length, root->arena};
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t header[2];
+    uint8_t sizes[3];
+    uint64_t fingerprint, depCount;
+    bool current = cacheGet(&r, magic, sizeof(magic)) && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0 &&
+                   cacheGet(&r, header, sizeof(header)) && header[0] == CACHE_VERSION && header[1] == CACHE_ORDER &&
+                   cacheGet(&r, sizes, sizeof(sizes)) && sizes[0] == sizeof(long) && sizes[1] == sizeof(double) &&
+                   sizes[2] == sizeof(bool) && cacheGetU64(&r, &fingerprint) &&
+                   fingerprint == schemaFingerprint(config) && cacheGetU64(&r, &depCount) && depCount > 0;
+    for (uint64_t i = 0; current && i < depCount; ++i) {
+        char *path;
+        size_t pathLen;
+        FileStamp stamp, now;
+        current = cacheGetString(&r, &path, &pathLen) && cacheGetStamp(&r, &stamp) &&
+                  (i > 0 || strcmp(path, filename) == 0);
+        if (!current) break;
+        fileStamp(path, &now);
+        current = stampEqual(&stamp, &now);
+    }
+
+    //Strings point into the cache, so it's kept like the source of a mapped load from here on
+    root->source = data;
+    root->sourceLen = length;
+#ifndef _WIN32
+    root->sourceMapped = true;
+#endif
+    if (current && cacheGetTable(&r, config) && r.pos == r.end) return true;
+    beginLoad(root, true);
+    return false;
+}
+
+bool readConfigCached(struct Option **config, const char *filename, const char *cachePath) {
+    if (!config) {
+        fprintf(stderr, "Error: Config '%s' not yet initialized\n", filename);
+        return false;
+    }
+    beginLoad(OPTION_TABLE(config), true); //A cached load starts from the defaults, so a parsed one does too
+    if (loadCache(config, filename, cachePath)) {
+        bindValues(config);
+        return true;
+    }
 
-                char *multiLineEnd = strchr(stringStart, searchChar);
-                if (!multiLineEnd) {
-                    fprintf(stderr, "Error at option %s:%s: String must end with ' or \"\n", file, optName);
-                    break;
-                }
+    IncludeDeps deps = {0};
+    if (loadConfig(config, filename, false, &deps) && !deps.uncacheable) writeCache(config, &deps, cachePath);
+    depsFree(&deps);
+    bindValues(config);
+    return false;
+}
 
-                buffer = strchrnul_(multiLineEnd, '\n') + 1;
-                lineEnd = buffer;
-                if (*(multiLineEnd - 1) == '\n') multiLineEnd--;
+//push parser
 
-                optOut->v_s = strndup(stringStart, multiLineEnd - stringStart);
-                if (buffer == 1 || !buffer) {
-                    free(optName);
-                    return;
-                }
-                goto loopEndR;
-            }
-            case LONG: {
-                char *endPtr = NULL;
-                char *start = NULL;
-                trimnp(assignIndex + 1, endValueIndex, &start);
-                long tempL = strtol(start, &endPtr, 10);
-                if (endPtr == start) {
-                    //error
-                    fprintf(stderr, "Error at option %s:%s: Invalid long \n", file, optName);
-                    optOut->v_l = optOut->dv_l;
-                } else {
-                    optOut->v_l = tempL;
-                }
+struct ConfigParser {
+    Option **config;
+    ParseContext ctx;
+    char *includeDir;
+    char *buffer; //Statements that haven't been parsed yet, the last of them usually incomplete
+    size_t len;
+    size_t capacity;
+    size_t scanned; //How much of buffer the statement scanner has looked at
+    size_t complete; //Where the last complete statement in buffer ends
+    //Scanner state of the statement in progress, kept between feeds so nothing is scanned twice
+    int depth; //Open [ and { of the value
+    char quote; //Quote the value is currently inside of, 0 if none
+    bool assigned; //'=' seen
+    bool comment; //Inside a // comment
+    StatsRecorder stats; //Of setParseStats, stats.out is NULL without
+    size_t fed; //Bytes fed so far, the size of the file in stats
+    DiagnosticState diag; //Of setDiagnosticSink, ctx.diag points here if there is a sink
+    size_t lines; //Parsed so far, where the next batch starts in the file
+    MemoryBudget budget; //Of setMemoryLimit, budget.limit is 0 without
+};
+
+ConfigParser *configParserCreate(Option **config, const char *name, const char *includeDir) {
+    if (!config) {
+        fprintf(stderr, "Error: Config '%s' not yet initialized\n", name);
+        return NULL;
+    }
+    ConfigParser *parser = calloc(1, sizeof(ConfigParser));
+    if (!parser) {
+        fprintf(stderr, "Error: Can't allocate memory for config parser: %s\n", strerror(errno));
+        return NULL;
+    }
+    parser->config = config;
+    parser->ctx.file = name;
+    parser->ctx.views = false;
+    parser->ctx.threads = settingsOf(OPTION_TABLE(config))->parseThreads;
+    parser->includeDir = strdup(includeDir ? includeDir : "");
+    if (settingsOf(OPTION_TABLE(config))->stats) { //The file goes first, its size is filled in once it's all there
+        statsStart(&parser->stats, settingsOf(OPTION_TABLE(config))->stats);
+        statsAddFile(&parser->stats, name, 0, 0, false);
+    }
+    parser->diag.sink = settingsOf(OPTION_TABLE(config))->diagnostics;
+    if (parser->diag.sink) {
+        diagnosticSinkReset(parser->diag.sink);
+#ifndef _WIN32
+        pthread_mutex_init(&parser->diag.lock, NULL);
+#endif
+        parser->ctx.diag = &parser->diag;
+    }
+    parser->budget.limit = settingsOf(OPTION_TABLE(config))->memoryLimit;
+    atomic_init(&parser->budget.used, parser->budget.limit ? memoryBaseline(config) : 0);
+    atomic_init(&parser->budget.exceeded, false);
+    beginLoad(OPTION_TABLE(config), false);
+    return parser;
+}
+
+/*
+ * Advances the scanner over new data and moves parser->complete to the end of the last statement that is complete.
+ * A statement ends at the first new line that isn't inside a string, array or compound value. If the data ends
+ * right after a '/', scanning stops there until the next feed shows whether it starts a comment.
+ */
+static void scanStatements(ConfigParser *parser, bool last) {
+    size_t i = parser->scanned;
+    for (; i < parser->len; ++i) {
+        char c = parser->buffer[i];
+        if (parser->comment) {
+            if (c != '\n') continue;
+            parser->comment = false;
+        } else if (parser->quote) {
+            if (c == parser->quote) parser->quote = 0;
+            continue;
+        }
+
+        switch (c) {
+            case '/':
+                if (i + 1 == parser->len && !last) goto out;
+                if (i + 1 < parser->len && parser->buffer[i + 1] == '/') parser->comment = true;
                 break;
-            }
-            case DOUBLE: {
-                char *endPtr = NULL;
-                char *start = NULL;
-                trimnp(assignIndex + 1, endValueIndex, &start);
-                double tempD = strtod(start, &endPtr);
-                if (endPtr == start) {
-                    //error
-                    fprintf(stderr, "Error at option %s:%s: Invalid double\n", file, optName);
-                    optOut->v_d = optOut->dv_d;
-                } else {
-                    optOut->v_d = tempD;
-                }
+            case '=':
+                parser->assigned = true;
                 break;
-            }
-            case BOOL: {
-                char *start = NULL;
-                trimnp(assignIndex + 1, endValueIndex, &start);
-                if (!strncasecmp(start, "true", 4) || !strncasecmp(start, "yes", 3)) {
-                    optOut->v_b = true;
-                    break;
-                } else if (!(!strncasecmp(start, "false", 5) || !strncasecmp(start, "no", 2))) {
-                    fprintf(stderr, "Error at option %s:%s: Invalid boolean. Must be true, false, yes or no\n",
-                            file, optName);
-                    optOut->v_b = optOut->dv_b;
-                    break;
+            case '"':
+            case '\'':
+                if (parser->assigned) parser->quote = c;
+                break;
+            case '[':
+            case '{':
+                if (parser->assigned) parser->depth++;
+                break;
+            case ']':
+            case '}':
+                if (parser->assigned && parser->depth > 0) parser->depth--;
+                break;
+            case '\n':
+                if (parser->depth == 0) {
+                    parser->complete = i + 1;
+                    parser->assigned = false;
                 }
-                optOut->v_b = false;
+                break;
+            default:
+                break;
+        }
+    }
+    out:
+    parser->scanned = i;
+}
+
+//Parses buffer[0, end) and drops it from the buffer
+static void parseStatements(ConfigParser *parser, size_t end) {
+    if (!end) return;
+    char saved = parser->buffer[end];
+    parser->buffer[end] = '\0'; //parseConfigWhole and the preprocessor rely on null termination
+
+    StatsRecorder *stats = parser->ctx.stats;
+    DiagnosticState *diag = parser->ctx.diag;
+    IncludeCache *cache = settingsOf(OPTION_TABLE(parser->config))->includeCache;
+    char *buffer = parser->buffer;
+    size_t len = end;
+    SourceMap diagMap = {0}; //Like loadFile's, only needed if an #include adds lines
+    SourceMap *map = NULL;
+    uint64_t start = statsClock(stats);
+    if (memchr(parser->buffer, '#', end)) {
+        map = diag && !cache ? &diagMap : NULL;
+        IncludeContext inc = {.threads = parser->ctx.threads, .cache = cache, .sourceMaps = map != NULL,
+                              .stats = stats, .diag = diag};
+        if (map) mapAddFile(map, parser->ctx.file, false);
+        len = preprocess(parser->buffer, end, &buffer, parser->includeDir, &inc, NULL, map);
+    }
+    if (stats) {
+        stats->out->preprocessNs += statsClock(stats) - start;
+        stats->out->bytesParsed += len;
+    }
+    if (diag) {
+        diagnosticsSource(diag, parser->ctx.file, buffer, map && !map->failed ? map : NULL);
+        diag->firstLine = diag->lastLine = parser->lines + 1;
+    }
+    Scanner scan;
+    scannerInit(&scan, buffer, len);
+    parser->ctx.scan = &scan;
+    start = statsClock(stats);
+    parseConfigWhole(parser->config, &parser->ctx, buffer, len);
+    if (stats) stats->out->parseNs += statsClock(stats) - start;
+    mapFree(&diagMap);
+    if (buffer != parser->buffer) free(buffer);
+    if (diag) parser->lines += countLines(parser->buffer, parser->buffer + end);
+
+    parser->buffer[end] = saved;
+    memmove(parser->buffer, parser->buffer + end, parser->len - end);
+    parser->len -= end;
+    parser->scanned -= end;
+    parser->complete = 0;
+}
+
+//Puts this thread on the load of parser for one feed or finish, NULL leaves it again. Returns when it entered
+static uint64_t parserEnter(ConfigParser *parser) {
+    StatsRecorder *stats = parser && parser->stats.out ? &parser->stats : NULL;
+    allocStats = stats;
+    budgetEnter(parser && parser->budget.limit ? &parser->budget : NULL);
+    if (parser) parser->ctx.stats = stats;
+    return statsClock(stats);
+}
+
+//parserEnter(NULL), with the time since start added to totalNs. Time between feeds isn't the parser's, and neither is
+//the rest of this thread's grant, which goes back to the budget so small feeds don't use it up
+static void parserLeave(ConfigParser *parser, uint64_t start) {
+    StatsRecorder *stats = parser->ctx.stats;
+    if (stats) stats->out->totalNs += statsClock(stats) - start;
+    if (allocBudget) atomic_fetch_sub_explicit(&allocBudget->used, budgetLeft, memory_order_relaxed);
+    parserEnter(NULL);
+}
+
+bool configParserFeed(ConfigParser *parser, const char *data, size_t len) {
+    if (!parser || atomic_load(&parser->budget.exceeded)) return false;
+    uint64_t start = parserEnter(parser);
+    if (parser->len + len + 2 > parser->capacity) { //Room for the trailing new line and null terminator
+        size_t capacity = parser->capacity ? parser->capacity : 4096;
+        while (capacity < parser->len + len + 2) capacity *= 2;
+        if (!budgetTake(capacity - parser->capacity)) {
+            parserLeave(parser, start);
+            return false;
+        }
+        char *tmp = realloc(parser->buffer, capacity);
+        if (!tmp) {
+            fprintf(stderr, "Error: Can't allocate memory for config parser buffer: %s\n", strerror(errno));
+            parserLeave(parser, start);
+            return false;
+        }
+        STATS_COUNT(reallocs, 1);
+        parser->buffer = tmp;
+        parser->capacity = capacity;
+    }
+    memcpy(parser->buffer + parser->len, data, len);
+    parser->len += len;
+    parser->fed += len;
+
+    scanStatements(parser, false);
+    parseStatements(parser, parser->complete);
+    parserLeave(parser, start);
+    return !atomic_load(&parser->budget.exceeded);
+}
+
+void configParserFinish(ConfigParser *parser) {
+    if (!parser) return;
+    uint64_t start = parserEnter(parser);
+    if (parser->len && !atomic_load(&parser->budget.exceeded)) {
+        //Whatever is left is parsed as is, an unterminated value gets the same errors readConfig would report
+        if (parser->buffer[parser->len - 1] != '\n') parser->buffer[parser->len++] = '\n';
+        scanStatements(parser, true);
+        parseStatements(parser, parser->len);
+    }
+    StatsRecorder *stats = parser->ctx.stats;
+    parserLeave(parser, start);
+    if (stats) {
+        ParseStats *out = stats->out;
+        if (out->fileCount && !out->files[0].depth) out->files[0].bytes = parser->fed; //Includes are deeper
+        statsFinish(stats, parser->config);
+    }
+    if (atomic_load(&parser->budget.exceeded)) {
+        limitExceeded(OPTION_TABLE(parser->config), parser->budget.limit, parser->ctx.file, parser->ctx.diag);
+    }
+#ifndef _WIN32
+    if (parser->ctx.diag) pthread_mutex_destroy(&parser->diag.lock);
+#endif
+    bindValues(parser->config);
+    free(parser->includeDir);
+    free(parser->buffer);
+    free(parser);
+}
+
+//writer
+
+#define WRITER_FLUSH (64 * 1024) //Bytes a file or fd writer collects before handing them over, at statement boundaries
+
+/*
+ * All output goes through one growing buffer. Values are formatted straight into it, a file or fd sink gets the
+ * buffer whenever a top level statement ends with at least WRITER_FLUSH bytes in it. An option with a value the
+ * syntax can't express is taken back out of the buffer, which is why flushing waits for a statement boundary
+ */
+typedef struct ConfigWriter {
+    char *data;
+    size_t len;
+    size_t capacity;
+    FILE *file; //Sink, NULL if it's fd or memory
+    int fd; //Sink if file is NULL, -1 for memory
+    bool views; //String arrays hold StringViews, see OptionTable.stringViews
+    bool failed; //Out of memory or a write failed, nothing more is written
+    bool skipped; //An option was left out
+} ConfigWriter;
+
+static void writerFlush(ConfigWriter *w) {
+    if (w->failed || (!w->file && w->fd < 0)) return;
+    if (w->file) {
+        if (fwrite(w->data, 1, w->len, w->file) != w->len) w->failed = true;
+    } else {
+        for (size_t done = 0; done < w->len;) {
+#ifndef _WIN32
+            ssize_t n = write(w->fd, w->data + done, w->len - done);
+#else
+            int n = _write(w->fd, w->data + done, (unsigned) (w->len - done));
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                w->failed = true;
                 break;
             }
-            case COMPOUND: {
-                char *compoundStart = strchr(assignIndex + 1, '{');
-                if (!compoundStart || compoundStart > endValueIndex) {
-                    fprintf(stderr, "Error at option %s:%s: Compound must start with '{'\n", file, optName);
-                    optOut->v_v = optOut->dv_v;
+            done += n;
+        }
+    }
+    if (w->failed) fprintf(stderr, "Error: Can't write config: '%s'\n", strerror(errno));
+    w->len = 0;
+}
 
-                    free(optName);
-                    return;
-                }
-                int openCount = 1;
-                char *compoundEnd = NULL;
-                for (char *i = compoundStart + 1; i < compoundStart + length; ++i) {
-                    if (*i == '{') openCount++;
-                    if (*i == '}') openCount--;
-                    if (!openCount) {
-                        compoundEnd = i;
-                        break;
-                    }
-                }
-                if (openCount) {
-                    fprintf(stderr, "Error at option %s:%s: Compound must end with '}'\n", file, optName);
+//Room for n more bytes at data + len, NULL once the writer failed
+static char *writerReserve(ConfigWriter *w, size_t n) {
+    if (w->failed) return NULL;
+    if (w->capacity - w->len >= n) return w->data + w->len;
+    size_t capacity = w->capacity ? w->capacity : WRITER_FLUSH * 2;
+    while (capacity - w->len < n) capacity *= 2;
+    char *tmp = realloc(w->data, capacity);
+    if (!tmp) {
+        fprintf(stderr, "Error: Can't allocate memory for config writer: %s\n", strerror(errno));
+        w->failed = true;
+        return NULL;
+    }
+    w->data = tmp;
+    w->capacity = capacity;
+    return w->data + w->len;
+}
 
-                    free(optName);
-                    return;
-                }
+static void writerPut(ConfigWriter *w, const char *s, size_t n) {
+    char *out = writerReserve(w, n);
+    if (!out) return;
+    memcpy(out, s, n);
+    w->len += n;
+}
 
-                parseConfigWhole(optOut->v_v, file, compoundStart + 1, compoundEnd - compoundStart + 1);
-                buffer = strchrnul_(compoundEnd, '\n');
-                if (!buffer) {
-                    free(optName);
-                    return;
-                }
-                lineEnd = buffer;
+static void writerIndent(ConfigWriter *w, unsigned depth) {
+    char *out = writerReserve(w, depth * 4);
+    if (!out) return;
+    memset(out, ' ', depth * 4);
+    w->len += depth * 4;
+}
+
+static const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354"
+        "555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+//Digits of value, written backwards from end. Returns where they start
+static char *formatDigits(char *end, uint64_t value) {
+    while (value >= 100) {
+        end -= 2;
+        memcpy(end, digitPairs + value % 100 * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        end -= 2;
+        memcpy(end, digitPairs + value * 2, 2);
+    } else {
+        *--end = (char) ('0' + value);
+    }
+    return end;
+}
+
+static void writerPutLong(ConfigWriter *w, long value) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = formatDigits(end, value < 0 ? 0 - (uint64_t) value : (uint64_t) value);
+    if (value < 0) *--start = '-';
+    writerPut(w, start, end - start);
+}
+
+//Writes count digits (no trailing zeros) as a number whose first digit is at 10^exponent. Like %g: positional for
+//exponents from -5 to 16, d.ddde<exponent> otherwise. Either way parseDouble reads the digits as one integer mantissa
+static char *formatDecimal(char *p, const char *digits, int count, int exponent) {
+    if (exponent < -5 || exponent > 16) {
+        *p++ = digits[0];
+        if (count > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, count - 1);
+            p += count - 1;
+        }
+        *p++ = 'e';
+        if (exponent < 0) *p++ = '-';
+        char buffer[8];
+        char *end = buffer + sizeof(buffer);
+        char *start = formatDigits(end, exponent < 0 ? -exponent : exponent);
+        memcpy(p, start, end - start);
+        return p + (end - start);
+    }
+    if (exponent < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -exponent - 1);
+        p += -exponent - 1;
+        memcpy(p, digits, count);
+        return p + count;
+    }
+    if (count <= exponent + 1) { //Integral, the point keeps it recognizable as a double
+        memcpy(p, digits, count);
+        memset(p + count, '0', exponent + 1 - count);
+        p += exponent + 1;
+        memcpy(p, ".0", 2);
+        return p + 2;
+    }
+    memcpy(p, digits, exponent + 1);
+    p += exponent + 1;
+    *p++ = '.';
+    memcpy(p, digits + exponent + 1, count - exponent - 1);
+    return p + count - exponent - 1;
+}
+
+/*
+ * Doubles with few decimal places (value = m / 10^k for an integer m below 2^53) are written as the digits of m,
+ * k of them after the point: parseDouble reads that back with the same division, so it comes out as the same double.
+ * The smallest k that works is used, so there are no trailing zeros. Anything else gets 17 significant digits from one
+ * snprintf, which always read back the same, or 16 if those do
+ */
+static void writerPutDouble(ConfigWriter *w, double value) {
+    char text[48];
+    char *p = text;
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (value != value || value == HUGE_VAL) {
+        memcpy(p, value != value ? "nan" : "inf", 3);
+        writerPut(w, text, p - text + 3);
+        return;
+    }
+    for (int k = 0; k <= 22; ++k) {
+        double scaled = value * powersOf10[k];
+        if (scaled >= 9007199254740992.0) break;
+        uint64_t m = (uint64_t) (scaled + 0.5);
+        if ((double) m / powersOf10[k] != value) continue;
+
+        char digits[24];
+        char *end = digits + sizeof(digits);
+        char *start = formatDigits(end, m);
+        int count = (int) (end - start);
+        int exponent = count - k - 1;
+        while (count > 1 && start[count - 1] == '0') count--;
+        p = formatDecimal(p, start, count, exponent);
+        writerPut(w, text, p - text);
+        return;
+    }
+
+    //d.dddddddddddddddde[+-]x, the point is whatever the locale uses
+    char printed[40];
+    snprintf(printed, sizeof(printed), "%.16e", value);
+    char digits[18];
+    int count = 0;
+    char *c = printed;
+    for (; *c && *c != 'e'; ++c) {
+        if (*c >= '0' && *c <= '9' && count < 17) digits[count++] = *c;
+    }
+    int exponent = *c ? atoi(c + 1) : 0;
+
+    //Rounded to 16 digits, with the carry that can ripple all the way up
+    char shorter[17];
+    int shorterExponent = exponent;
+    memcpy(shorter, digits, 16);
+    if (digits[16] >= '5') {
+        int i = 15;
+        while (i >= 0 && shorter[i] == '9') shorter[i--] = '0';
+        if (i >= 0) {
+            shorter[i]++;
+        } else {
+            shorter[0] = '1';
+            shorterExponent++;
+        }
+    }
+    int shorterCount = 16;
+    while (shorterCount > 1 && shorter[shorterCount - 1] == '0') shorterCount--;
+    char *end = formatDecimal(p, shorter, shorterCount, shorterExponent);
+    *end = '\0';
+    char *parsedEnd;
+    if (parseDouble(p, &parsedEnd) != value) {
+        while (count > 1 && digits[count - 1] == '0') count--;
+        end = formatDecimal(p, digits, count, exponent);
+    }
+    writerPut(w, text, end - text);
+}
+
+/*
+ * Strings can't hold escapes, so one with both kinds of quote can't be written, and neither can one with a line that
+ * starts with # after blanks, which the preprocessor would expand as a macro. Inside a compound, where the end of
+ * the compound is found by counting braces, the braces of a string have to pair up. A new line right after the opening
+ * or before the closing quote is dropped by the parser, a string that starts or ends with one gets another
+ */
+static bool writerPutString(ConfigWriter *w, const char *s, size_t len, bool nested) {
+    if (!s) return false;
+    char quote = '"';
+    if (memchr(s, '"', len)) {
+        if (memchr(s, '\'', len)) return false;
+        quote = '\'';
+    }
+    for (const char *line = memchr(s, '\n', len); line; line = memchr(line, '\n', s + len - line)) {
+        while (++line < s + len && isspace((unsigned char) *line) && *line != '\n') {}
+        if (line < s + len && *line == '#') return false;
+    }
+    if (nested && (memchr(s, '{', len) || memchr(s, '}', len))) {
+        long open = 0;
+        for (size_t i = 0; i < len && open >= 0; ++i) open += s[i] == '{' ? 1 : s[i] == '}' ? -1 : 0;
+        if (open != 0) return false;
+    }
+    bool leading = len && s[0] == '\n', trailing = len && s[len - 1] == '\n';
+    char *out = writerReserve(w, len + 4);
+    if (!out) return true;
+    *out++ = quote;
+    if (leading) *out++ = '\n';
+    memcpy(out, s, len);
+    out += len;
+    if (trailing) *out++ = '\n';
+    *out = quote;
+    w->len += len + 2 + leading + trailing;
+    return true;
+}
+
+static int compareOptionNames(const void *a, const void *b) {
+    return strcmp((*(Option *const *) a)->name, (*(Option *const *) b)->name);
+}
+
+static void writerPutTable(ConfigWriter *w, Option **options, unsigned depth);
+
+//Arrays are written on one line, compound elements over several: [{ ... }, { ... }]
+static bool writerPutArray(ConfigWriter *w, const ArrayOption *array, unsigned depth) {
+    size_t len = array->a_l ? array->len : 0; //The default of a compound array without one is NULL with some length
+    writerPut(w, "[", 1);
+    for (size_t i = 0; i < len; ++i) {
+        if (i) writerPut(w, ", ", 2);
+        switch (array->type) {
+            case BOOL:
+                if (array->a_b[i]) writerPut(w, "true", 4);
+                else writerPut(w, "false", 5);
+                break;
+            case LONG:
+                writerPutLong(w, array->a_l[i]);
+                break;
+            case DOUBLE:
+                writerPutDouble(w, array->a_d[i]);
+                break;
+            case TEXT: {
+                bool written = w->views ? writerPutString(w, array->a_sv[i].ptr, array->a_sv[i].len, depth > 0)
+                                        : writerPutString(w, array->a_s[i], array->a_s[i] ? strlen(array->a_s[i]) : 0,
+                                                          depth > 0);
+                if (!written) return false;
                 break;
             }
-            case ARRAY: {
-                char *arrayEnd = parseArray(&(optOut->v_a), file, optName, assignIndex, bufferOriginal + length);
-                if (!arrayEnd)break;
-                lineEnd = arrayEnd;
+            case COMPOUND:
+                writerPut(w, "{\n", 2);
+                writerPutTable(w, array->a_v.a_v[i], depth + 1);
+                writerIndent(w, depth);
+                writerPut(w, "}", 1);
                 break;
+            case ARRAY:
+                if (!writerPutArray(w, &array->a_a.a_a[i], depth)) return false;
+                break;
+        }
+    }
+    writerPut(w, "]", 1);
+    return true;
+}
+
+//Options are written in name order, so the same config always comes out the same
+static void writerPutTable(ConfigWriter *w, Option **options, unsigned depth) {
+    OptionTable *table = OPTION_TABLE(options);
+    size_t total = table->count + (table->base ? table->base->count : 0); //At most, an element overrides some of these
+    Option *stackSorted[32];
+    Option **sorted = total <= 32 ? stackSorted : malloc(total * sizeof(Option *));
+    if (!sorted) {
+        fprintf(stderr, "Error: Can't allocate memory for config writer: %s\n", strerror(errno));
+        w->failed = true;
+        return;
+    }
+    size_t count = 0;
+    Option *opt;
+    HASH_ITER(options, opt) {
+            sorted[count++] = opt;
+        }
+    qsort(sorted, count, sizeof(Option *), compareOptionNames);
+
+    for (size_t i = 0; i < count && !w->failed; ++i) {
+        opt = sorted[i];
+        size_t start = w->len;
+        bool written = true;
+        writerIndent(w, depth);
+        writerPut(w, opt->name, strlen(opt->name));
+        writerPut(w, " = ", 3);
+        switch (opt->type) {
+            case BOOL:
+                if (opt->v_b) writerPut(w, "true", 4);
+                else writerPut(w, "false", 5);
+                break;
+            case LONG:
+                writerPutLong(w, opt->v_l);
+                break;
+            case DOUBLE:
+                writerPutDouble(w, opt->v_d);
+                break;
+            case TEXT:
+                written = writerPutString(w, opt->v_sv.ptr, opt->v_sv.len, depth > 0);
+                break;
+            case COMPOUND:
+                writerPut(w, "{\n", 2);
+                writerPutTable(w, opt->v_v, depth + 1);
+                writerIndent(w, depth);
+                writerPut(w, "}", 1);
+                break;
+            case ARRAY:
+                written = writerPutArray(w, &opt->v_a, depth);
+                break;
+        }
+        if (!written) {
+            fprintf(stderr, "Error: Option %s can't be written: a string has both kinds of quotes%s or a line starting "
+                            "with #\n", opt->name, depth > 0 ? ", braces that don't pair up" : "");
+            w->len = start;
+            w->skipped = true;
+            continue;
+        }
+        writerPut(w, "\n", 1);
+        if (depth == 0 && w->len >= WRITER_FLUSH) writerFlush(w);
+    }
+    if (sorted != stackSorted) free(sorted);
+}
+
+static bool writeWith(ConfigWriter *w, Option **config) {
+    if (!config) {
+        fprintf(stderr, "Error: Config not yet initialized\n");
+        return false;
+    }
+    w->views = OPTION_TABLE(config)->stringViews;
+    writerPutTable(w, config, 0);
+    writerFlush(w);
+    return !w->failed && !w->skipped;
+}
+
+bool writeConfigFile(struct Option **config, FILE *fp) {
+    ConfigWriter w = {.file = fp, .fd = -1};
+    bool written = writeWith(&w, config);
+    free(w.data);
+    return written;
+}
+
+bool writeConfigFd(struct Option **config, int fd) {
+    ConfigWriter w = {.fd = fd};
+    bool written = writeWith(&w, config);
+    free(w.data);
+    return written;
+}
+
+bool writeConfigString(struct Option **config, char **out, size_t *length) {
+    ConfigWriter w = {.fd = -1};
+    bool written = writeWith(&w, config);
+    writerPut(&w, "", 1); //Null-terminated, not counted in length
+    if (w.failed) {
+        free(w.data);
+        *out = NULL;
+        *length = 0;
+        return false;
+    }
+    *out = w.data;
+    *length = w.len - 1;
+    return written;
+}
+
+bool writeConfig(struct Option **config, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: Can't open file '%s': '%s'\n", filename, strerror(errno));
+        return false;
+    }
+    bool written = writeConfigFile(config, fp);
+    if (fclose(fp)) {
+        fprintf(stderr, "Error: Can't write file '%s': '%s'\n", filename, strerror(errno));
+        written = false;
+    }
+    return written;
+}
+
+//shared configs
+
+//Points every option of options and its compounds at its default, without freeing anything
+static void defaultValues(Option **options) {
+    Option *opt;
+    OWN_ITER(OPTION_TABLE(options), opt) {
+            switch (opt->type) {
+                case BOOL:
+                    opt->v_b = opt->def->dv_b;
+                    break;
+                case LONG:
+                    opt->v_l = opt->def->dv_l;
+                    break;
+                case DOUBLE:
+                    opt->v_d = opt->def->dv_d;
+                    break;
+                case TEXT:
+                    opt->v_sv = opt->def->dv_sv;
+                    break;
+                case COMPOUND:
+                    defaultValues(opt->v_v);
+                    break;
+                case ARRAY:
+                    opt->v_a = opt->def->dv_a;
+                    break;
             }
         }
+}
+
+#ifndef _WIN32
+
+typedef struct SharedVersion {
+    struct SharedVersion *next; //Retired versions, newest first
+    Option **config;
+    unsigned long number;
+    unsigned long retired; //Epoch it was replaced in
+} SharedVersion;
+
+//A reader thread. Only the thread itself touches depth and pinned; epoch is what other threads look at, on its own
+//cache line so readers don't slow each other down
+typedef struct ReaderSlot {
+    _Alignas(64) atomic_ulong epoch; //Epoch the thread started reading in, 0 while it isn't reading
+    struct ReaderSlot *next;
+    atomic_bool used; //Cleared when the thread exits, so another thread can take the slot over
+    unsigned depth;
+    SharedVersion *pinned;
+} ReaderSlot;
+
+struct SharedConfig {
+    Option **schema;
+    unsigned long id; //Unique per instance, so a thread's cached slot can't outlive its config (see readerCache)
+    _Atomic(SharedVersion *) current;
+    atomic_ulong epoch; //Starts at 1, goes up with every publish
+    atomic_ulong version; //Number of the current version
+    pthread_key_t key; //The calling thread's slot
+    pthread_mutex_t lock; //Slot registration, publishing and the retired list. Readers never take it
+    ReaderSlot *readers;
+    SharedVersion *retired;
+};
+
+/*
+ * Readers publish their epoch and then read current, a publisher replaces current and then reads the epochs; one of
+ * the two has to see the other's store. A fence on the reader side costs about as much as a locked instruction, so
+ * where the kernel has membarrier readers only keep the compiler from reordering and the publisher, which is rare,
+ * makes every running thread of the process execute the fence for them before it scans the epochs
+ */
+static atomic_bool asymmetricFences = false;
+
+static void asymmetricFencesInit(void) {
+#ifdef __linux__
+    long cmds = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0);
+    if (cmds >= 0 && cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED &&
+        !syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0)) {
+        atomic_store(&asymmetricFences, true);
+    }
+#endif
+}
+
+//The publisher's half, before it looks at the readers' epochs
+static void readerFence(void) {
+#ifdef __linux__
+    if (atomic_load_explicit(&asymmetricFences, memory_order_relaxed)) {
+        syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        return;
+    }
+#endif
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+//The slot of the config this thread acquired last, saves the pthread_getspecific of every acquire
+static _Thread_local struct {
+    SharedConfig *shared;
+    unsigned long id;
+    ReaderSlot *slot;
+} readerCache;
+
+static void freeSharedVersion(SharedVersion *version) {
+    cleanOptions(version->config);
+    free(version);
+}
+
+static void releaseReaderSlot(void *arg) {
+    ReaderSlot *slot = arg;
+    slot->depth = 0;
+    slot->pinned = NULL;
+    atomic_store(&slot->epoch, 0);
+    atomic_store(&slot->used, false);
+}
+
+//Frees the retired versions no thread can still be reading. A thread that started reading in an epoch after the one
+//a version was replaced in read current after the replacement, so it can't have the old version. Lock held
+static void reclaimVersions(SharedConfig *shared) {
+    readerFence();
+    unsigned long oldest = ULONG_MAX;
+    for (ReaderSlot *slot = shared->readers; slot; slot = slot->next) {
+        unsigned long epoch = atomic_load(&slot->epoch);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+    SharedVersion **link = &shared->retired;
+    while (*link) {
+        SharedVersion *version = *link;
+        if (version->retired > oldest) {
+            link = &version->next;
+            continue;
+        }
+        *link = version->next;
+        freeSharedVersion(version);
+    }
+}
+
+static void publishShared(SharedConfig *shared, Option **config) {
+    SharedVersion *version = malloc(sizeof(SharedVersion));
+    if (!version) {
+        fprintf(stderr, "Error: Can't allocate memory for config version: %s\n", strerror(errno));
+        cleanOptions(config);
+        return;
+    }
+    version->config = config;
+    version->next = NULL;
+    version->retired = 0;
+    pthread_mutex_lock(&shared->lock);
+    SharedVersion *old = atomic_load(&shared->current);
+    version->number = old ? old->number + 1 : 0;
+    atomic_store(&shared->current, version);
+    atomic_store(&shared->version, version->number);
+    if (old) {
+        old->retired = atomic_fetch_add(&shared->epoch, 1) + 1;
+        old->next = shared->retired;
+        shared->retired = old;
+        reclaimVersions(shared);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+//A copy of the schema with every option at its default
+static Option **sharedDefaults(SharedConfig *shared) {
+    Option **config = optionTableCloneIn(shared->schema, NULL);
+    if (!config) return NULL;
+    defaultValues(config);
+    const RootSettings *schema = settingsOf(OPTION_TABLE(shared->schema));
+    if (schema->parseThreads || schema->includeCache) {
+        RootSettings *settings = settingsFor(OPTION_TABLE(config));
+        if (!settings) {
+            cleanOptions(config);
+            return NULL;
+        }
+        settings->parseThreads = schema->parseThreads;
+        settings->includeCache = schema->includeCache;
+    }
+    return config;
+}
+
+//Reads filename into a new version and publishes it. deps, if not NULL, gets what it was read from
+static bool loadShared(SharedConfig *shared, const char *filename, IncludeDeps *deps) {
+    Option **config = sharedDefaults(shared);
+    if (!config) return false;
+    if (!loadConfig(config, filename, false, deps)) {
+        cleanOptions(config);
+        return false;
+    }
+    publishShared(shared, config);
+    return true;
+}
+
+SharedConfig *sharedConfigCreate(struct Option **schema) {
+    if (!schema) {
+        fprintf(stderr, "Error: Config not yet initialized\n");
+        return NULL;
+    }
+    SharedConfig *shared = calloc(1, sizeof(SharedConfig));
+    if (!shared || pthread_key_create(&shared->key, releaseReaderSlot)) {
+        fprintf(stderr, "Error: Can't allocate memory for shared config: %s\n", strerror(errno));
+        free(shared);
+        return NULL;
+    }
+    static pthread_once_t fencesOnce = PTHREAD_ONCE_INIT;
+    pthread_once(&fencesOnce, asymmetricFencesInit);
+    static atomic_ulong nextId = 1;
+    shared->id = atomic_fetch_add(&nextId, 1);
+    shared->schema = schema;
+    atomic_init(&shared->current, NULL);
+    atomic_init(&shared->epoch, 1);
+    atomic_init(&shared->version, 0);
+    pthread_mutex_init(&shared->lock, NULL);
+    Option **config = sharedDefaults(shared);
+    if (config) publishShared(shared, config);
+    if (!atomic_load(&shared->current)) {
+        sharedConfigFree(shared);
+        return NULL;
+    }
+    return shared;
+}
 
+bool sharedConfigRead(SharedConfig *shared, const char *filename) {
+    return shared && loadShared(shared, filename, NULL);
+}
 
-        loopEnd:
-        buffer = lineEnd + 1;
-        loopEndR:
-        free(optName);
+//Slow path of a thread's first acquire
+static ReaderSlot *registerReader(SharedConfig *shared) {
+    pthread_mutex_lock(&shared->lock);
+    ReaderSlot *slot = shared->readers;
+    while (slot && atomic_load(&slot->used)) slot = slot->next;
+    if (slot) {
+        atomic_store(&slot->used, true);
+    } else if ((slot = aligned_alloc(_Alignof(ReaderSlot), sizeof(ReaderSlot)))) {
+        atomic_init(&slot->epoch, 0);
+        atomic_init(&slot->used, true);
+        slot->depth = 0;
+        slot->pinned = NULL;
+        slot->next = shared->readers;
+        shared->readers = slot;
+    }
+    pthread_mutex_unlock(&shared->lock);
+    if (!slot) {
+        fprintf(stderr, "Error: Can't allocate memory for config reader: %s\n", strerror(errno));
+        return NULL;
     }
+    pthread_setspecific(shared->key, slot);
+    return slot;
 }
 
-size_t readFile(const char *filename, char **bufferOut) {
-    size_t length;
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "Error: Can't open file '%s': '%s'\n", filename, strerror(errno));
-        return 0;
+//The calling thread's slot, NULL if it has none yet
+static inline ReaderSlot *readerSlot(SharedConfig *shared) {
+    if (readerCache.shared == shared && readerCache.id == shared->id) return readerCache.slot;
+    ReaderSlot *slot = pthread_getspecific(shared->key);
+    if (slot) {
+        readerCache.shared = shared;
+        readerCache.id = shared->id;
+        readerCache.slot = slot;
     }
+    return slot;
+}
 
-    length = getFileSize(filename);
-    if (length == 0) {
-        fclose(fp);
-        return 0;
+struct Option **sharedConfigAcquire(SharedConfig *shared) {
+    if (!shared) return NULL;
+    ReaderSlot *slot = readerSlot(shared);
+    if (!slot && !(slot = registerReader(shared))) return NULL;
+    if (slot->depth++) return slot->pinned->config;
+    atomic_store_explicit(&slot->epoch, atomic_load_explicit(&shared->epoch, memory_order_relaxed),
+                          memory_order_relaxed);
+    //The epoch has to be visible to publishers before current is read, see readerFence
+    if (atomic_load_explicit(&asymmetricFences, memory_order_relaxed)) {
+        atomic_signal_fence(memory_order_seq_cst);
+    } else {
+        atomic_thread_fence(memory_order_seq_cst);
     }
+    slot->pinned = atomic_load_explicit(&shared->current, memory_order_acquire);
+    return slot->pinned->config;
+}
 
-    (*bufferOut) = malloc(length + 2);
-    if (!(*bufferOut)) {
-        fprintf(stderr, "Error: Can't allocate memory for reading file '%s': '%s'\n", filename, strerror(errno));
-        fclose(fp);
-        free((*bufferOut));
-        return 0;
-    }
-    if (!fread((*bufferOut), 1, length, fp)) {
-        fprintf(stderr, "Error: Can't read file '%s': '%s'\n", filename, strerror(errno));
-        fclose(fp);
-        free((*bufferOut));
-        return 0;
-    }
-    fclose(fp);
+void sharedConfigRelease(SharedConfig *shared) {
+    if (!shared) return;
+    ReaderSlot *slot = readerSlot(shared);
+    if (!slot || !slot->depth || --slot->depth) return;
+    slot->pinned = NULL;
+    atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+}
 
-    if ((*bufferOut)[length - 1] != '\n') { //Ensure that string ends in new line (makes things nicer)
-        length++;
-        (*bufferOut)[length - 1] = '\n';
+unsigned long sharedConfigVersion(SharedConfig *shared) {
+    return shared ? atomic_load(&shared->version) : 0;
+}
+
+void sharedConfigFree(SharedConfig *shared) {
+    if (!shared) return;
+    pthread_key_delete(shared->key);
+    SharedVersion *current = atomic_load(&shared->current);
+    if (current) freeSharedVersion(current);
+    while (shared->retired) {
+        SharedVersion *next = shared->retired->next;
+        freeSharedVersion(shared->retired);
+        shared->retired = next;
     }
-    (*bufferOut)[length] = '\0'; //Must be null terminated
-    return length;
+    while (shared->readers) {
+        ReaderSlot *next = shared->readers->next;
+        free(shared->readers);
+        shared->readers = next;
+    }
+    pthread_mutex_destroy(&shared->lock);
+    free(shared);
 }
 
-size_t preprocessor(char *bufferOriginal, size_t bufferOriginalLen, char **bufferOut, char *dirPath) {
-    size_t dirPathLen = strlen(dirPath);
-    char *bufferO = malloc(bufferOriginalLen);
-    char *buffer = bufferO; // Increment this buffer in order to keep the original for realloc and measuring size
-    size_t bufferLen = bufferOriginalLen;
-    char *macroStart = bufferOriginal;
-    char *prevMacroEnd = bufferOriginal;
-    bool macroUsed = false;
+#else
 
-    while ((macroStart = strchr(macroStart, '#')) && macroStart - bufferOriginal < bufferOriginalLen) {
-        char *lineBegin = strrchr_(macroStart, macroStart - prevMacroEnd, '\n') + 1;
-        if (lineBegin == NULL + 1) { // 1 was added to lineBegin, so it will be NULL + 1 if it would usually be NULL
-            lineBegin = prevMacroEnd;
-        }
-        for (; lineBegin < macroStart; lineBegin++) { //Macro has to be the only thing on the line
-            if (!isspace(*lineBegin)) goto eol;
-        }
+SharedConfig *sharedConfigCreate(struct Option **schema) {
+    fprintf(stderr, "Error: Shared configs aren't supported on Windows\n");
+    return NULL;
+}
 
-        char *lineEnd = strchr(macroStart + 1, '\n');
-        if (!(strncmp(macroStart + 1, "include", 7))) {
-            char *pathStart = memchr(macroStart + 7, '"', lineEnd - macroStart);
-            if (!pathStart) {
-                fprintf(stderr, "Error: macro #include must have a path specified in '\"'\n");
-                goto eol;
-            }
-            pathStart++;
-            char *pathEnd = memchr(pathStart, '"', lineEnd - (pathStart));
-            if (!pathEnd) {
-                fprintf(stderr, "Error: macro #include must have a path specified in '\"'\n");
-                goto eol;
-            }
-            char *fileName = malloc(((pathEnd - pathStart + dirPathLen + 1) * sizeof(char)));
-            memcpy(fileName, dirPath, dirPathLen);
-            memcpy(fileName + dirPathLen, pathStart, pathEnd - pathStart);
-            fileName[pathEnd - pathStart + dirPathLen] = '\0'; //Must be null-terminated
+bool sharedConfigRead(SharedConfig *shared, const char *filename) {
+    return false;
+}
 
-            glob_t glob_result;
-            memset(&glob_result, 0, sizeof(glob_result));
+struct Option **sharedConfigAcquire(SharedConfig *shared) {
+    return NULL;
+}
 
-            int glob_return = glob(fileName, GLOB_TILDE, NULL, &glob_result);
+void sharedConfigRelease(SharedConfig *shared) {
+}
 
-            switch (glob_return) {
-                case GLOB_NOSPACE: {
-                    fprintf(stderr, "Error: glob() failed with return code GLOB_NOSPACE (Out of memory)\n");
-                    globfree(&glob_result);
-                    goto eol;
-                }
-                case GLOB_ABORTED: {
-                    fprintf(stderr, "Error: glob() failed with return code GLOB_ABORTED (Read error)\n");
-                    globfree(&glob_result);
-                    goto eol;
-                }
-                case GLOB_NOMATCH: {
-                    fprintf(stderr, "Error: No files found matching pattern '%s'\n", fileName);
-                    globfree(&glob_result);
-                    goto eol;
-                }
-                default: {
-                    break;
-                }
-            }
+unsigned long sharedConfigVersion(SharedConfig *shared) {
+    return 0;
+}
 
-            if (buffer - bufferO + (macroStart - prevMacroEnd) >= bufferLen) {
-                char *tmp = realloc(bufferO, bufferLen + (macroStart - prevMacroEnd) + 1); // +1 because why not
-                if (!tmp) {
-                    fprintf(stderr, "Error: unable to reallocate more memory for macro processing buffer: %s\n",
-                            strerror(errno));
-                    goto eol;
-                }
-                bufferLen += (macroStart - prevMacroEnd) + 1;
-            }
+void sharedConfigFree(SharedConfig *shared) {
+}
 
-            memcpy(buffer, prevMacroEnd,
-                   macroStart - prevMacroEnd); // Copy everything leading up to the macro into new buffer
-            buffer += macroStart - prevMacroEnd;
+#endif
 
-            for (int i = 0; i < glob_result.gl_pathc; ++i) {
-                if (!isFile(glob_result.gl_pathv[i]))continue; //Continue if it's not a file
-                char *fileBuf = NULL;
-                size_t len = readFile(glob_result.gl_pathv[i], &fileBuf);
-                if (!len) {
-                    fprintf(stderr, "Error: unable to read file: %s\n", glob_result.gl_pathv[i]);
-                    continue;
-                }
+//watcher
 
-                //Get path to the parent directory used to find other files which may be included
-                char *parentDirI = strrchr(fileName, '/') + 1;
-                char *parentDir = strndup(fileName, parentDirI - fileName);
+#ifdef __linux__
 
-                char *fileProcessed = NULL;
-                size_t len1 = preprocessor(fileBuf, len, &fileProcessed, parentDir);
+//A directory under watch. Files are watched through their directory, so a file that is replaced by a rename
+//(the way most editors save) is still seen
+typedef struct WatchDir {
+    int wd;
+    char *prefix; //The directory with a trailing '/', "" for the working directory
+    bool pattern; //#include patterns are matched in it, so any file appearing or going away matters
+} WatchDir;
 
-                // First make sure new buffer has enough space
-                if (buffer - bufferO + len >= bufferLen) {
-                    char *tmp = realloc(bufferO, bufferLen + len + 1); // +1 because why not
-                    if (!tmp) {
-                        fprintf(stderr, "Error: unable to reallocate more memory for macro processing buffer: %s\n",
-                                strerror(errno));
-                        goto eol;
-                    }
-                    size_t offset = buffer - bufferO;
-                    bufferO = tmp;
-                    buffer = bufferO + offset;
-                    bufferLen += len + 1;
-                }
+struct ConfigWatch {
+    SharedConfig *shared;
+    char *filename;
+    unsigned debounceMs;
+    IncludeDeps deps; //Files and directories the current version was read from
+    WatchDir *dirs;
+    size_t dirCount;
+    int inotify;
+    int stop[2]; //Pipe that wakes the watch thread up when the watch is freed
+    pthread_t thread;
+};
 
+struct Option **configWatchAcquire(ConfigWatch *watch) {
+    return watch ? sharedConfigAcquire(watch->shared) : NULL;
+}
 
-                memcpy(buffer, fileProcessed, len1); // Copy everything from included file into new buffer
-                buffer += len1;
-            }
+void configWatchRelease(ConfigWatch *watch, struct Option **config) {
+    if (watch && config) sharedConfigRelease(watch->shared);
+}
 
-            globfree(&glob_result);
+unsigned long configWatchVersion(ConfigWatch *watch) {
+    return watch ? sharedConfigVersion(watch->shared) : 0;
+}
 
-            prevMacroEnd = lineEnd;
-            macroUsed = true;
-        }
-        eol:
-        macroStart++;
+static void watchDir(ConfigWatch *watch, const char *path, size_t len, bool pattern) {
+    char *prefix = malloc(len + 2);
+    if (!prefix) return;
+    memcpy(prefix, path, len);
+    prefix[len] = '\0';
+    if (!strcmp(prefix, ".")) prefix[0] = '\0';
+    else if (len && prefix[len - 1] != '/') strcat(prefix, "/");
+    int wd = inotify_add_watch(watch->inotify, prefix[0] ? prefix : ".",
+                               IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    if (wd < 0) {
+        free(prefix);
+        return;
     }
-    if (!macroUsed) {
-        (*bufferOut) = bufferOriginal;
-        return bufferOriginalLen;
+    for (size_t i = 0; i < watch->dirCount; ++i) {
+        if (watch->dirs[i].wd != wd) continue;
+        watch->dirs[i].pattern |= pattern;
+        free(prefix);
+        return;
     }
+    WatchDir *tmp = realloc(watch->dirs, (watch->dirCount + 1) * sizeof(WatchDir));
+    if (!tmp) {
+        free(prefix);
+        return;
+    }
+    watch->dirs = tmp;
+    watch->dirs[watch->dirCount++] = (WatchDir) {wd, prefix, pattern};
+}
 
-    // First make sure new buffer has enough space
-    if ((buffer - bufferO) + ((bufferOriginal + bufferOriginalLen) - prevMacroEnd) >= bufferLen) {
-        char *tmp = realloc(bufferO, (buffer - bufferO) + ((bufferOriginal + bufferOriginalLen) - prevMacroEnd) +
-                                     1); // +1 because why not
-        if (!tmp) {
-            fprintf(stderr, "Error: unable to reallocate more memory for macro processing buffer: %s\n",
-                    strerror(errno));
-            return buffer - bufferO;
+//Adds watches for whatever the current version was read from. Watches are never removed, a directory that is no
+//longer needed only costs a reload now and then
+static void watchDeps(ConfigWatch *watch) {
+    const char *slash = strrchr(watch->filename, '/');
+    watchDir(watch, watch->filename, slash ? slash - watch->filename + 1 : 0, false);
+    for (size_t i = 0; i < watch->deps.count; ++i) {
+        const IncludeDep *dep = &watch->deps.items[i];
+        if (dep->stamp.regular) {
+            slash = strrchr(dep->path, '/');
+            watchDir(watch, dep->path, slash ? slash - dep->path + 1 : 0, false);
+        } else if (dep->stamp.exists) {
+            watchDir(watch, dep->path, strlen(dep->path), true);
         }
-        size_t offset = buffer - bufferO;
-        bufferO = tmp;
-        buffer = bufferO + offset;
     }
+}
 
-    memcpy(buffer, prevMacroEnd, ((bufferOriginal + bufferOriginalLen) -
-                                  prevMacroEnd)); // Copy everything leading up to the macro into new buffer
-    buffer += ((bufferOriginal + bufferOriginalLen) - prevMacroEnd);
-
-    (*bufferOut) = bufferO;
+static bool watchRelevant(ConfigWatch *watch, const struct inotify_event *event) {
+    const WatchDir *dir = NULL;
+    for (size_t i = 0; i < watch->dirCount && !dir; ++i) {
+        if (watch->dirs[i].wd == event->wd) dir = &watch->dirs[i];
+    }
+    if (!dir || !event->len) return false;
+    if (dir->pattern) return true;
+    size_t prefixLen = strlen(dir->prefix);
+    const char *name = event->name;
+    const char *target = watch->filename;
+    for (size_t i = 0; target; target = i < watch->deps.count ? watch->deps.items[i++].path : NULL) {
+        if (!strncmp(target, dir->prefix, prefixLen) && !strcmp(target + prefixLen, name)) return true;
+    }
+    return false;
+}
 
-    return buffer - bufferO;
+//Builds and publishes a new version. Returns true if something changed while it was read, so another reload is due
+static bool reloadWatch(ConfigWatch *watch) {
+    IncludeDeps deps = {0};
+    if (!loadShared(watch->shared, watch->filename, &deps)) {
+        //The file itself is watched even if it couldn't be read the first time
+        if (!watch->dirCount) watchDeps(watch);
+        depsFree(&deps);
+        return false;
+    }
+    depsFree(&watch->deps);
+    watch->deps = deps;
+    watchDeps(watch);
+    return !depsUnchanged(&watch->deps, 0);
 }
 
+static void *watchMain(void *arg) {
+    ConfigWatch *watch = arg;
+    bool pending = !depsUnchanged(&watch->deps, 0);
+    _Alignas(struct inotify_event) char events[4096];
+    while (true) {
+        struct pollfd fds[2] = {{.fd = watch->inotify, .events = POLLIN}, {.fd = watch->stop[0], .events = POLLIN}};
+        int ready = poll(fds, 2, pending ? (int) watch->debounceMs : -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0 || fds[1].revents) break;
+        if (ready == 0) { //Nothing changed for debounceMs since the last change
+            pending = reloadWatch(watch);
+            continue;
+        }
+        ssize_t len = read(watch->inotify, events, sizeof(events));
+        const struct inotify_event *event;
+        for (char *p = events; len > 0 && p < events + len; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) p;
+            if ((event->mask & IN_Q_OVERFLOW) || watchRelevant(watch, event)) pending = true;
+        }
+    }
+    return NULL;
+}
 
-void readConfig(struct Option **config, const char *filename) {
-    if (!config) {
+ConfigWatch *configWatchCreate(struct Option **schema, const char *filename, unsigned debounceMs) {
+    if (!schema) {
         fprintf(stderr, "Error: Config '%s' not yet initialized\n", filename);
-        return;
+        return NULL;
+    }
+    ConfigWatch *watch = calloc(1, sizeof(ConfigWatch));
+    if (!watch) {
+        fprintf(stderr, "Error: Can't allocate memory for config watch: %s\n", strerror(errno));
+        return NULL;
+    }
+    watch->shared = sharedConfigCreate(schema);
+    watch->filename = strdup(filename);
+    watch->debounceMs = debounceMs ? debounceMs : CONFIG_WATCH_DEBOUNCE_MS;
+    watch->stop[0] = watch->stop[1] = -1;
+    watch->inotify = inotify_init1(IN_CLOEXEC);
+    if (!watch->shared || !watch->filename || watch->inotify < 0 || pipe(watch->stop)) {
+        fprintf(stderr, "Error: Can't watch '%s' for changes: %s\n", filename, strerror(errno));
+        configWatchFree(watch);
+        return NULL;
     }
 
-    char *bufferOriginal = NULL;
-    size_t length = readFile(filename, &bufferOriginal);
+    reloadWatch(watch); //If the file can't be read yet, readers get the defaults until it can
+    if (pthread_create(&watch->thread, NULL, watchMain, watch)) {
+        fprintf(stderr, "Error: Can't watch '%s' for changes: %s\n", filename, strerror(errno));
+        close(watch->stop[1]); //Tells configWatchFree there is no thread to stop
+        watch->stop[1] = -1;
+        configWatchFree(watch);
+        return NULL;
+    }
+    return watch;
+}
 
-    //Get path to the parent directory used to find other files which may be included
-    char *parentDirI = strrchr(filename, '/') + 1;
-    char *parentDir = strndup(filename, parentDirI - filename);
+void configWatchFree(ConfigWatch *watch) {
+    if (!watch) return;
+    if (watch->stop[1] >= 0) {
+        write(watch->stop[1], "", 1);
+        pthread_join(watch->thread, NULL);
+        close(watch->stop[1]);
+    }
+    if (watch->stop[0] >= 0) close(watch->stop[0]);
+    if (watch->inotify >= 0) close(watch->inotify);
+    sharedConfigFree(watch->shared); //Readers must be done with their versions by now
+    for (size_t i = 0; i < watch->dirCount; ++i) free(watch->dirs[i].prefix);
+    free(watch->dirs);
+    depsFree(&watch->deps);
+    free(watch->filename);
+    free(watch);
+}
 
-    //Process macros before parsing file
-    char *buffer = NULL;
-    size_t len = preprocessor(bufferOriginal, length, &buffer, parentDir);
+#else
+
+ConfigWatch *configWatchCreate(struct Option **schema, const char *filename, unsigned debounceMs) {
+    fprintf(stderr, "Error: Can't watch '%s' for changes, watching is only supported on Linux\n", filename);
+    return NULL;
+}
+
+struct Option **configWatchAcquire(ConfigWatch *watch) {
+    return NULL;
+}
+
+void configWatchRelease(ConfigWatch *watch, struct Option **config) {
+}
+
+unsigned long configWatchVersion(ConfigWatch *watch) {
+    return 0;
+}
+
+void configWatchFree(ConfigWatch *watch) {
+}
 
-#ifndef NDEBUG
-    FILE *fp = fopen("debug/preprocessor-output.txt", "w");
-    fwrite(buffer, sizeof(char), len, fp);
-    fclose(fp);
 #endif
 
-    parseConfigWhole(config, filename, buffer, len);
+//Splits the next "name" or "name[index]" segment off a dotted path, pointing into the path instead of copying it
+static bool nextPathSegment(const char **cursor, OptionPathSegment *out) {
+    const char *start = *cursor;
+    const char *end = start;
+    while (*end && *end != '.' && *end != '[') end++;
+    out->name = start;
+    out->len = end - start;
+    out->index = -1;
+    if (!out->len) return false;
+    if (*end == '[') {
+        char *indexEnd = NULL;
+        long index = strtol(end + 1, &indexEnd, 10);
+        if (indexEnd == end + 1 || *indexEnd != ']' || index < 0) return false;
+        out->index = index;
+        end = indexEnd + 1;
+    }
+    if (*end == '.') {
+        if (!*(++end)) return false;
+    } else if (*end) {
+        return false;
+    }
+    *cursor = end;
+    return true;
+}
 
-    free(bufferOriginal);
-    free(buffer);
+//Looks up one segment in options. Returns the option for the last segment, otherwise stores the table to continue in
+static struct Option *resolveSegment(struct Option ***options, const OptionPathSegment *segment, bool last,
+                                     const char *path) {
+    struct Option *opt = optionTableFindHashed(*options, segment->name, segment->len, segment->hash);
+    if (!opt) {
+        fprintf(stderr, "Error: Option %s not found\n", path);
+        return NULL;
+    }
+    if (segment->index >= 0) {
+        if (opt->type != ARRAY || opt->v_a.type != COMPOUND) {
+            fprintf(stderr, "Error: Only compound array options can be indexed. Option %.*s is not a compound array.\n",
+                    (int) segment->len, segment->name);
+            return NULL;
+        }
+        if ((size_t) segment->index >= opt->v_a.len) {
+            fprintf(stderr, "Error: Index %ld out of bounds for option %.*s with %zu elements\n", segment->index,
+                    (int) segment->len, segment->name, opt->v_a.len);
+            return NULL;
+        }
+        if (last) {
+            fprintf(stderr, "Error: Path %s must end with an option name, not an array element\n", path);
+            return NULL;
+        }
+        *options = opt->v_a.a_v.a_v[segment->index];
+        return opt;
+    }
+    if (!last) {
+        if (opt->type != COMPOUND) {
+            fprintf(stderr, "Error: Only compound type options can have child options. Option %.*s is not compound.\n",
+                    (int) segment->len, segment->name);
+            return NULL;
+        }
+        *options = opt->v_v;
+    }
+    return opt;
 }
 
 struct Option *get_(struct Option **options, char *optName) {
@@ -823,30 +5650,196 @@ struct Option *get_(struct Option **options, char *optName) {
         return NULL;
     }
 
-    char *dotIndex = strchr(optName, '.');
-    char *name = optName;
-    if (dotIndex) {
-        name = strndup(optName, dotIndex - optName);
+    const char *cursor = optName;
+    OptionPathSegment segment;
+    struct Option *opt = NULL;
+    while (*cursor) {
+        if (!nextPathSegment(&cursor, &segment)) {
+            fprintf(stderr, "Error: Invalid option path %s\n", optName);
+            return NULL;
+        }
+        segment.hash = optionTableHash(segment.name, segment.len);
+        opt = resolveSegment(&options, &segment, !*cursor, optName);
+        if (!opt) return NULL;
+    }
+    if (!opt) fprintf(stderr, "Error: Option %s not found\n", optName);
+    return opt;
+}
+
+OptionPath *compilePath(const char *path) {
+    size_t pathLen = strlen(path);
+    size_t maxSegments = 1;
+    for (const char *c = path; *c; ++c) {
+        if (*c == '.') maxSegments++;
     }
 
-    struct Option *opt;
-    HASH_FIND(options, name, opt);
-    if (!opt) {
-        fprintf(stderr, "Error: Option %s not found\n", optName);
+    //Segments and the copy of the path they point into share one allocation
+    OptionPath *compiled = malloc(sizeof(OptionPath) + maxSegments * sizeof(OptionPathSegment) + pathLen + 1);
+    if (!compiled) {
+        fprintf(stderr, "Error: Can't allocate memory for option path '%s': %s\n", path, strerror(errno));
         return NULL;
     }
-    if (dotIndex) {
-        if (opt->type != COMPOUND) {
-            fprintf(stderr, "Error: Only compound type options can have child options. Option %s is not compound.\n",
-                    name);
+    compiled->segments = (OptionPathSegment *) (compiled + 1);
+    compiled->source = (char *) (compiled->segments + maxSegments);
+    memcpy(compiled->source, path, pathLen + 1);
+    compiled->count = 0;
+
+    const char *cursor = compiled->source;
+    while (*cursor) {
+        OptionPathSegment *segment = &compiled->segments[compiled->count];
+        if (!nextPathSegment(&cursor, segment)) {
+            fprintf(stderr, "Error: Invalid option path %s\n", path);
+            free(compiled);
             return NULL;
         }
-        return get_(opt->v_v, dotIndex + 1);
+        segment->hash = optionTableHash(segment->name, segment->len);
+        compiled->count++;
     }
+    if (!compiled->count) {
+        fprintf(stderr, "Error: Invalid option path %s\n", path);
+        free(compiled);
+        return NULL;
+    }
+    return compiled;
+}
 
+struct Option *getPath(struct Option **options, const OptionPath *path) {
+    if (!options || !path) return NULL;
+    struct Option *opt = NULL;
+    for (size_t i = 0; i < path->count; ++i) {
+        opt = resolveSegment(&options, &path->segments[i], i + 1 == path->count, path->source);
+        if (!opt) return NULL;
+    }
     return opt;
 }
 
+void freePath(OptionPath *path) {
+    free(path);
+}
+
+OptionHandle getHandle(struct Option **options, char *optName) {
+    return get_(options, optName);
+}
+
+//binding
+
+typedef struct Binding {
+    const Option *opt;
+    size_t offset;
+    enum BindKind kind;
+} Binding;
+
+typedef struct BindingSet {
+    char *target; //NULL until setBindTarget
+    Binding *items;
+    size_t count;
+    size_t capacity;
+} BindingSet;
+
+static size_t bindingsMemory(const BindingSet *bindings) {
+    return sizeof(BindingSet) + bindings->capacity * sizeof(Binding);
+}
+
+static bool bindKindFits(enum Type type, enum BindKind kind) {
+    switch (kind) {
+        case BIND_LONG:
+        case BIND_INT:
+            return type == LONG;
+        case BIND_DOUBLE:
+            return type == DOUBLE;
+        case BIND_BOOL:
+            return type == BOOL;
+        case BIND_STRING:
+        case BIND_VIEW:
+            return type == TEXT;
+        case BIND_ARRAY:
+            return type == ARRAY;
+    }
+    return false;
+}
+
+static void bindValue(char *target, const Binding *binding) {
+    const Option *opt = binding->opt;
+    void *field = target + binding->offset;
+    switch (binding->kind) {
+        case BIND_LONG:
+            *(long *) field = opt->v_l;
+            break;
+        case BIND_INT:
+            *(int *) field = (int) opt->v_l;
+            break;
+        case BIND_DOUBLE:
+            *(double *) field = opt->v_d;
+            break;
+        case BIND_BOOL:
+            *(bool *) field = opt->v_b;
+            break;
+        case BIND_STRING:
+            *(char **) field = opt->v_s;
+            break;
+        case BIND_VIEW:
+            *(StringView *) field = opt->v_sv;
+            break;
+        case BIND_ARRAY:
+            *(ArrayOption *) field = opt->v_a;
+            break;
+    }
+}
+
+//Bound options are resolved once by bindOption and stay put across loads, so this is a copy per binding
+static void bindValues(Option **config) {
+    const BindingSet *set = config ? settingsOf(OPTION_TABLE(config))->bindings : NULL;
+    if (!set || !set->target) return;
+    for (size_t i = 0; i < set->count; ++i) bindValue(set->target, &set->items[i]);
+}
+
+bool bindOption(struct Option **config, const char *path, size_t offset, enum BindKind kind) {
+    if (!config || !path) return false;
+    if (strchr(path, '[')) {
+        fprintf(stderr, "Error: Can't bind option %s, compound array elements are rebuilt on every load\n", path);
+        return false;
+    }
+    Option *opt = get_(config, (char *) path);
+    if (!opt) return false;
+    if (!bindKindFits(opt->type, kind)) {
+        fprintf(stderr, "Error: Option %s doesn't fit the type of the field it's bound to\n", path);
+        return false;
+    }
+
+    OptionTable *root = OPTION_TABLE(config);
+    BindingSet *set = settingsOf(root)->bindings;
+    if (!set) {
+        RootSettings *settings = settingsFor(root);
+        if (!settings) return false;
+        set = settings->bindings = calloc(1, sizeof(BindingSet));
+        if (!set) {
+            fprintf(stderr, "Error: Can't allocate memory for option bindings: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        Binding *items = realloc(set->items, capacity * sizeof(Binding));
+        if (!items) {
+            fprintf(stderr, "Error: Can't allocate memory for option bindings: %s\n", strerror(errno));
+            return false;
+        }
+        set->items = items;
+        set->capacity = capacity;
+    }
+    Binding *binding = &set->items[set->count++];
+    *binding = (Binding) {opt, offset, kind};
+    if (set->target) bindValue(set->target, binding);
+    return true;
+}
+
+void setBindTarget(struct Option **config, void *target) {
+    BindingSet *set = config ? settingsOf(OPTION_TABLE(config))->bindings : NULL;
+    if (!set) return;
+    set->target = target;
+    bindValues(config);
+}
+
 size_t getFileSize(const char *filename) {
 #ifndef _WIN32
     struct stat st;
@@ -859,19 +5852,72 @@ size_t getFileSize(const char *filename) {
 #endif
 }
 
+//Frees the data of a parsed (heap allocated) array, including the elements of string, compound and nested arrays.
+//Strings that are views into the source buffer aren't freed
+static void freeArrayValue(ArrayOption *array, bool views) {
+    switch (array->type) {
+        case TEXT:
+            if (!views) {
+                for (size_t i = 0; i < array->len; ++i) free(array->a_s[i]);
+            }
+            break;
+        case COMPOUND:
+            for (size_t i = 0; i < array->len; ++i) {
+                if (views) releaseValues(array->a_v.a_v[i], true);
+                cleanOptions(array->a_v.a_v[i]);
+            }
+            break;
+        case ARRAY:
+            for (size_t i = 0; i < array->len; ++i) freeArrayValue(&array->a_a.a_a[i], views);
+            break;
+        default:
+            break;
+    }
+    free(array->a_l);
+}
+
 void cleanOptions(Option **options) {
     if (!options)return;
+    OptionTable *table = OPTION_TABLE(options);
+    RootSettings *settings = table->settings;
+    if (settings) {
+        if (settings->record) {
+            recordClear(settings->record);
+            free(settings->record);
+        }
+        if (settings->bindings) {
+            free(settings->bindings->items);
+            free(settings->bindings);
+            settings->bindings = NULL;
+        }
+        settings->record = NULL;
+    }
+    if (table->source) {
+        releaseValues(options, true);
+        releaseSource(table);
+    }
+    free(settings);
+    table->settings = NULL;
+    if (table->arena) {
+        //Everything in an arena config goes away with its chunks
+        if (table->ownsArena) {
+            configArenaFree(table->arena); //table itself lives in the schema region
+        }
+        return;
+    }
     Option *opt;
 
-    HASH_ITER(options, opt) {
+    OWN_ITER(table, opt) {
             if (opt->type == TEXT) {
-                if (opt->v_s != opt->dv_s)
+                if (opt->v_s != opt->def->dv_s)
                     free(opt->v_s); // Default value does not need to be freed because it was made from a string literal
             } else if (opt->type == COMPOUND) {
                 cleanOptions(opt->v_v);
-                if (opt->v_v != opt->dv_v) cleanOptions(opt->dv_v);
+            } else if (opt->type == ARRAY && opt->v_a.a_l != opt->def->dv_a.a_l) {
+                freeArrayValue(&opt->v_a, false);
             }
+            if (!table->base) free(opt->def); //An element's options share the template's
             free(opt);
         }
-    free(options);
+    optionTableFree(options);
 }
@@ -0,0 +1,1625 @@
+#include "../include/libconf.h"
+#include "corpus.h"
+
+#include <linux/perf_event.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Allocation counting: the bench is linked with -Wl,--wrap for these functions (see CMakeLists.txt), which routes
+ * every call made by the bench and the library through the counters below.
+ */
+static size_t allocations = 0;
+static size_t frees = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+char *__real_strndup(const char *s, size_t n);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocations++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    allocations++;
+    return __real_strdup(s);
+}
+
+char *__wrap_strndup(const char *s, size_t n) {
+    allocations++;
+    return __real_strndup(s, n);
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr) frees++;
+    __real_free(ptr);
+}
+
+//Set by the checks some benches make along the way, the bench then exits with 1
+static bool benchFailed = false;
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+//xorshift, so the lookup order is not just the insertion order
+static size_t nextIndex(uint64_t *state, size_t n) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state % n;
+}
+
+static void benchLookup(void) {
+    printf("== lookup: ns per HASH_FIND against table size ==\n");
+    const size_t lookups = 2000000;
+    for (size_t n = 10; n <= 100000; n *= 10) {
+        Option **config;
+        INIT_CONFIG(config);
+        char **names = malloc(n * sizeof(char *));
+        for (size_t i = 0; i < n; ++i) {
+            names[i] = malloc(32);
+            snprintf(names[i], 32, "section.option_%zu", i);
+            ADD_OPT_LONG(config, names[i], (long) i);
+        }
+
+        uint64_t state = 88172645463325252ULL;
+        long sum = 0;
+        double start = nowNs();
+        for (size_t i = 0; i < lookups; ++i) {
+            Option *o;
+            HASH_FIND(config, names[nextIndex(&state, n)], o);
+            sum += o->v_l;
+        }
+        double elapsed = nowNs() - start;
+        printf("%7zu keys: %6.1f ns/lookup (capacity %zu, checksum %ld)\n", n, elapsed / (double) lookups,
+               OPTION_TABLE(config)->capacity, sum);
+
+        cleanOptions(config);
+        for (size_t i = 0; i < n; ++i) free(names[i]);
+        free(names);
+    }
+}
+
+#define FREEZE_BENCH_LOOKUPS 2000000
+#define FREEZE_BENCH_UNKNOWN 4 //Unknown keys in the parse corpus per known one
+
+#define FREEZE_BENCH_NAME_LEN 40 //"section.option_" and a 20 digit index
+
+//Probed against frozen tables: hits and misses, and a parse of a file that assigns every option once next to keys the
+//schema doesn't have (their warnings go to /dev/null). A probed table grows at OPTION_TABLE_MAX_LOAD, so next to round
+//sizes come the largest ones that still fit a capacity, where its probe sequences are the longest
+static void benchFreeze(void) {
+    printf("== freeze: probed against frozen (minimal perfect hash) tables ==\n");
+    printf("%8s %-7s %10s %10s %10s %10s %10s\n", "keys", "table", "hit ns", "miss ns", "parse ms", "freeze ms",
+           "table KB");
+    static const size_t sizes[] = {96, 10000, OPTION_TABLE_MAX_LOAD(16384), OPTION_TABLE_MAX_LOAD(1 << 20)};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t n = sizes[s];
+        char **names = malloc(n * sizeof(char *));
+        char **unknown = malloc(n * sizeof(char *));
+        for (size_t i = 0; i < n; ++i) {
+            names[i] = malloc(FREEZE_BENCH_NAME_LEN);
+            unknown[i] = malloc(FREEZE_BENCH_NAME_LEN);
+            snprintf(names[i], FREEZE_BENCH_NAME_LEN, "section.option_%zu", i);
+            snprintf(unknown[i], FREEZE_BENCH_NAME_LEN, "section.stale_%zu", i);
+        }
+        char path[] = "/tmp/libconf_bench_XXXXXX";
+        FILE *fp = fdopen(mkstemp(path), "w");
+        for (size_t i = 0; i < n; ++i) {
+            fprintf(fp, "%s = %zu\n", names[i], i);
+            for (int u = 0; u < FREEZE_BENCH_UNKNOWN; ++u) fprintf(fp, "%s_%d = 1\n", unknown[i], u);
+        }
+        fclose(fp);
+
+        for (int frozen = 0; frozen < 2; ++frozen) {
+            Option **config;
+            INIT_CONFIG(config);
+            for (size_t i = 0; i < n; ++i) ADD_OPT_LONG(config, names[i], (long) i);
+            double start = nowNs();
+            if (frozen) freezeConfig(config);
+            double freezeNs = nowNs() - start;
+
+            uint64_t state = 88172645463325252ULL;
+            long sum = 0;
+            Option *o;
+            start = nowNs();
+            for (size_t i = 0; i < FREEZE_BENCH_LOOKUPS; ++i) {
+                HASH_FIND(config, names[nextIndex(&state, n)], o);
+                sum += o->v_l;
+            }
+            double hitNs = (nowNs() - start) / FREEZE_BENCH_LOOKUPS;
+            start = nowNs();
+            for (size_t i = 0; i < FREEZE_BENCH_LOOKUPS; ++i) {
+                HASH_FIND(config, unknown[nextIndex(&state, n)], o);
+                sum += o != NULL;
+            }
+            double missNs = (nowNs() - start) / FREEZE_BENCH_LOOKUPS;
+
+            fflush(stderr);
+            int err = dup(STDERR_FILENO);
+            int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDERR_FILENO);
+            start = nowNs();
+            readConfig(config, path);
+            double parseNs = nowNs() - start;
+            dup2(err, STDERR_FILENO);
+            close(err);
+            close(devNull);
+
+            printf("%8zu %-7s %10.1f %10.1f %10.2f %10.2f %10.1f (checksum %ld)\n", n, frozen ? "frozen" : "probed",
+                   hitNs, missNs, parseNs / 1e6, freezeNs / 1e6, configMemory(config).tables / 1024.0, sum);
+            cleanOptions(config);
+        }
+        unlink(path);
+        for (size_t i = 0; i < n; ++i) {
+            free(names[i]);
+            free(unknown[i]);
+        }
+        free(names);
+        free(unknown);
+    }
+}
+
+//Hardware counter of this thread's user space, -1 where perf events aren't available (containers often block them)
+static int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void startCounter(int fd) {
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static double stopCounter(int fd, size_t per) {
+    uint64_t count = 0;
+    if (fd < 0) return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) return -1;
+    return (double) count / (double) per;
+}
+
+#define FOOTPRINT_BENCH_LOOKUPS 4000000
+
+//Random get() over configs too large for the cache, where every lookup misses on the fingerprints, the slot and the
+//option. Misses are L1 data cache read misses and last level cache misses per lookup
+static void benchFootprint(void) {
+    printf("== footprint: random get() over large configs, %zu bytes per option ==\n", sizeof(Option));
+    int l1 = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    int llc = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    if (l1 < 0 || llc < 0) printf("(no perf counters here, misses are shown as -1)\n");
+    for (size_t n = 10000; n <= 1000000; n *= 10) {
+        char **names = malloc(n * sizeof(char *));
+        for (size_t i = 0; i < n; ++i) {
+            names[i] = malloc(24);
+            snprintf(names[i], 24, "option_%zu", i);
+        }
+        //Lookup order drawn up front, so the loop only does lookups
+        uint32_t *order = malloc(FOOTPRINT_BENCH_LOOKUPS * sizeof(uint32_t));
+        uint64_t state = 88172645463325252ULL;
+        for (size_t i = 0; i < FOOTPRINT_BENCH_LOOKUPS; ++i) order[i] = (uint32_t) nextIndex(&state, n);
+
+        for (int arena = 0; arena < 2; ++arena) {
+            Option **config;
+            if (arena) {
+                INIT_CONFIG_ARENA(config);
+            } else {
+                INIT_CONFIG(config);
+            }
+            for (size_t i = 0; i < n; ++i) ADD_OPT_LONG(config, names[i], (long) i);
+
+            long v = 0, sum = 0;
+            double best = 0, l1Misses = -1, llcMisses = -1;
+            for (int run = 0; run < 3; ++run) {
+                startCounter(l1);
+                startCounter(llc);
+                double start = nowNs();
+                for (size_t i = 0; i < FOOTPRINT_BENCH_LOOKUPS; ++i) {
+                    get(config, names[order[i]], &v);
+                    sum += v;
+                }
+                double elapsed = nowNs() - start;
+                double l1Run = stopCounter(l1, FOOTPRINT_BENCH_LOOKUPS);
+                double llcRun = stopCounter(llc, FOOTPRINT_BENCH_LOOKUPS);
+                if (!best || elapsed < best) {
+                    best = elapsed;
+                    l1Misses = l1Run;
+                    llcMisses = llcRun;
+                }
+            }
+            printf("%7zu options %-6s %6.1f ns/lookup, %5.2f L1D misses, %5.2f LLC misses (checksum %ld)\n", n,
+                   arena ? "arena" : "malloc", best / FOOTPRINT_BENCH_LOOKUPS, l1Misses, llcMisses, sum);
+            cleanOptions(config);
+        }
+        for (size_t i = 0; i < n; ++i) free(names[i]);
+        free(names);
+        free(order);
+    }
+    if (l1 >= 0) close(l1);
+    if (llc >= 0) close(llc);
+}
+
+static void benchHandle(void) {
+    printf("== handle: get() against a compiled path and a pre-resolved handle for 'limits.max_conn' ==\n");
+    const size_t reads = 1000000;
+    Option **config;
+    Option **limits;
+    INIT_CONFIG(config);
+    INIT_CONFIG(limits);
+    char names[100][16];
+    for (int i = 0; i < 100; ++i) {
+        snprintf(names[i], sizeof(names[i]), "opt_%d", i);
+        ADD_OPT_LONG(config, names[i], i);
+    }
+    ADD_OPT_LONG(limits, "max_conn", 1024);
+    ADD_OPT_LONG(limits, "max_body", 1 << 20);
+    ADD_OPT_COMPOUND(config, "limits", limits);
+
+    long v = 0, sum = 0;
+    double start = nowNs();
+    for (size_t i = 0; i < reads; ++i) {
+        get(config, "limits.max_conn", &v);
+        sum += v;
+    }
+    double getNs = (nowNs() - start) / (double) reads;
+
+    OptionPath *maxConnPath = compilePath("limits.max_conn");
+    start = nowNs();
+    for (size_t i = 0; i < reads; ++i) {
+        get_path(config, maxConnPath, &v);
+        sum += v;
+    }
+    double pathNs = (nowNs() - start) / (double) reads;
+    freePath(maxConnPath);
+
+    OptionHandle maxConn = getHandle(config, "limits.max_conn");
+    start = nowNs();
+    for (size_t i = 0; i < reads; ++i) {
+        get_handle(maxConn, &v);
+        sum += v;
+        __asm__ volatile("" : : "g"(maxConn) : "memory"); //keep the read inside the loop
+    }
+    double handleNs = (nowNs() - start) / (double) reads;
+
+    printf("get():    %6.2f ns/read\ngetPath(): %5.2f ns/read\nhandle:   %6.2f ns/read (checksum %ld)\n",
+           getNs, pathNs, handleNs, sum);
+    cleanOptions(config);
+}
+
+#define BIND_BENCH_OPTIONS 1000
+#define BIND_BENCH_RELOADS 2000
+
+typedef struct BenchSettings {
+    long longs[BIND_BENCH_OPTIONS / 2];
+    double doubles[BIND_BENCH_OPTIONS / 2];
+} BenchSettings;
+
+//Filling a settings struct after every reload: get() per field against the pass over bound fields
+static void benchBind(void) {
+    printf("== bind: filling a settings struct of %d fields on every reload, get() against BIND_OPT ==\n",
+           BIND_BENCH_OPTIONS);
+    static char names[BIND_BENCH_OPTIONS][16];
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    FILE *fp = fdopen(mkstemp(path), "w");
+    for (int i = 0; i < BIND_BENCH_OPTIONS; ++i) {
+        snprintf(names[i], sizeof(names[i]), "field_%d", i);
+        if (i % 2) fprintf(fp, "%s = %d.5\n", names[i], i);
+        else fprintf(fp, "%s = %d\n", names[i], i);
+    }
+    fclose(fp);
+
+    double times[2];
+    long checksum = 0;
+    for (int mode = 0; mode < 2; ++mode) {
+        Option **config;
+        INIT_CONFIG(config);
+        for (int i = 0; i < BIND_BENCH_OPTIONS; ++i) {
+            if (i % 2) {
+                ADD_OPT_DOUBLE(config, names[i], 0);
+            } else {
+                ADD_OPT_LONG(config, names[i], 0);
+            }
+        }
+        for (int i = 0; mode == 1 && i < BIND_BENCH_OPTIONS; ++i) {
+            if (i % 2) {
+                bindOption(config, names[i], offsetof(BenchSettings, doubles) + i / 2 * sizeof(double), BIND_DOUBLE);
+            } else {
+                bindOption(config, names[i], offsetof(BenchSettings, longs) + i / 2 * sizeof(long), BIND_LONG);
+            }
+        }
+        BenchSettings settings[2] = {0}; //One being read, one being filled by the reload
+        double reloads = 0;
+        for (int reload = 0; reload < BIND_BENCH_RELOADS; ++reload) {
+            BenchSettings *next = &settings[reload % 2];
+            readConfig(config, path);
+            //setBindTarget runs the same pass readConfig ends with, timed on its own here
+            double start = nowNs();
+            if (mode == 1) setBindTarget(config, next);
+            for (int i = 0; !mode && i < BIND_BENCH_OPTIONS; ++i) {
+                if (i % 2) get(config, names[i], &next->doubles[i / 2]);
+                else get(config, names[i], &next->longs[i / 2]);
+            }
+            reloads += nowNs() - start;
+            checksum += next->longs[reload % (BIND_BENCH_OPTIONS / 2)];
+        }
+        times[mode] = reloads / BIND_BENCH_RELOADS;
+        cleanOptions(config);
+    }
+    printf("get() per field: %8.0f ns per reload\nbound:           %8.0f ns per reload\n", times[0], times[1]);
+    printf("checksum %ld\n", checksum);
+    unlink(path);
+}
+
+#define ARENA_BENCH_OPTIONS 500
+#define ARENA_BENCH_ITEMS 20000
+
+static char optionNames[2][ARENA_BENCH_OPTIONS][16];
+
+//A larger version of the schema in test/main.c: flat options plus a compound array with a template
+static Option **buildSchema(bool arena) {
+    Option **config;
+    Option **item;
+    if (arena) {
+        INIT_CONFIG_ARENA(config);
+        INIT_CONFIG_CHILD(item, config);
+    } else {
+        INIT_CONFIG(config);
+        INIT_CONFIG(item);
+    }
+    for (int i = 0; i < ARENA_BENCH_OPTIONS; ++i) {
+        ADD_OPT_STR(config, optionNames[0][i], "default");
+        ADD_OPT_LONG(config, optionNames[1][i], 0);
+    }
+    ADD_OPT_LONG(item, "breh", 12);
+    ADD_OPT_STR(item, "name", "unnamed");
+    ADD_OPT_DOUBLE(item, "ratio", 1.0);
+    static long arrDef[] = {33, 22, 44};
+    ADD_OPT_ARRAY_LONG(item, "arr", arrDef);
+    static bool arrbDef[] = {true, false};
+    ADD_OPT_ARRAY_BOOL(item, "arrb", arrbDef);
+    corpusAddItems(config, "items", item);
+    return config;
+}
+
+static void writeArenaCorpus(const char *path) {
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < ARENA_BENCH_OPTIONS; ++i) {
+        fprintf(fp, "%s = \"value number %d\"\n%s = %d\n", optionNames[0][i], i, optionNames[1][i], i);
+    }
+    fprintf(fp, "items = [");
+    for (int i = 0; i < ARENA_BENCH_ITEMS; ++i) {
+        fprintf(fp, "%s{\n  breh = %d\n  arr = [%d, %d, %d, %d, %d]\n  arrb = [yes, no, true]\n}",
+                i ? ", " : "", i, i, i + 1, i + 2, i + 3, i + 4);
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+}
+
+static void nameArenaOptions(void) {
+    for (int i = 0; i < ARENA_BENCH_OPTIONS; ++i) {
+        snprintf(optionNames[0][i], sizeof(optionNames[0][i]), "str_%d", i);
+        snprintf(optionNames[1][i], sizeof(optionNames[1][i]), "long_%d", i);
+    }
+}
+
+static void benchArena(void) {
+    printf("== arena: malloc and arena configs, %d options + %d compound array elements ==\n",
+           2 * ARENA_BENCH_OPTIONS, ARENA_BENCH_ITEMS);
+    nameArenaOptions();
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    writeArenaCorpus(path);
+
+    printf("allocations/frees and wall time per phase\n");
+    printf("%-7s %15s %15s %15s %15s | %8s %8s %9s %8s\n", "mode", "init", "read", "reload", "clean",
+           "init ms", "read ms", "reload ms", "clean ms");
+    for (int arena = 0; arena < 2; ++arena) {
+        size_t allocs[4], freed[4];
+        double times[4];
+        for (int phase = 0; phase < 4; ++phase) {
+            static Option **config;
+            size_t allocsBefore = allocations, freesBefore = frees;
+            double start = nowNs();
+            if (phase == 0) config = buildSchema(arena);
+            else if (phase == 3) cleanOptions(config);
+            else readConfig(config, path);
+            times[phase] = nowNs() - start;
+            allocs[phase] = allocations - allocsBefore;
+            freed[phase] = frees - freesBefore;
+        }
+
+        printf("%-7s", arena ? "arena" : "malloc");
+        for (int phase = 0; phase < 4; ++phase) printf(" %7zu/%-7zu", allocs[phase], freed[phase]);
+        printf(" | %8.2f %8.2f %9.2f %8.2f\n", times[0] / 1e6, times[1] / 1e6, times[2] / 1e6, times[3] / 1e6);
+    }
+    unlink(path);
+}
+
+#define STATIC_BENCH_MAX_OPTIONS 100000
+#define STATIC_BENCH_BUILDS 1000000 //options built per size, split into as many schemas as it takes
+
+static char staticNames[STATIC_BENCH_MAX_OPTIONS][16];
+static StaticOption staticSchema[STATIC_BENCH_MAX_OPTIONS + 1];
+
+//The same flat schema of longs, doubles, bools and strings three ways: ADD_OPT_* into a malloc config, ADD_OPT_* into
+//an arena config, and INIT_CONFIG_STATIC
+static Option **buildFlatSchema(int mode, size_t count) {
+    Option **config;
+    if (mode == 2) {
+        StaticOption next = staticSchema[count];
+        staticSchema[count] = (StaticOption) STATIC_END;
+        INIT_CONFIG_STATIC(config, staticSchema);
+        staticSchema[count] = next;
+        return config;
+    }
+    if (mode == 1) {
+        INIT_CONFIG_ARENA(config);
+    } else {
+        INIT_CONFIG(config);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        switch (i % 4) {
+            case 0: {
+                ADD_OPT_LONG(config, staticNames[i], 1);
+                break;
+            }
+            case 1: {
+                ADD_OPT_DOUBLE(config, staticNames[i], 0.5);
+                break;
+            }
+            case 2: {
+                ADD_OPT_BOOL(config, staticNames[i], true);
+                break;
+            }
+            default: {
+                ADD_OPT_STR(config, staticNames[i], "default");
+                break;
+            }
+        }
+    }
+    return config;
+}
+
+static void benchStatic(void) {
+    printf("== static: schema startup, ADD_OPT_* against INIT_CONFIG_STATIC ==\n");
+    //Filled in here only because the names are generated, a real schema is a static const table
+    for (size_t i = 0; i < STATIC_BENCH_MAX_OPTIONS; ++i) {
+        snprintf(staticNames[i], sizeof(staticNames[i]), "option_%zu", i);
+        switch (i % 4) {
+            case 0:
+                staticSchema[i] = (StaticOption) STATIC_LONG(staticNames[i], 1);
+                break;
+            case 1:
+                staticSchema[i] = (StaticOption) STATIC_DOUBLE(staticNames[i], 0.5);
+                break;
+            case 2:
+                staticSchema[i] = (StaticOption) STATIC_BOOL(staticNames[i], true);
+                break;
+            default:
+                staticSchema[i] = (StaticOption) STATIC_STR(staticNames[i], "default");
+                break;
+        }
+    }
+
+    const char *modes[] = {"malloc", "arena", "static"};
+    printf("%-8s %-7s %12s %12s %14s %14s\n", "options", "mode", "init ns/opt", "clean ns/opt", "allocs/schema",
+           "frees/schema");
+    for (size_t count = 100; count <= STATIC_BENCH_MAX_OPTIONS; count *= 10) {
+        size_t rounds = STATIC_BENCH_BUILDS / count;
+        for (int mode = 0; mode < 3; ++mode) {
+            double init = 0, clean = 0;
+            size_t allocsBefore = allocations, freesBefore = frees;
+            for (size_t round = 0; round < rounds; ++round) {
+                double start = nowNs();
+                Option **config = buildFlatSchema(mode, count);
+                double built = nowNs();
+                cleanOptions(config);
+                init += built - start;
+                clean += nowNs() - built;
+            }
+            printf("%-8zu %-7s %12.1f %12.1f %14zu %14zu\n", count, modes[mode], init / (double) (rounds * count),
+                   clean / (double) (rounds * count), (allocations - allocsBefore) / rounds,
+                   (frees - freesBefore) / rounds);
+        }
+    }
+}
+
+#define SCAN_BENCH_OPTIONS 1000
+#define SCAN_BENCH_BYTES (64 * 1024 * 1024)
+
+//A large flat config: the same schema assigned over and over, with comments and double quoted strings only (a string
+//search used to run to the end of the file looking for the other quote type)
+static size_t writeScanCorpus(const char *path) {
+    FILE *fp = fopen(path, "w");
+    size_t written = 0;
+    for (int i = 0; written < SCAN_BENCH_BYTES; i = (i + 1) % SCAN_BENCH_OPTIONS) {
+        switch (i % 4) {
+            case 0:
+                written += fprintf(fp, "option_%d = %d // line comment\n", i, i * 7);
+                break;
+            case 1:
+                written += fprintf(fp, "option_%d = %d.25\n", i, i);
+                break;
+            case 2:
+                written += fprintf(fp, "option_%d = %s\n", i, i & 4 ? "yes" : "false");
+                break;
+            default:
+                written += fprintf(fp, "option_%d = \"value %d\"\n", i, i);
+                break;
+        }
+    }
+    fclose(fp);
+    return written;
+}
+
+static void benchScan(void) {
+    printf("== scan: readConfig throughput on a %d MiB flat config ==\n", SCAN_BENCH_BYTES / (1024 * 1024));
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    size_t bytes = writeScanCorpus(path);
+
+    static char names[SCAN_BENCH_OPTIONS][16];
+    Option **config;
+    INIT_CONFIG(config);
+    for (int i = 0; i < SCAN_BENCH_OPTIONS; ++i) {
+        snprintf(names[i], sizeof(names[i]), "option_%d", i);
+        switch (i % 4) {
+            case 0: ADD_OPT_LONG(config, names[i], 0);
+                break;
+            case 1: ADD_OPT_DOUBLE(config, names[i], 0);
+                break;
+            case 2: ADD_OPT_BOOL(config, names[i], false);
+                break;
+            default: ADD_OPT_STR(config, names[i], "");
+                break;
+        }
+    }
+
+    //The SIMD path the library was built with against the scalar one, on the same file
+    double best[2] = {0, 0};
+    for (int scalar = 0; scalar < 2; ++scalar) {
+        const char *backend = setScalarScan(scalar);
+        if (!scalar && !strcmp(backend, "scalar")) continue; //Built without SIMD, there is only the one path
+        for (int run = 0; run < 5; ++run) {
+            double start = nowNs();
+            readConfig(config, path);
+            double elapsed = nowNs() - start;
+            if (!best[scalar] || elapsed < best[scalar]) best[scalar] = elapsed;
+        }
+        printf("%-6s best of 5: %.2f ms, %.3f GB/s\n", backend, best[scalar] / 1e6, (double) bytes / best[scalar]);
+    }
+    if (best[0]) printf("SIMD is %.2fx the scalar path\n", best[1] / best[0]);
+    setScalarScan(false);
+    cleanOptions(config);
+    unlink(path);
+}
+
+static void benchStats(void) {
+    printf("== stats: readConfig of the scan config without and with setParseStats ==\n");
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    writeScanCorpus(path);
+
+    static char names[SCAN_BENCH_OPTIONS][16];
+    Option **config;
+    INIT_CONFIG(config);
+    for (int i = 0; i < SCAN_BENCH_OPTIONS; ++i) {
+        snprintf(names[i], sizeof(names[i]), "option_%d", i);
+        switch (i % 4) {
+            case 0: ADD_OPT_LONG(config, names[i], 0);
+                break;
+            case 1: ADD_OPT_DOUBLE(config, names[i], 0);
+                break;
+            case 2: ADD_OPT_BOOL(config, names[i], false);
+                break;
+            default: ADD_OPT_STR(config, names[i], "");
+                break;
+        }
+    }
+
+    ParseStats stats = {0};
+    for (int enabled = 0; enabled < 2; ++enabled) {
+        setParseStats(config, enabled ? &stats : NULL);
+        double best = 0;
+        size_t allocs = 0;
+        for (int run = 0; run < 5; ++run) {
+            size_t allocsBefore = allocations;
+            double start = nowNs();
+            readConfig(config, path);
+            double elapsed = nowNs() - start;
+            if (!best || elapsed < best) best = elapsed;
+            allocs = allocations - allocsBefore;
+        }
+        printf("%-9s best of 5: %.2f ms, %zu allocations per read\n", enabled ? "stats on" : "stats off", best / 1e6,
+               allocs);
+    }
+    printf("last read: read %.2f ms, preprocess %.2f ms, parse %.2f ms of %.2f ms; %zu options, %zu mallocs, "
+           "%zu reallocs\n", stats.readNs / 1e6, stats.preprocessNs / 1e6, stats.parseNs / 1e6, stats.totalNs / 1e6,
+           stats.options, stats.mallocs, stats.reallocs);
+    printf("probe lengths:");
+    for (int i = 0; i < PARSE_STATS_PROBES; ++i) printf(" %s%d: %zu", i + 1 == PARSE_STATS_PROBES ? ">=" : "", i + 1,
+                                                         stats.probes[i]);
+    printf("\n");
+    parseStatsFree(&stats);
+    cleanOptions(config);
+    unlink(path);
+}
+
+#define DIAGNOSTICS_BENCH_KEYS 100000
+#define DIAGNOSTICS_BENCH_CAP 100
+
+static void countDiagnostic(const Diagnostic *diagnostic, void *user) {
+    *(size_t *) user += diagnostic->line != 0;
+}
+
+//A file of stale keys the schema no longer has: every one a warning, written to stderr (sent to /dev/null here), kept
+//by a sink, or mostly dropped by a sink's per load cap before its position is worked out
+static void benchDiagnostics(void) {
+    printf("== diagnostics: readConfig of %d unknown keys by where the warnings go ==\n", DIAGNOSTICS_BENCH_KEYS);
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    FILE *fp = fdopen(mkstemp(path), "w");
+    fprintf(fp, "known = 1\n");
+    for (int i = 0; i < DIAGNOSTICS_BENCH_KEYS; ++i) fprintf(fp, "stale_option_%d = %d\n", i, i);
+    fclose(fp);
+
+    Option **config;
+    INIT_CONFIG(config);
+    ADD_OPT_LONG(config, "known", 0);
+    for (int mode = 0; mode < 4; ++mode) {
+        size_t emitted = 0;
+        DiagnosticSink sink = {0};
+        if (mode == 2) {
+            sink.emit = countDiagnostic;
+            sink.user = &emitted;
+        }
+        if (mode == 3) sink.maxPerLoad = DIAGNOSTICS_BENCH_CAP;
+        setDiagnosticSink(config, mode ? &sink : NULL);
+
+        fflush(stderr);
+        int err = dup(STDERR_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDERR_FILENO);
+        double start = nowNs();
+        readConfig(config, path);
+        double elapsed = nowNs() - start;
+        dup2(err, STDERR_FILENO);
+        close(err);
+        close(devNull);
+
+        static const char *const modes[] = {"stderr", "buffered", "callback", "capped"};
+        printf("%-9s %8.2f ms, %zu warnings, %zu kept, %zu suppressed\n", modes[mode], elapsed / 1e6,
+               mode ? sink.warnings : (size_t) DIAGNOSTICS_BENCH_KEYS, mode == 2 ? emitted : sink.count,
+               sink.suppressed);
+        setDiagnosticSink(config, NULL);
+        diagnosticSinkClear(&sink);
+    }
+    cleanOptions(config);
+    unlink(path);
+}
+
+#define NUMERIC_BENCH_ELEMENTS 1000000
+
+static void benchNumeric(void) {
+    printf("== numeric: readConfig on a long and a double array of %d elements each ==\n", NUMERIC_BENCH_ELEMENTS);
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    FILE *fp = fopen(path, "w");
+    uint64_t state = 88172645463325252ULL;
+    fprintf(fp, "longs = [");
+    for (int i = 0; i < NUMERIC_BENCH_ELEMENTS; ++i) {
+        fprintf(fp, "%s%ld", i ? ", " : "", (long) nextIndex(&state, 2000000000) - 1000000000);
+    }
+    fprintf(fp, "]\ndoubles = [");
+    for (int i = 0; i < NUMERIC_BENCH_ELEMENTS; ++i) {
+        fprintf(fp, "%s%.*g", i ? ", " : "", 4 + i % 14, (double) nextIndex(&state, 1000000) / 997.0 - 500.0);
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+
+    Option **config;
+    INIT_CONFIG(config);
+    long longsDef[] = {0};
+    double doublesDef[] = {0};
+    ADD_OPT_ARRAY_LONG(config, "longs", longsDef);
+    ADD_OPT_ARRAY_DOUBLE(config, "doubles", doublesDef);
+
+    double best = 0;
+    size_t allocs = 0;
+    for (int run = 0; run < 5; ++run) {
+        size_t allocsBefore = allocations;
+        double start = nowNs();
+        readConfig(config, path);
+        double elapsed = nowNs() - start;
+        if (!best || elapsed < best) best = elapsed;
+        allocs = allocations - allocsBefore;
+    }
+    printf("best of 5: %.2f ms, %.1f M elements/s, %zu allocations per read\n", best / 1e6,
+           2.0 * NUMERIC_BENCH_ELEMENTS / best * 1e3, allocs);
+    cleanOptions(config);
+    unlink(path);
+}
+
+#define PARALLEL_BENCH_ITEMS 100000
+
+static void benchParallel(void) {
+    printf("== parallel: readConfig of a %d element compound array against setParseThreads ==\n",
+           PARALLEL_BENCH_ITEMS);
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "items = [");
+    for (int i = 0; i < PARALLEL_BENCH_ITEMS; ++i) {
+        fprintf(fp, "%s{\n  breh = %d\n  name = \"service %d\"\n  ratio = %d.5\n  arr = [%d, %d, %d]\n"
+                    "  arrb = [yes, no]\n}", i ? ", " : "", i, i, i, i, i + 1, i + 2);
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+
+    for (int arena = 0; arena < 2; ++arena) {
+        Option **config = buildSchema(arena);
+        double serial = 0;
+        char *serialText = NULL; //Written out after the serial parse, every parallel one has to give the same
+        size_t serialLen = 0;
+        for (unsigned threads = 1; threads <= 16; threads *= 2) {
+            setParseThreads(config, threads);
+            double best = 0;
+            for (int run = 0; run < 3; ++run) {
+                double start = nowNs();
+                readConfig(config, path);
+                double elapsed = nowNs() - start;
+                if (!best || elapsed < best) best = elapsed;
+            }
+            char *text;
+            size_t len;
+            writeConfigString(config, &text, &len);
+            bool same = true;
+            if (threads == 1) {
+                serial = best;
+                serialText = text;
+                serialLen = len;
+            } else {
+                same = len == serialLen && !memcmp(text, serialText, len);
+                free(text);
+            }
+            benchFailed |= !same;
+            printf("%-6s %2u threads: %8.2f ms, %5.2fx%s\n", arena ? "arena" : "malloc", threads, best / 1e6,
+                   serial / best, same ? "" : ", values DIFFER from the serial parse");
+        }
+        free(serialText);
+        cleanOptions(config);
+    }
+    unlink(path);
+}
+
+#define ELEMENT_BENCH_ITEMS 50000
+#define ELEMENT_BENCH_FIELDS 40
+
+static char fieldNames[ELEMENT_BENCH_FIELDS][16];
+
+static Option **buildElementSchema(bool arena) {
+    Option **config;
+    Option **item;
+    if (arena) {
+        INIT_CONFIG_ARENA(config);
+        INIT_CONFIG_CHILD(item, config);
+    } else {
+        INIT_CONFIG(config);
+        INIT_CONFIG(item);
+    }
+    for (int i = 0; i < ELEMENT_BENCH_FIELDS; ++i) {
+        if (i % 4 == 1) {
+            ADD_OPT_STR(item, fieldNames[i], "default");
+        } else if (i % 4 == 2) {
+            ADD_OPT_DOUBLE(item, fieldNames[i], 0.5);
+        } else {
+            ADD_OPT_LONG(item, fieldNames[i], 0);
+        }
+    }
+    corpusAddItems(config, "items", item);
+    return config;
+}
+
+//Compound array elements that set 2 of the 40 fields of their template, the rest keep the template's defaults. Heap is
+//what the read left allocated, arena chunks included
+static void benchElements(void) {
+    printf("== elements: %d compound array elements setting 2 of %d template fields ==\n", ELEMENT_BENCH_ITEMS,
+           ELEMENT_BENCH_FIELDS);
+    for (int i = 0; i < ELEMENT_BENCH_FIELDS; ++i) snprintf(fieldNames[i], sizeof(fieldNames[i]), "field_%d", i);
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "items = [");
+    for (int i = 0; i < ELEMENT_BENCH_ITEMS; ++i) {
+        fprintf(fp, "%s{ %s = %d\n  %s = \"item %d\" }", i ? ", " : "", fieldNames[0], i, fieldNames[1], i);
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+
+    for (int arena = 0; arena < 2; ++arena) {
+        double best = 0;
+        size_t bytes = 0, allocs = 0;
+        long last = 0;
+        for (int run = 0; run < 5; ++run) {
+            Option **config = buildElementSchema(arena);
+            size_t heapBefore = mallinfo2().uordblks, allocsBefore = allocations;
+            double start = nowNs();
+            readConfig(config, path);
+            double elapsed = nowNs() - start;
+            if (!best || elapsed < best) best = elapsed;
+            bytes = mallinfo2().uordblks - heapBefore;
+            allocs = allocations - allocsBefore;
+
+            Option ***items;
+            size_t count = 0;
+            get_array(config, "items", &items, count);
+            if (count) get(items[count - 1], fieldNames[0], &last);
+            cleanOptions(config);
+        }
+        printf("%-6s read %7.2f ms, %7.2f MB heap (%4.0f bytes/element), %7zu allocations, last %s = %ld\n",
+               arena ? "arena" : "malloc", best / 1e6, bytes / 1e6, (double) bytes / ELEMENT_BENCH_ITEMS, allocs,
+               fieldNames[0], last);
+    }
+    unlink(path);
+}
+
+//Where the memory of the elements config goes by configMemory, next to what the heap says the read left allocated,
+//and reads under setMemoryLimit: one with room to spare and one a quarter of the config's size stops at
+static void benchMemory(void) {
+    printf("== memory: configMemory of %d compound array elements, reads under setMemoryLimit ==\n",
+           ELEMENT_BENCH_ITEMS);
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "items = [");
+    for (int i = 0; i < ELEMENT_BENCH_ITEMS; ++i) {
+        fprintf(fp, "%s{ %s = %d\n  %s = \"item %d\" }", i ? ", " : "", fieldNames[0], i, fieldNames[1], i);
+    }
+    fprintf(fp, "]\n");
+    fclose(fp);
+
+    for (int arena = 0; arena < 2; ++arena) {
+        Option **config = buildElementSchema(arena);
+        size_t heapBefore = mallinfo2().uordblks;
+        readConfig(config, path);
+        size_t heapBytes = mallinfo2().uordblks - heapBefore;
+        double start = nowNs();
+        ConfigMemory memory = configMemory(config);
+        double walkNs = nowNs() - start;
+        printf("%-6s %.2f MB (heap %.2f MB): tables %.2f, options %.2f, elements %.2f, strings %.2f, arrays %.2f, "
+               "unused %.2f; walked in %.2f ms\n", arena ? "arena" : "malloc", memory.total / 1e6, heapBytes / 1e6,
+               memory.tables / 1e6, memory.options / 1e6, memory.elements / 1e6, memory.strings / 1e6,
+               memory.arrays / 1e6, memory.arenaUnused / 1e6, walkNs / 1e6);
+
+        cleanOptions(config);
+
+        //Best of 5 reads into a fresh config without a limit, with room under one and stopping at one
+        double readNs[3] = {0};
+        size_t limits[3] = {0, memory.total * 4, memory.total / 4};
+        fflush(stderr);
+        int err = dup(STDERR_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDERR_FILENO);
+        for (int run = 0; run < 15; ++run) {
+            config = buildElementSchema(arena);
+            setMemoryLimit(config, limits[run % 3]);
+            start = nowNs();
+            readConfig(config, path);
+            double elapsed = nowNs() - start;
+            if (!readNs[run % 3] || elapsed < readNs[run % 3]) readNs[run % 3] = elapsed;
+            cleanOptions(config);
+        }
+        dup2(err, STDERR_FILENO);
+        close(err);
+        close(devNull);
+        printf("%-6s read %.2f ms, %.2f ms under a %.2f MB limit, %.2f ms to stop at a %.2f MB one\n", "",
+               readNs[0] / 1e6, readNs[1] / 1e6, limits[1] / 1e6, readNs[2] / 1e6, limits[2] / 1e6);
+    }
+    unlink(path);
+}
+
+#define INCLUDE_BENCH_FILES 500
+#define INCLUDE_BENCH_OPTIONS 20
+
+static void benchInclude(void) {
+    printf("== include: readConfig of a config including %d conf.d fragments against setParseThreads ==\n",
+           INCLUDE_BENCH_FILES);
+    char dir[] = "/tmp/libconf_bench_XXXXXX";
+    char path[64];
+    mkdtemp(dir);
+    snprintf(path, sizeof(path), "%s/conf.d", dir);
+    mkdir(path, 0700);
+    for (int i = 0; i < INCLUDE_BENCH_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/conf.d/%03d.conf", dir, i);
+        FILE *fp = fopen(path, "w");
+        for (int j = 0; j < INCLUDE_BENCH_OPTIONS; ++j) fprintf(fp, "include_%d = %d\n", j, i * j);
+        fclose(fp);
+    }
+    snprintf(path, sizeof(path), "%s/main.conf", dir);
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "#include \"conf.d/*.conf\"\n");
+    fclose(fp);
+
+    static char names[INCLUDE_BENCH_OPTIONS][16];
+    Option **config;
+    INIT_CONFIG(config);
+    for (int i = 0; i < INCLUDE_BENCH_OPTIONS; ++i) {
+        snprintf(names[i], sizeof(names[i]), "include_%d", i);
+        ADD_OPT_LONG(config, names[i], 0);
+    }
+    for (unsigned threads = 1; threads <= 16; threads *= 2) {
+        setParseThreads(config, threads);
+        double best = 0;
+        size_t allocs = 0;
+        for (int run = 0; run < 5; ++run) {
+            size_t allocsBefore = allocations;
+            double start = nowNs();
+            readConfig(config, path);
+            double elapsed = nowNs() - start;
+            if (!best || elapsed < best) best = elapsed;
+            allocs = allocations - allocsBefore;
+        }
+        printf("%2u threads: %6.2f ms, %zu allocations per read\n", threads, best / 1e6, allocs);
+    }
+
+    setParseThreads(config, 1);
+    IncludeCache *cache = includeCacheCreate();
+    setIncludeCache(config, cache);
+    readConfig(config, path); //Fills the cache
+    double best = 0;
+    size_t allocs = 0;
+    for (int run = 0; run < 5; ++run) {
+        size_t allocsBefore = allocations;
+        double start = nowNs();
+        readConfig(config, path);
+        double elapsed = nowNs() - start;
+        if (!best || elapsed < best) best = elapsed;
+        allocs = allocations - allocsBefore;
+    }
+    IncludeCacheStats stats = includeCacheStats(cache);
+    printf("cached:     %6.2f ms, %zu allocations per read (%zu hits, %zu misses, %zu entries, %zu bytes)\n",
+           best / 1e6, allocs, stats.hits, stats.misses, stats.entries, stats.bytes);
+    cleanOptions(config);
+    includeCacheFree(cache);
+
+    unlink(path);
+    for (int i = 0; i < INCLUDE_BENCH_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/conf.d/%03d.conf", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/conf.d", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+//Startup of a process: a new config from the schema, loaded once. The cache is written by the first cached load
+static void benchCache(void) {
+    printf("== cache: startup with readConfig against readConfigCached, %d options + %d compound array elements ==\n",
+           2 * ARENA_BENCH_OPTIONS, ARENA_BENCH_ITEMS);
+    nameArenaOptions();
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    writeArenaCorpus(path);
+    char cachePath[64];
+    snprintf(cachePath, sizeof(cachePath), "%s.cache", path);
+
+    const char *modes[] = {"readConfig", "readConfigMapped", "cached, miss", "cached, hit"};
+    for (int mode = 0; mode < 4; ++mode) {
+        double best = 0;
+        size_t allocs = 0;
+        bool hit = false;
+        for (int run = 0; run < 5; ++run) {
+            if (mode == 2) unlink(cachePath);
+            Option **config = buildSchema(false);
+            size_t allocsBefore = allocations;
+            double start = nowNs();
+            if (mode == 0) readConfig(config, path);
+            else if (mode == 1) readConfigMapped(config, path);
+            else hit = readConfigCached(config, path, cachePath);
+            double elapsed = nowNs() - start;
+            if (!best || elapsed < best) best = elapsed;
+            allocs = allocations - allocsBefore;
+            cleanOptions(config);
+        }
+        printf("%-16s %8.2f ms, %6zu allocations%s\n", modes[mode], best / 1e6, allocs,
+               mode >= 2 && hit != (mode == 3) ? " (unexpected cache result)" : "");
+    }
+    printf("config %zu bytes, cache %zu bytes\n", getFileSize(path), getFileSize(cachePath));
+    unlink(cachePath);
+    unlink(path);
+}
+
+#define WRITE_BENCH_ELEMENTS 1000000
+
+static Option **buildNumberSchema(void) {
+    static long longsDef[] = {0};
+    static double doublesDef[] = {0};
+    Option **config;
+    INIT_CONFIG(config);
+    ADD_OPT_ARRAY_LONG(config, "longs", longsDef);
+    ADD_OPT_ARRAY_DOUBLE(config, "doubles", doublesDef);
+    return config;
+}
+
+//The arena corpus (strings, longs and compound elements) and two large number arrays, written to memory and to a
+//file, against formatting the arrays with fprintf
+static void benchWrite(void) {
+    printf("== write: writeConfig throughput ==\n");
+    nameArenaOptions();
+    char path[] = "/tmp/libconf_bench_XXXXXX";
+    close(mkstemp(path));
+    writeArenaCorpus(path);
+    Option **corpus = buildSchema(false);
+    readConfig(corpus, path);
+
+    Option **numbers = buildNumberSchema();
+    Option *longs = get_(numbers, "longs"), *doubles = get_(numbers, "doubles");
+    uint64_t state = 88172645463325252ULL;
+    longs->v_a.a_l = malloc(WRITE_BENCH_ELEMENTS * sizeof(long));
+    doubles->v_a.a_d = malloc(WRITE_BENCH_ELEMENTS * sizeof(double));
+    longs->v_a.len = doubles->v_a.len = WRITE_BENCH_ELEMENTS;
+    for (int i = 0; i < WRITE_BENCH_ELEMENTS; ++i) {
+        longs->v_a.a_l[i] = (long) nextIndex(&state, 2000000000) - 1000000000;
+        //Half of them with two decimals, the rest need all 17 digits
+        doubles->v_a.a_d[i] = i % 2 ? (double) nextIndex(&state, 1000000) / 100.0
+                                    : (double) nextIndex(&state, 1000000) / 997.0 - 500.0;
+    }
+
+    Option **configs[] = {corpus, numbers};
+    const char *names[] = {"corpus", "numbers"};
+    for (int c = 0; c < 2; ++c) {
+        double bestMemory = 0, bestFile = 0;
+        size_t bytes = 0;
+        for (int run = 0; run < 5; ++run) {
+            char *text;
+            double start = nowNs();
+            writeConfigString(configs[c], &text, &bytes);
+            double elapsed = nowNs() - start;
+            if (!bestMemory || elapsed < bestMemory) bestMemory = elapsed;
+            free(text);
+
+            start = nowNs();
+            writeConfig(configs[c], path);
+            elapsed = nowNs() - start;
+            if (!bestFile || elapsed < bestFile) bestFile = elapsed;
+        }
+        //Read back into a fresh schema and written again, the text has to come out the same
+        Option **copy = c ? buildNumberSchema() : buildSchema(false);
+        readConfig(copy, path);
+        char *first, *second;
+        size_t firstLen, secondLen;
+        writeConfigString(configs[c], &first, &firstLen);
+        writeConfigString(copy, &second, &secondLen);
+        bool same = firstLen == secondLen && !memcmp(first, second, firstLen);
+        free(first);
+        free(second);
+        cleanOptions(copy);
+        printf("%-8s %6.2f MB: memory %7.1f MB/s, file %7.1f MB/s, round trip %s\n", names[c], bytes / 1e6,
+               bytes / bestMemory * 1e3, bytes / bestFile * 1e3, same ? "identical" : "DIFFERENT");
+        benchFailed |= !same;
+    }
+
+    //A line of a string that starts with # would come back as whatever the preprocessor makes of it, so the string
+    //is refused and the rest still round trips
+    Option **macro;
+    INIT_CONFIG(macro);
+    ADD_OPT_STR(macro, "s", "none");
+    ADD_OPT_LONG(macro, "n", 0);
+    const char *value = "line1\n  #include \"inc1.conf\"\nline3";
+    get_(macro, "s")->v_sv = (StringView) {strdup(value), strlen(value)};
+    get_(macro, "n")->v_l = 42;
+    char *text;
+    size_t textLen;
+    bool written = writeConfigString(macro, &text, &textLen);
+    Option **macroCopy;
+    INIT_CONFIG(macroCopy);
+    ADD_OPT_STR(macroCopy, "s", "none");
+    ADD_OPT_LONG(macroCopy, "n", 0);
+    ConfigParser *parser = configParserCreate(macroCopy, "written", NULL);
+    configParserFeed(parser, text, textLen);
+    configParserFinish(parser);
+    char *s = NULL;
+    long n = 0;
+    get(macroCopy, "s", &s);
+    get(macroCopy, "n", &n);
+    bool refused = !written && !strchr(text, '#') && !strcmp(s, "none") && n == 42;
+    printf("string with a # line: %s\n", refused ? "refused, the rest round trips" : "WRITTEN");
+    benchFailed |= !refused;
+    free(text);
+    cleanOptions(macroCopy);
+    cleanOptions(macro);
+
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+        double start = nowNs();
+        FILE *fp = fopen(path, "w");
+        fprintf(fp, "longs = [");
+        for (int i = 0; i < WRITE_BENCH_ELEMENTS; ++i) fprintf(fp, "%s%ld", i ? ", " : "", longs->v_a.a_l[i]);
+        fprintf(fp, "]\ndoubles = [");
+        for (int i = 0; i < WRITE_BENCH_ELEMENTS; ++i) fprintf(fp, "%s%.17g", i ? ", " : "", doubles->v_a.a_d[i]);
+        fprintf(fp, "]\n");
+        fclose(fp);
+        double elapsed = nowNs() - start;
+        if (!best || elapsed < best) best = elapsed;
+    }
+    printf("numbers with fprintf: %7.1f MB/s\n", getFileSize(path) / best * 1e3);
+
+    cleanOptions(numbers);
+    cleanOptions(corpus);
+    unlink(path);
+}
+
+#define RELOAD_BENCH_FILES 2000
+#define RELOAD_BENCH_OPTIONS 10
+
+static char reloadNames[RELOAD_BENCH_FILES * RELOAD_BENCH_OPTIONS][16];
+
+static void writeReloadFragment(const char *dir, int file, int version) {
+    char path[96], tmp[sizeof(path) + 4];
+    snprintf(path, sizeof(path), "%s/conf.d/%04d.conf", dir, file);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    for (int j = 0; j < RELOAD_BENCH_OPTIONS; ++j) {
+        fprintf(fp, "%s = \"fragment %d option %d version %d, padded to look like a real value\"\n",
+                reloadNames[file * RELOAD_BENCH_OPTIONS + j], file, j, version);
+    }
+    fclose(fp);
+    rename(tmp, path);
+}
+
+static void benchReload(void) {
+    printf("== reload: readConfig after changing some of %d fragments, full against setIncrementalReload ==\n",
+           RELOAD_BENCH_FILES);
+    char dir[] = "/tmp/libconf_bench_XXXXXX";
+    char path[96];
+    mkdtemp(dir);
+    snprintf(path, sizeof(path), "%s/conf.d", dir);
+    mkdir(path, 0700);
+    for (int i = 0; i < RELOAD_BENCH_FILES * RELOAD_BENCH_OPTIONS; ++i) {
+        snprintf(reloadNames[i], sizeof(reloadNames[i]), "reload_%d", i);
+    }
+    for (int i = 0; i < RELOAD_BENCH_FILES; ++i) writeReloadFragment(dir, i, 0);
+    snprintf(path, sizeof(path), "%s/main.conf", dir);
+    FILE *fp = fopen(path, "w");
+    fprintf(fp, "#include \"conf.d/*.conf\"\n");
+    fclose(fp);
+
+    Option **configs[2];
+    for (int c = 0; c < 2; ++c) {
+        INIT_CONFIG(configs[c]);
+        for (int i = 0; i < RELOAD_BENCH_FILES * RELOAD_BENCH_OPTIONS; ++i) {
+            ADD_OPT_STR(configs[c], reloadNames[i], "");
+        }
+        setIncrementalReload(configs[c], c == 1);
+        readConfig(configs[c], path);
+    }
+    //Past a quarter of the fragments the incremental config reads everything again, which stats shows as includes
+    ParseStats stats[2] = {0};
+    setParseStats(configs[0], &stats[0]);
+    setParseStats(configs[1], &stats[1]);
+    static const int changes[] = {1, 10, 100, 250, 500, 501, 1000, 2000};
+    int version = 1;
+    for (size_t n = 0; n < sizeof(changes) / sizeof(changes[0]); ++n) {
+        int changed = changes[n];
+        double best[2] = {0, 0};
+        bool cutOver = false;
+        for (int run = 0; run < 3; ++run, ++version) {
+            for (int i = 0; i < changed; ++i) {
+                writeReloadFragment(dir, (int) ((long) i * RELOAD_BENCH_FILES / changed), version);
+            }
+            for (int c = 0; c < 2; ++c) {
+                double start = nowNs();
+                readConfig(configs[c], path);
+                double elapsed = nowNs() - start;
+                if (!best[c] || elapsed < best[c]) best[c] = elapsed;
+            }
+            cutOver = stats[1].includes != 0;
+        }
+        printf("%4d changed: full %7.2f ms, incremental %7.2f ms%s\n", changed, best[0] / 1e6, best[1] / 1e6,
+               cutOver ? " (read in full)" : "");
+    }
+    setParseStats(configs[0], NULL);
+    setParseStats(configs[1], NULL);
+    parseStatsFree(&stats[0]);
+    parseStatsFree(&stats[1]);
+    size_t differing = 0;
+    for (int i = 0; i < RELOAD_BENCH_FILES * RELOAD_BENCH_OPTIONS; ++i) {
+        char *full = NULL, *incremental = NULL;
+        get(configs[0], reloadNames[i], &full);
+        get(configs[1], reloadNames[i], &incremental);
+        differing += !full || !incremental || strcmp(full, incremental) != 0;
+    }
+    printf("options that differ between the two: %zu\n", differing);
+    cleanOptions(configs[0]);
+    cleanOptions(configs[1]);
+
+    unlink(path);
+    for (int i = 0; i < RELOAD_BENCH_FILES; ++i) {
+        snprintf(path, sizeof(path), "%s/conf.d/%04d.conf", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/conf.d", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+#define SHARED_BENCH_OPTIONS 2000
+#define SHARED_BENCH_SECONDS 1
+
+static char sharedNames[SHARED_BENCH_OPTIONS][16];
+
+typedef struct SharedBench {
+    Option **config; //Guarded by lock, for the rwlock runs
+    SharedConfig *shared; //NULL for the rwlock runs
+    pthread_rwlock_t lock;
+    const char *paths[2];
+    atomic_bool stop;
+    atomic_ulong reads;
+    atomic_ulong reloads;
+    atomic_ulong torn;
+} SharedBench;
+
+//Every option of a file has the same value, a reader that sees two different ones saw a half read config
+static void readShared(SharedBench *bench, Option **config, uint64_t *state) {
+    long first = -1, second = -2;
+    get(config, sharedNames[nextIndex(state, SHARED_BENCH_OPTIONS)], &first);
+    get(config, sharedNames[nextIndex(state, SHARED_BENCH_OPTIONS)], &second);
+    if (first != second) atomic_fetch_add(&bench->torn, 1);
+}
+
+static void *sharedReader(void *arg) {
+    SharedBench *bench = arg;
+    uint64_t state = (uintptr_t) &state;
+    unsigned long reads = 0;
+    while (!atomic_load_explicit(&bench->stop, memory_order_relaxed)) {
+        if (bench->shared) {
+            Option **config = sharedConfigAcquire(bench->shared);
+            readShared(bench, config, &state);
+            sharedConfigRelease(bench->shared);
+        } else {
+            pthread_rwlock_rdlock(&bench->lock);
+            readShared(bench, bench->config, &state);
+            pthread_rwlock_unlock(&bench->lock);
+        }
+        reads++;
+    }
+    atomic_fetch_add(&bench->reads, reads);
+    return NULL;
+}
+
+static void *sharedWriter(void *arg) {
+    SharedBench *bench = arg;
+    for (unsigned long i = 0; !atomic_load(&bench->stop); ++i) {
+        if (bench->shared) {
+            sharedConfigRead(bench->shared, bench->paths[i % 2]);
+        } else {
+            pthread_rwlock_wrlock(&bench->lock);
+            readConfig(bench->config, bench->paths[i % 2]);
+            pthread_rwlock_unlock(&bench->lock);
+        }
+        atomic_fetch_add(&bench->reloads, 1);
+    }
+    return NULL;
+}
+
+static void benchShared(void) {
+    printf("== shared: reader throughput during continuous reloads of %d options, rwlock against SharedConfig ==\n",
+           SHARED_BENCH_OPTIONS);
+    char paths[2][64];
+    Option **schema;
+    INIT_CONFIG(schema);
+    for (int i = 0; i < SHARED_BENCH_OPTIONS; ++i) {
+        snprintf(sharedNames[i], sizeof(sharedNames[i]), "shared_%d", i);
+        ADD_OPT_LONG(schema, sharedNames[i], -1);
+    }
+    for (int f = 0; f < 2; ++f) {
+        snprintf(paths[f], sizeof(paths[f]), "/tmp/libconf_bench_shared_%d.conf", f);
+        FILE *fp = fopen(paths[f], "w");
+        for (int i = 0; i < SHARED_BENCH_OPTIONS; ++i) fprintf(fp, "%s = %d\n", sharedNames[i], f);
+        fclose(fp);
+    }
+    readConfig(schema, paths[0]);
+
+    //What a read pays for the protection alone, on one thread with nothing publishing
+    {
+        const int pairs = 10000000;
+        pthread_rwlock_t lock;
+        pthread_rwlock_init(&lock, NULL);
+        double start = nowNs();
+        for (int i = 0; i < pairs; ++i) {
+            pthread_rwlock_rdlock(&lock);
+            pthread_rwlock_unlock(&lock);
+        }
+        double rwlock = (nowNs() - start) / pairs;
+        pthread_rwlock_destroy(&lock);
+        SharedConfig *shared = sharedConfigCreate(schema);
+        Option **volatile config;
+        start = nowNs();
+        for (int i = 0; i < pairs; ++i) {
+            config = sharedConfigAcquire(shared);
+            sharedConfigRelease(shared);
+        }
+        double acquire = (nowNs() - start) / pairs;
+        (void) config;
+        sharedConfigFree(shared);
+        printf("uncontended: rdlock + unlock %.1f ns, acquire + release %.1f ns\n", rwlock, acquire);
+    }
+
+    for (int mode = 0; mode < 2; ++mode) {
+        for (int readers = 1; readers <= 4; readers *= 2) {
+            SharedBench bench = {.config = schema, .paths = {paths[0], paths[1]}};
+            //Readers would otherwise keep the writer out for the whole run, and read a config that never changes
+            pthread_rwlockattr_t attr;
+            pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+            pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+            pthread_rwlock_init(&bench.lock, &attr);
+            pthread_rwlockattr_destroy(&attr);
+            if (mode) {
+                bench.shared = sharedConfigCreate(schema);
+                sharedConfigRead(bench.shared, paths[0]);
+            }
+            pthread_t threads[5];
+            for (int i = 0; i < readers; ++i) pthread_create(&threads[i], NULL, sharedReader, &bench);
+            pthread_create(&threads[readers], NULL, sharedWriter, &bench);
+            sleep(SHARED_BENCH_SECONDS);
+            atomic_store(&bench.stop, true);
+            for (int i = 0; i <= readers; ++i) pthread_join(threads[i], NULL);
+            printf("%s, %d readers: %8.2f M reads/s, %5lu reloads/s, %lu torn reads\n",
+                   mode ? "SharedConfig" : "rwlock      ", readers,
+                   atomic_load(&bench.reads) / 1e6 / SHARED_BENCH_SECONDS,
+                   atomic_load(&bench.reloads) / SHARED_BENCH_SECONDS, atomic_load(&bench.torn));
+            sharedConfigFree(bench.shared);
+            pthread_rwlock_destroy(&bench.lock);
+        }
+    }
+    cleanOptions(schema);
+    unlink(paths[0]);
+    unlink(paths[1]);
+}
+
+/*
+ * The suite: every corpus kind at sizes from --min-bytes to --max-bytes (32 times larger each step), each size run
+ * --reps times with a fresh schema. Phases are timed with CLOCK_MONOTONIC: init (building the schema), read (the raw
+ * bytes of every file, for reference), load (readConfig: reading, preprocessing and parsing), lookup (get() of the
+ * corpus's sample paths) and clean (cleanOptions). The preprocess and parse parts of load come from setParseStats,
+ * which is set on every schema, so load includes what collecting the statistics costs. A table of medians goes to
+ * stdout and, with --json, one JSON object per corpus and size is appended to a file, to be tracked across builds.
+ */
+#define SUITE_MIN_BYTES 1024
+#define SUITE_MAX_BYTES ((size_t) 32 << 20)
+#define SUITE_REPS 5
+
+enum SuitePhase {
+    PHASE_INIT,
+    PHASE_READ,
+    PHASE_LOAD,
+    PHASE_PREPROCESS,
+    PHASE_PARSE,
+    PHASE_LOOKUP,
+    PHASE_CLEAN,
+    PHASES
+};
+
+static const char *const phaseNames[PHASES] = {"init", "read", "load", "preprocess", "parse", "lookup",
+                                                   "clean"};
+
+typedef struct SuiteOptions {
+    size_t minBytes;
+    size_t maxBytes;
+    int reps;
+    unsigned kinds; //Bit per CorpusKind
+    const char *json;
+} SuiteOptions;
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+//"64", "32K", "1M", "1G"
+static size_t parseBytes(const char *text) {
+    char *end;
+    size_t value = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'k':
+        case 'K':
+            return value << 10;
+        case 'm':
+        case 'M':
+            return value << 20;
+        case 'g':
+        case 'G':
+            return value << 30;
+        default:
+            return value;
+    }
+}
+
+static double readCorpus(const Corpus *corpus) {
+    double start = nowNs();
+    for (size_t i = 0; i < corpus->fileCount; ++i) {
+        FILE *fp = fopen(corpus->files[i], "rb");
+        if (!fp) continue;
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        rewind(fp);
+        char *buffer = malloc(size > 0 ? (size_t) size : 1);
+        if (buffer && fread(buffer, 1, (size_t) size, fp) != (size_t) size) fprintf(stderr, "Short read\n");
+        free(buffer);
+        fclose(fp);
+    }
+    return nowNs() - start;
+}
+
+static void runSuiteCase(Corpus *corpus, const SuiteOptions *options, FILE *json) {
+    double *times[PHASES];
+    for (int p = 0; p < PHASES; ++p) times[p] = malloc(options->reps * sizeof(double));
+    size_t found = 0;
+    ParseStats stats = {0};
+    for (int rep = 0; rep < options->reps; ++rep) {
+        double start = nowNs();
+        Option **config = corpusSchema(corpus);
+        times[PHASE_INIT][rep] = nowNs() - start;
+        times[PHASE_READ][rep] = readCorpus(corpus);
+        setParseStats(config, &stats);
+        start = nowNs();
+        readConfig(config, corpus->path);
+        times[PHASE_LOAD][rep] = nowNs() - start;
+        times[PHASE_PREPROCESS][rep] = (double) stats.preprocessNs;
+        times[PHASE_PARSE][rep] = (double) stats.parseNs;
+        start = nowNs();
+        for (size_t i = 0; i < corpus->lookupCount; ++i) found += get_(config, corpus->lookups[i]) != NULL;
+        times[PHASE_LOOKUP][rep] = nowNs() - start;
+        start = nowNs();
+        cleanOptions(config);
+        times[PHASE_CLEAN][rep] = nowNs() - start;
+    }
+
+    double median[PHASES];
+    for (int p = 0; p < PHASES; ++p) {
+        qsort(times[p], options->reps, sizeof(double), compareDoubles);
+        median[p] = times[p][options->reps / 2];
+    }
+    double loadMbs = (double) corpus->bytes / (median[PHASE_LOAD] / 1e9) / (1 << 20);
+    double lookupNs = corpus->lookupCount ? median[PHASE_LOOKUP] / (double) corpus->lookupCount : 0;
+    printf("%-9s %11zu %6zu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.2f %7.1f\n", corpusName(corpus->kind),
+           corpus->bytes, corpus->fileCount, median[PHASE_INIT] / 1e6, median[PHASE_READ] / 1e6,
+           median[PHASE_LOAD] / 1e6, median[PHASE_PREPROCESS] / 1e6, median[PHASE_PARSE] / 1e6,
+           median[PHASE_CLEAN] / 1e6, loadMbs, lookupNs);
+    if (found != (size_t) options->reps * corpus->lookupCount) {
+        fprintf(stderr, "Suite: %zu of the %s lookups failed\n", (size_t) options->reps * corpus->lookupCount - found,
+                corpusName(corpus->kind));
+    }
+
+    if (json) {
+        fprintf(json, "{\"time\": %ld, \"corpus\": \"%s\", \"bytes\": %zu, \"files\": %zu, \"units\": %zu, "
+                      "\"lookups\": %zu, \"reps\": %d, \"load_mb_s\": %.2f, \"lookup_ns\": %.1f, \"phases\": {",
+                (long) time(NULL), corpusName(corpus->kind), corpus->bytes, corpus->fileCount, corpus->units,
+                corpus->lookupCount, options->reps, loadMbs, lookupNs);
+        for (int p = 0; p < PHASES; ++p) {
+            fprintf(json, "%s\"%s\": {\"min_ns\": %.0f, \"median_ns\": %.0f, \"max_ns\": %.0f}", p ? ", " : "",
+                    phaseNames[p], times[p][0], median[p], times[p][options->reps - 1]);
+        }
+        fprintf(json, "}}\n");
+        fflush(json);
+    }
+    for (int p = 0; p < PHASES; ++p) free(times[p]);
+    parseStatsFree(&stats);
+}
+
+static int benchSuite(int argc, char **argv) {
+    SuiteOptions options = {SUITE_MIN_BYTES, SUITE_MAX_BYTES, SUITE_REPS, 0, NULL};
+    for (int i = 0; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!value) {
+            fprintf(stderr, "Usage: libconf_bench suite [--min-bytes N[K|M|G]] [--max-bytes N[K|M|G]] [--reps N] "
+                            "[--corpus flat,nested,arrays,strings,includes] [--json FILE]\n");
+            return 2;
+        }
+        ++i;
+        if (!strcmp(arg, "--min-bytes")) {
+            options.minBytes = parseBytes(value);
+        } else if (!strcmp(arg, "--max-bytes")) {
+            options.maxBytes = parseBytes(value);
+        } else if (!strcmp(arg, "--reps")) {
+            options.reps = atoi(value) > 0 ? atoi(value) : 1;
+        } else if (!strcmp(arg, "--json")) {
+            options.json = value;
+        } else if (!strcmp(arg, "--corpus")) {
+            for (int k = 0; k < CORPUS_KINDS; ++k) {
+                if (strstr(value, corpusName(k))) options.kinds |= 1u << k;
+            }
+        } else {
+            fprintf(stderr, "Unknown suite option %s\n", arg);
+            return 2;
+        }
+    }
+    if (!options.kinds) options.kinds = (1u << CORPUS_KINDS) - 1;
+    FILE *json = NULL;
+    if (options.json && !(json = fopen(options.json, "a"))) {
+        fprintf(stderr, "Can't open %s\n", options.json);
+        return 1;
+    }
+
+    printf("== suite: median of %d runs, phases in ms, load throughput and ns per lookup ==\n", options.reps);
+    printf("%-9s %11s %6s %9s %9s %9s %9s %9s %9s %9s %7s\n", "corpus", "bytes", "files", "init", "read", "load",
+           "prep", "parse", "clean", "load MB/s", "lookup");
+    for (int k = 0; k < CORPUS_KINDS; ++k) {
+        if (!(options.kinds & 1u << k)) continue;
+        for (size_t bytes = options.minBytes; bytes <= options.maxBytes; bytes *= 32) {
+            Corpus corpus;
+            if (!corpusGenerate(&corpus, k, bytes)) {
+                fprintf(stderr, "Can't generate a %zu byte %s corpus\n", bytes, corpusName(k));
+                continue;
+            }
+            runSuiteCase(&corpus, &options, json);
+            corpusFree(&corpus);
+        }
+    }
+    if (json) fclose(json);
+    return 0;
+}
+
+//With no arguments the micro benchmarks run, "suite" runs the corpus suite instead
+int main(int argc, char **argv) {
+    if (argc > 1 && !strcmp(argv[1], "suite")) return benchSuite(argc - 2, argv + 2);
+    if (argc > 1) {
+        fprintf(stderr, "Usage: libconf_bench [suite [options]]\n");
+        return 2;
+    }
+    benchLookup();
+    benchFreeze();
+    benchFootprint();
+    benchHandle();
+    benchBind();
+    benchArena();
+    benchStatic();
+    benchScan();
+    benchStats();
+    benchDiagnostics();
+    benchNumeric();
+    benchParallel();
+    benchElements();
+    benchMemory();
+    benchInclude();
+    benchCache();
+    benchWrite();
+    benchReload();
+    benchShared();
+    return benchFailed;
+}
@@ -0,0 +1,333 @@
+#include "corpus.h"
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char *const kindNames[CORPUS_KINDS] = {"flat", "nested", "arrays", "strings", "includes"};
+
+//Text the strings of a string corpus are cut from, nothing in it needs escaping
+static const char lorem[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut "
+                            "labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco "
+                            "laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in "
+                            "voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat "
+                            "cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.";
+
+static char *stringArrayDefault[] = {"none"};
+
+const char *corpusName(CorpusKind kind) {
+    return kind < CORPUS_KINDS ? kindNames[kind] : "unknown";
+}
+
+static char *nameAt(const Corpus *corpus, size_t i) {
+    return corpus->nameData + i * CORPUS_NAME_LEN;
+}
+
+static FILE *openFile(Corpus *corpus, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return NULL;
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+    char **files = realloc(corpus->files, (corpus->fileCount + 1) * sizeof(char *));
+    if (!files) {
+        fclose(fp);
+        return NULL;
+    }
+    corpus->files = files;
+    corpus->files[corpus->fileCount++] = strdup(path);
+    return fp;
+}
+
+static void put(Corpus *corpus, FILE *fp, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vfprintf(fp, format, args);
+    va_end(args);
+    if (written > 0) corpus->bytes += (size_t) written;
+}
+
+static void writeFlat(Corpus *corpus, FILE *fp, size_t bytes) {
+    size_t i = 0;
+    for (; corpus->bytes < bytes; ++i) {
+        size_t k = i % CORPUS_MAX_OPTIONS;
+        switch (k % 4) {
+            case 0:
+                put(corpus, fp, "opt_%zu = %zu\n", k, i);
+                break;
+            case 1:
+                put(corpus, fp, "opt_%zu = %zu.25\n", k, i);
+                break;
+            case 2:
+                put(corpus, fp, "opt_%zu = %s\n", k, i & 4 ? "yes" : "false");
+                break;
+            default:
+                put(corpus, fp, "opt_%zu = \"value %zu\"\n", k, i);
+                break;
+        }
+    }
+    corpus->units = i;
+    corpus->distinct = i < CORPUS_MAX_OPTIONS ? i : CORPUS_MAX_OPTIONS;
+}
+
+static void writeNested(Corpus *corpus, FILE *fp, size_t bytes) {
+    size_t g = 0;
+    for (; corpus->bytes < bytes; ++g) {
+        size_t id = g % CORPUS_MAX_GROUPS;
+        put(corpus, fp, "group_%zu = {\n", id);
+        for (int d = 0; d < CORPUS_NESTED_DEPTH; ++d) {
+            int indent = 2 * (d + 1);
+            put(corpus, fp, "%*sa = %zu\n%*sb = \"level %d of %zu\"\n", indent, "", g, indent, "", d, g);
+            if (d + 1 < CORPUS_NESTED_DEPTH) put(corpus, fp, "%*slevel_%d = {\n", indent, "", d + 1);
+        }
+        for (int d = CORPUS_NESTED_DEPTH - 1; d >= 0; --d) put(corpus, fp, "%*s}\n", 2 * d, "");
+    }
+    corpus->units = g;
+    corpus->distinct = g < CORPUS_MAX_GROUPS ? g : CORPUS_MAX_GROUPS;
+}
+
+//Two fifths of the bytes are longs, one fifth doubles, the rest compound elements
+static void writeArrays(Corpus *corpus, FILE *fp, size_t bytes) {
+    size_t numbers = 0, ratios = 0, items = 0;
+    put(corpus, fp, "numbers = [");
+    for (; corpus->bytes < bytes / 5 * 2; ++numbers) {
+        put(corpus, fp, "%s%zu", !numbers ? "" : numbers % 16 ? ", " : ",\n", numbers * 7919 % 1000003);
+    }
+    put(corpus, fp, "]\nratios = [");
+    for (; corpus->bytes < bytes / 5 * 3; ++ratios) {
+        put(corpus, fp, "%s%zu.5", !ratios ? "" : ratios % 16 ? ", " : ",\n", ratios);
+    }
+    put(corpus, fp, "]\nitems = [");
+    for (; corpus->bytes < bytes || !items; ++items) {
+        put(corpus, fp, "%s{ id = %zu\n  name = \"item %zu\" }", items ? ", " : "", items, items);
+    }
+    put(corpus, fp, "]\n");
+    corpus->units = numbers + ratios + items;
+    corpus->distinct = items;
+}
+
+//Strings of 64 to 191 characters, every eighth option an array of four shorter ones
+static void writeStrings(Corpus *corpus, FILE *fp, size_t bytes) {
+    size_t i = 0;
+    for (; corpus->bytes < bytes; ++i) {
+        size_t k = i % CORPUS_MAX_OPTIONS;
+        const char *text = lorem + i % 64;
+        if (k % 8 == 7) {
+            put(corpus, fp, "strs_%zu = [\"%.40s\", \"%.32s\", \"%.48s\", \"%.24s\"]\n", k, text, text + 40, text + 72,
+                text + 120);
+        } else {
+            put(corpus, fp, "str_%zu = \"%.*s\"\n", k, (int) (64 + i % 128), text);
+        }
+    }
+    corpus->units = i;
+    corpus->distinct = i < CORPUS_MAX_OPTIONS ? i : CORPUS_MAX_OPTIONS;
+}
+
+static bool writeIncludes(Corpus *corpus, FILE *fp, size_t bytes) {
+    put(corpus, fp, "main = 1\n#include \"inc/*.conf\"\n");
+    char path[192];
+    snprintf(path, sizeof(path), "%s/inc", corpus->dir);
+    if (mkdir(path, 0700) != 0) return false;
+
+    size_t fragments = bytes / 4096 + 1;
+    if (fragments > CORPUS_MAX_FRAGMENTS) fragments = CORPUS_MAX_FRAGMENTS;
+    size_t fragmentBytes = bytes / fragments;
+    corpus->perUnit = fragmentBytes / 24 + 1;
+    if (corpus->perUnit > CORPUS_MAX_OPTIONS / fragments) corpus->perUnit = CORPUS_MAX_OPTIONS / fragments;
+    for (size_t f = 0; f < fragments; ++f) {
+        snprintf(path, sizeof(path), "%s/inc/frag_%05zu.conf", corpus->dir, f);
+        FILE *fragment = openFile(corpus, path);
+        if (!fragment) return false;
+        size_t end = corpus->bytes + fragmentBytes;
+        for (size_t j = 0; corpus->bytes < end; ++j) {
+            size_t k = j % corpus->perUnit;
+            if (k % 2) put(corpus, fragment, "f%zu_%zu = \"fragment %zu\"\n", f, k, j);
+            else put(corpus, fragment, "f%zu_%zu = %zu\n", f, k, j);
+        }
+        fclose(fragment);
+    }
+    corpus->units = fragments;
+    corpus->distinct = fragments * corpus->perUnit;
+    return true;
+}
+
+//Names of the options (groups for a nested corpus) the schema has, in the order the writers number them
+static bool makeNames(Corpus *corpus) {
+    corpus->nameCount = corpus->kind == CORPUS_ARRAYS ? 0 : corpus->distinct;
+    corpus->nameData = malloc(corpus->nameCount * CORPUS_NAME_LEN + 1);
+    if (!corpus->nameData) return false;
+    for (size_t i = 0; i < corpus->nameCount; ++i) {
+        char *name = nameAt(corpus, i);
+        switch (corpus->kind) {
+            case CORPUS_FLAT:
+                snprintf(name, CORPUS_NAME_LEN, "opt_%zu", i);
+                break;
+            case CORPUS_NESTED:
+                snprintf(name, CORPUS_NAME_LEN, "group_%zu", i);
+                break;
+            case CORPUS_STRINGS:
+                snprintf(name, CORPUS_NAME_LEN, i % 8 == 7 ? "strs_%zu" : "str_%zu", i);
+                break;
+            default:
+                snprintf(name, CORPUS_NAME_LEN, "f%zu_%zu", i / corpus->perUnit, i % corpus->perUnit);
+                break;
+        }
+    }
+    return true;
+}
+
+//Evenly spread over what the schema has, so lookups touch all of it
+static bool makeLookups(Corpus *corpus) {
+    size_t count = corpus->distinct;
+    size_t step = count / CORPUS_LOOKUP_SAMPLE + 1;
+    corpus->lookups = malloc((count / step + 2) * sizeof(char *));
+    if (!corpus->lookups) return false;
+    char path[256];
+    for (size_t i = 0; i < count; i += step) {
+        switch (corpus->kind) {
+            case CORPUS_NESTED:
+                snprintf(path, sizeof(path), "%s.level_1.level_2.level_3.level_4.level_5.a", nameAt(corpus, i));
+                break;
+            case CORPUS_ARRAYS:
+                snprintf(path, sizeof(path), "items[%zu].id", i);
+                break;
+            default:
+                snprintf(path, sizeof(path), "%s", nameAt(corpus, i));
+                break;
+        }
+        corpus->lookups[corpus->lookupCount++] = strdup(path);
+    }
+    if (corpus->kind == CORPUS_ARRAYS) {
+        corpus->lookups[corpus->lookupCount++] = strdup("numbers");
+    }
+    return true;
+}
+
+bool corpusGenerate(Corpus *corpus, CorpusKind kind, size_t bytes) {
+    memset(corpus, 0, sizeof(Corpus));
+    corpus->kind = kind;
+    snprintf(corpus->dir, sizeof(corpus->dir), "/tmp/libconf_corpus_XXXXXX");
+    if (!mkdtemp(corpus->dir)) return false;
+    snprintf(corpus->path, sizeof(corpus->path), "%s/main.conf", corpus->dir);
+    FILE *fp = openFile(corpus, corpus->path);
+    if (!fp) {
+        corpusFree(corpus);
+        return false;
+    }
+
+    bool written = true;
+    switch (kind) {
+        case CORPUS_FLAT:
+            writeFlat(corpus, fp, bytes);
+            break;
+        case CORPUS_NESTED:
+            writeNested(corpus, fp, bytes);
+            break;
+        case CORPUS_ARRAYS:
+            writeArrays(corpus, fp, bytes);
+            break;
+        case CORPUS_STRINGS:
+            writeStrings(corpus, fp, bytes);
+            break;
+        default:
+            written = writeIncludes(corpus, fp, bytes);
+            break;
+    }
+    if (fclose(fp) != 0 || !written || !makeNames(corpus) || !makeLookups(corpus)) {
+        corpusFree(corpus);
+        return false;
+    }
+    return true;
+}
+
+static Option **nestedGroup(void) {
+    static const char *levels[CORPUS_NESTED_DEPTH] = {NULL, "level_1", "level_2", "level_3", "level_4", "level_5"};
+    Option **tables[CORPUS_NESTED_DEPTH];
+    for (int d = 0; d < CORPUS_NESTED_DEPTH; ++d) {
+        INIT_CONFIG(tables[d]);
+        ADD_OPT_LONG(tables[d], "a", 0);
+        ADD_OPT_STR(tables[d], "b", "none");
+    }
+    for (int d = CORPUS_NESTED_DEPTH - 1; d > 0; --d) {
+        ADD_OPT_COMPOUND(tables[d - 1], (char *) levels[d], tables[d]);
+    }
+    return tables[0];
+}
+
+void corpusAddItems(Option **config, char *name, Option **item) {
+    Option *opt = optionAlloc(config);
+    opt->name = name;
+    opt->type = ARRAY;
+    opt->def->dv_a = (ArrayOption) {.type = COMPOUND, .a_v.a_v_t = item};
+    opt->v_a = opt->def->dv_a;
+    HASH_ADD(config, opt);
+}
+
+Option **corpusSchema(Corpus *corpus) {
+    Option **config;
+    INIT_CONFIG_SIZED(config, corpus->nameCount + 1);
+    if (corpus->kind == CORPUS_ARRAYS) {
+        //cleanOptions leaves templates to their owner, which is the corpus here
+        if (!corpus->itemTemplate) {
+            INIT_CONFIG(corpus->itemTemplate);
+            ADD_OPT_LONG(corpus->itemTemplate, "id", -1);
+            ADD_OPT_STR(corpus->itemTemplate, "name", "none");
+        }
+        static long numbersDefault[] = {0};
+        ADD_OPT_ARRAY_LONG(config, "numbers", numbersDefault);
+        static double ratiosDefault[] = {0};
+        ADD_OPT_ARRAY_DOUBLE(config, "ratios", ratiosDefault);
+        corpusAddItems(config, "items", corpus->itemTemplate);
+        return config;
+    }
+    if (corpus->kind == CORPUS_INCLUDES) ADD_OPT_LONG(config, "main", 0);
+    for (size_t i = 0; i < corpus->nameCount; ++i) {
+        char *name = nameAt(corpus, i);
+        switch (corpus->kind) {
+            case CORPUS_FLAT:
+                if (i % 4 == 0) {
+                    ADD_OPT_LONG(config, name, 0);
+                } else if (i % 4 == 1) {
+                    ADD_OPT_DOUBLE(config, name, 0);
+                } else if (i % 4 == 2) {
+                    ADD_OPT_BOOL(config, name, false);
+                } else {
+                    ADD_OPT_STR(config, name, "none");
+                }
+                break;
+            case CORPUS_NESTED:
+                ADD_OPT_COMPOUND(config, name, nestedGroup());
+                break;
+            case CORPUS_STRINGS:
+                if (i % 8 == 7) {
+                    ADD_OPT_ARRAY_STR(config, name, stringArrayDefault, 1);
+                } else {
+                    ADD_OPT_STR(config, name, "none");
+                }
+                break;
+            default:
+                if (i % corpus->perUnit % 2) {
+                    ADD_OPT_STR(config, name, "none");
+                } else {
+                    ADD_OPT_LONG(config, name, 0);
+                }
+                break;
+        }
+    }
+    return config;
+}
+
+void corpusFree(Corpus *corpus) {
+    for (size_t i = 0; i < corpus->fileCount; ++i) {
+        unlink(corpus->files[i]);
+        free(corpus->files[i]);
+    }
+    free(corpus->files);
+    char path[192];
+    snprintf(path, sizeof(path), "%s/inc", corpus->dir);
+    rmdir(path);
+    rmdir(corpus->dir);
+    free(corpus->nameData);
+    for (size_t i = 0; i < corpus->lookupCount; ++i) free(corpus->lookups[i]);
+    free(corpus->lookups);
+    cleanOptions(corpus->itemTemplate);
+    memset(corpus, 0, sizeof(Corpus));
+}
@@ -0,0 +1,57 @@
+#ifndef LIBCONF_CORPUS_H
+#define LIBCONF_CORPUS_H
+
+#include "../include/libconf.h"
+
+/*
+ * Generated configs for the benchmark suite (libconf_bench suite). Each kind grows by repeating one unit until the
+ * files reach the requested size, and comes with the schema that reads it and a sample of option paths to look up.
+ */
+typedef enum CorpusKind {
+    CORPUS_FLAT, //Top level longs, doubles, bools and short strings
+    CORPUS_NESTED, //Groups of compounds nested CORPUS_NESTED_DEPTH deep
+    CORPUS_ARRAYS, //A few huge arrays: longs, doubles and compound elements
+    CORPUS_STRINGS, //Long strings and string arrays
+    CORPUS_INCLUDES, //A main file that includes a directory of flat fragments
+    CORPUS_KINDS
+} CorpusKind;
+
+#define CORPUS_NESTED_DEPTH 6
+#define CORPUS_LOOKUP_SAMPLE 100000 //Most paths a corpus keeps for the lookup phase
+#define CORPUS_MAX_FRAGMENTS 4096 //Fragments of an include corpus, which get bigger instead past this
+#define CORPUS_MAX_OPTIONS 1000000 //Distinct options of a corpus, larger ones assign them again
+#define CORPUS_MAX_GROUPS 20000 //Same for the groups of a nested corpus
+#define CORPUS_NAME_LEN 48 //Fits the longest name, "f%zu_%zu" of two 20 digit numbers
+
+typedef struct Corpus {
+    CorpusKind kind;
+    char dir[64]; //Temporary directory holding the files
+    char path[128]; //The main file, what readConfig is given
+    char **files; //Every file, the main one first
+    size_t fileCount;
+    size_t bytes; //Over all files
+    size_t units; //Options, groups, array elements or fragments written
+    size_t distinct; //Options or groups the schema has, units up to the CORPUS_MAX_* limits
+    size_t perUnit; //Options per fragment of an include corpus
+    char *nameData; //nameCount names of CORPUS_NAME_LEN bytes each, which the schema points to
+    size_t nameCount;
+    char **lookups; //Paths of options the corpus assigns, a sample of at most CORPUS_LOOKUP_SAMPLE
+    size_t lookupCount;
+    Option **itemTemplate; //Template of the compound array of an arrays corpus, shared by its schemas
+} Corpus;
+
+const char *corpusName(CorpusKind kind);
+
+//Writes a corpus of about bytes bytes into a new directory under /tmp, false if it couldn't
+bool corpusGenerate(Corpus *corpus, CorpusKind kind, size_t bytes);
+
+//A fresh schema for the corpus, every option at a default the file overrides
+Option **corpusSchema(Corpus *corpus);
+
+//Adds a compound array of item elements that has none by default, which ADD_OPT_ARRAY_COMPOUND can't take as NULL
+void corpusAddItems(Option **config, char *name, Option **item);
+
+//Removes the files and frees the corpus (schemas made from it have to be cleaned first)
+void corpusFree(Corpus *corpus);
+
+#endif //LIBCONF_CORPUS_H
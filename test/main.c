@@ -1,6 +1,135 @@
 #include "../include/libconf.h"
 #include "timer.h"
 
+#ifdef __linux__
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static ConfigWatch *watch;
+static atomic_bool watchStop;
+static atomic_ulong watchTorn;
+
+static void watchWrite(const char *dir, const char *name, const char *text) {
+    char path[256], tmp[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "w");
+    fputs(text, file);
+    fclose(file);
+    rename(tmp, path); //Replaced in one step, like an editor saving it
+}
+
+//Both values of a version come from the same write, a reader seeing them disagree saw a half-updated config
+static void *watchReader(void *arg) {
+    while (!atomic_load(&watchStop)) {
+        Option **current = configWatchAcquire(watch);
+        long a = -1;
+        char *s = NULL;
+        get(current, "a", &a);
+        get(current, "s", &s);
+        if (!s || a != atol(s)) atomic_fetch_add(&watchTorn, 1);
+        configWatchRelease(watch, current);
+    }
+    return NULL;
+}
+
+static bool watchWait(unsigned long version) {
+    for (int i = 0; i < 200 && configWatchVersion(watch) <= version; ++i) usleep(10000);
+    return configWatchVersion(watch) > version;
+}
+
+//False if a reader saw a half-updated config or a write wasn't picked up
+static bool watchDemo(void) {
+    char dir[] = "/tmp/libconf_watch_XXXXXX";
+    if (!mkdtemp(dir)) return false;
+    char path[256], fragments[256];
+    snprintf(path, sizeof(path), "%s/watch.config", dir);
+    snprintf(fragments, sizeof(fragments), "%s/watch.d", dir);
+    mkdir(fragments, 0700);
+    watchWrite(dir, "watch.config", "a = 0\ns = \"0\"\n#include \"watch.d/*.conf\"\n");
+    watchWrite(fragments, "b.conf", "b = 0\n");
+
+    Option **schema;
+    INIT_CONFIG(schema);
+    ADD_OPT_LONG(schema, "a", -1);
+    ADD_OPT_LONG(schema, "b", -1);
+    ADD_OPT_STR(schema, "s", "none");
+    watch = configWatchCreate(schema, path, 20);
+
+    pthread_t readers[4];
+    for (int i = 0; i < 4; ++i) pthread_create(&readers[i], NULL, watchReader, NULL);
+    bool advanced = true;
+    for (int i = 1; i <= 20; ++i) {
+        char text[128];
+        snprintf(text, sizeof(text), "a = %d\ns = \"%d\"\n#include \"watch.d/*.conf\"\n", i, i);
+        unsigned long version = configWatchVersion(watch);
+        watchWrite(dir, "watch.config", text);
+        advanced &= watchWait(version);
+    }
+    unsigned long version = configWatchVersion(watch);
+    watchWrite(fragments, "b.conf", "b = 42\n");
+    advanced &= watchWait(version);
+    atomic_store(&watchStop, true);
+    for (int i = 0; i < 4; ++i) pthread_join(readers[i], NULL);
+
+    Option **current = configWatchAcquire(watch);
+    long a = 0, b = 0;
+    get(current, "a", &a);
+    get(current, "b", &b);
+    configWatchRelease(watch, current);
+    printf("watch: versions advanced: %s\n", advanced ? "yes" : "no");
+    printf("watch: a = %ld, b (included) = %ld\n", a, b);
+    printf("watch: torn configs seen by readers: %lu\n", atomic_load(&watchTorn));
+    configWatchFree(watch);
+    cleanOptions(schema);
+
+    snprintf(path, sizeof(path), "rm -rf %s", dir);
+    system(path);
+    return advanced && !atomic_load(&watchTorn) && a == 20 && b == 42;
+}
+#endif
+
+//The schema of config in main, declared as data
+static const long arrDefault[] = {33, 22, 44};
+static const double arrdDefault[] = {55.0122, 233.23};
+static const bool arrbDefault[] = {true, false};
+static const char *const arrsDefault[] = {"fakse", "yes", "falssse"};
+static const char *const arrs1Default[] = {"aaaa", "bbbbbb", "cccccc"};
+static const long arraFirst[] = {7767, 345, 12};
+static const long arraSecond[] = {444, 2222221, 211, 44, 334, 56, 33};
+static const ArrayOption arraDefault[] = {{.a_l = (long *) arraFirst, .len = 3, .type = LONG},
+                                          {.a_l = (long *) arraSecond, .len = 7, .type = LONG}};
+
+static const StaticOption elementSchema[] = {
+        STATIC_LONG("breh", 12),
+        STATIC_ARRAY_LONG("arr", arrDefault),
+        STATIC_ARRAY_DOUBLE("arrd", arrdDefault),
+        STATIC_ARRAY_BOOL("arrb", arrbDefault),
+        STATIC_END
+};
+
+static const StaticOption staticSchema[] = {
+        STATIC_DOUBLE("dubl", 32.2),
+        STATIC_STR("str", "test"),
+        STATIC_BOOL("bl", false),
+        STATIC_ARRAY_STR("arrs", arrsDefault, 3),
+        STATIC_ARRAY_STR("arrs1", arrs1Default, 3),
+        STATIC_ARRAY_ARRAY("arra", arraDefault, arraDefault, 2),
+        STATIC_ARRAY_COMPOUND("arrc", elementSchema),
+        STATIC_END
+};
+
+//Where the demo binds options of the static config
+struct Settings {
+    double dubl;
+    char *str;
+    bool bl;
+    ArrayOption arra;
+};
+
 int main() {
     TIMER_START(config);
 
@@ -45,15 +174,26 @@ int main() {
     ADD_OPT_ARRAY_COMPOUND(config, "arrc", configM, NULL);
     TIMER_END(init);
 
+    ParseStats stats = {0};
+    setParseStats(config, &stats);
     TIMER_START(read);
     readConfig(config, "debug/test.config");
     TIMER_END(read);
+    printf("stats: %zu files (%zu included, depth %u), %zu bytes, %zu options, %zu arrays with %zu elements\n",
+           stats.fileCount, stats.includes, stats.includeDepth, stats.bytesRead, stats.options, stats.arrays,
+           stats.arrayElements);
+    setParseStats(config, NULL);
+    parseStatsFree(&stats);
 
     TIMER_START(get);
     double dubl = 0;
     get(config, "dubl", &dubl);
     printf("dubl is: %f\n", dubl);
 
+    OptionHandle dublHandle = getHandle(config, "dubl");
+    get_handle(dublHandle, &dubl);
+    printf("dubl (handle) is: %f\n", dubl);
+
     char *str = NULL;
     get(config, "str", &str);
     printf("str is: %s\n", str);
@@ -113,6 +253,12 @@ int main() {
         printf("arrc[%d].breh is: %d\n", i, breh);
     }
 
+    OptionPath *brehPath = compilePath("arrc[1].breh");
+    long breh = 0;
+    get_path(config, brehPath, &breh);
+    printf("arrc[1].breh (path) is: %ld\n", breh);
+    freePath(brehPath);
+
     ArrayOption *arra = NULL;
     size_t arra_count = 0;
     get_array(config, "arra", &arra, arra_count);
@@ -126,8 +272,97 @@ int main() {
 
     TIMER_END(get);
 
+    TIMER_START(read_mapped);
+    readConfigMapped(config, "debug/test.config");
+    TIMER_END(read_mapped);
+
+    StringView str_view;
+    get(config, "str", &str_view);
+    printf("str (mapped) is: %.*s\n", (int) str_view.len, str_view.ptr);
+
+    StringView *str_views;
+    size_t str_views_len = 0;
+    get_array(config, "arrs", &str_views, str_views_len);
+    for (int i = 0; i < str_views_len; ++i) {
+        printf("arrs[%d] (mapped)=%.*s\n", i, (int) str_views[i].len, str_views[i].ptr);
+    }
+
+    TIMER_START(read_push);
+    FILE *stream = fopen("debug/test.config", "r");
+    ConfigParser *parser = configParserCreate(config, "debug/test.config", "debug/");
+    char chunk[7]; //Small on purpose, so values span chunks
+    size_t chunk_len;
+    while ((chunk_len = fread(chunk, 1, sizeof(chunk), stream)) > 0) configParserFeed(parser, chunk, chunk_len);
+    configParserFinish(parser);
+    fclose(stream);
+    TIMER_END(read_push);
+
+    get(config, "str", &str);
+    printf("str (pushed) is: %s\n", str);
+    get_array(config, "arrc", &opts_arr, opts_arr_len);
+    printf("opts_arr length (pushed) is %zu\n", opts_arr_len);
+
+    TIMER_START(read_cached);
+    readConfigCached(config, "debug/test.config", "debug/test.config.cache"); //Writes the cache if it's stale
+    bool cached = readConfigCached(config, "debug/test.config", "debug/test.config.cache");
+    TIMER_END(read_cached);
+
+    get(config, "str", &str);
+    printf("str (cached, %s) is: %s\n", cached ? "hit" : "miss", str);
+    get_array(config, "arrc", &opts_arr, opts_arr_len);
+    printf("opts_arr length (cached) is %zu\n", opts_arr_len);
+
+    TIMER_START(write);
+    char *written = NULL;
+    size_t written_len = 0;
+    writeConfigString(config, &written, &written_len);
+    TIMER_END(write);
+    printf("written (%zu bytes):\n%s", written_len, written);
+    free(written);
+
     TIMER_START(clean);
     cleanOptions(config);
     TIMER_END(clean);
+
+    TIMER_START(static);
+    Option **configS;
+    INIT_CONFIG_STATIC(configS, staticSchema);
+    struct Settings settings;
+    BIND_OPT(configS, "dubl", struct Settings, dubl);
+    BIND_OPT(configS, "str", struct Settings, str);
+    BIND_OPT(configS, "bl", struct Settings, bl);
+    BIND_OPT(configS, "arra", struct Settings, arra);
+    setBindTarget(configS, &settings);
+    freezeConfig(configS);
+    readConfig(configS, "debug/test.config");
+    TIMER_END(static);
+
+    printf("dubl (bound) is: %f, bl (bound) is: %s\n", settings.dubl, settings.bl ? "true" : "false");
+    printf("str (bound) is: %s, arra (bound) count: %zu\n", settings.str, settings.arra.len);
+
+    get(configS, "str", &str);
+    printf("str (static) is: %s\n", str);
+    get_array(configS, "arrc", &opts_arr, opts_arr_len);
+    printf("opts_arr length (static) is %zu\n", opts_arr_len);
+    brehPath = compilePath("arrc[1].breh");
+    get_path(configS, brehPath, &breh);
+    printf("arrc[1].breh (static) is: %ld\n", breh);
+    freePath(brehPath);
+    long *arr = NULL;
+    size_t arr_len = 0;
+    get_array(opts_arr[1], "arr", &arr, arr_len);
+    printf("arrc[1].arr (static, default) length is %zu\n", arr_len);
+    cleanOptions(configS);
+
+#ifdef __linux__
+    TIMER_START(watch);
+    bool watched = watchDemo();
+    TIMER_END(watch);
+    if (!watched) {
+        fprintf(stderr, "watch: FAILED\n");
+        return 1;
+    }
+#endif
     TIMER_END(config);
+    return 0;
 }